@@ -0,0 +1,60 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+// Counter-based random number engine (Philox4x32-10, Salmon et al., SC'11).
+//
+// Every output is a pure function of a 64-bit key and a 128-bit counter.
+// The counter is laid out as (id, predicate, block, substream), so that the
+// random stream of any (seed, type, id, predicate) coordinate can be positioned
+// in O(1) with seek(), without replaying the draws of other entities.
+// Without seek(), the engine behaves like an ordinary sequential generator.
+//
+// Satisfies the UniformRandomNumberGenerator concept, so it can be plugged into
+// boost::variate_generator...
+class counter_rng{
+    public:
+        typedef uint32_t result_type;
+
+        counter_rng(uint32_t substream = 0);
+
+        void seed(uint32_t seed);
+        void seek(uint32_t seed, uint32_t type_key, uint32_t id, uint32_t predicate_key);
+
+        result_type operator()();
+
+        static result_type min() { return 0; }
+        static result_type max() { return 0xFFFFFFFF; }
+
+        static uint32_t hash(const string & label);
+        static void philox(const uint32_t counter[4], const uint32_t key[2], uint32_t result[4]);
+    private:
+        uint32_t _key[2];
+        uint32_t _counter[4];
+        uint32_t _output[4];
+        int _cursor;
+};
+
+// Keyed pseudo-random permutation of [0, size): a 4-round balanced Feistel network
+// over the smallest even power of two >= size, with cycle walking for the values
+// that fall outside of [0, size). Round keys come from Philox, so the permutation
+// is a pure function of (size, seed, key)...
+class feistel_permutation{
+    public:
+        feistel_permutation(uint32_t size, uint32_t seed, uint32_t key);
+
+        uint32_t operator()(uint32_t index) const;
+
+        uint32_t size() const { return _size; }
+    private:
+        uint32_t _size;
+        int _half_bits;
+        uint32_t _half_mask;
+        uint32_t _round_keys[4];
+};
+
+#endif // COUNTER_RNG_H
@@ -11,6 +11,13 @@
 
 #include <iostream>
 
+#include "output_sink.h"
+#include "statistics_file.h"
+#include "triple_file.h"
+#include "workload_writer.h"
+
+#include <boost/dynamic_bitset.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/random.hpp>
 #include <boost/random/uniform_int.hpp>
 #include <boost/random/variate_generator.hpp>
@@ -133,12 +140,22 @@ class namespace_map {
         void insert (const string & alias, const string & prefix);
         string lookup (const string & alias) const;
         string replace (const string & content) const;
+        void replace (const string & content, string & result) const;
+
+        int alias_id (const char * alias, size_t length) const;
+        const string & expansion (int alias_id) const;
 
         void to_str (vector<string> & lines) const;
     private:
         map<string, string> _index;
+        // Compiled table, the ID of an alias is its position...
+        vector<string>      _aliases;
+        vector<string>      _expansions;
 };
 
+// Entities are dense integer IDs under a type prefix, so instead of instance strings the
+// type_map interns types and entity prefixes, and keeps one bitmap of member IDs
+// per (type, prefix) pair. Instances that do not end with an ID are kept as strings...
 class type_map {
     public:
         type_map();
@@ -146,14 +163,46 @@ class type_map {
 
         void clear();
         void insert (const string & instance, const string & type);
+        void insert (unsigned int prefix_id, unsigned int id, unsigned int type_id);
         bool instanceof (const string & instance, const string & type) const;
+        bool instanceof (unsigned int prefix_id, unsigned int id, unsigned int type_id) const;
         vector<string> * get_instances (const string & entity, const string & type) const;
-
+        void get_instances (unsigned int prefix_id, unsigned int type_id, vector<unsigned int> & ids) const;
+        void build_index ();
+        const vector<unsigned int> * instance_ids (unsigned int prefix_id, unsigned int type_id) const;
+
+        unsigned int intern_type (const string & type);
+        unsigned int intern_prefix (const string & prefix);
+        int type_id (const string & type) const;
+        int prefix_id (const string & prefix) const;
+
+        unsigned int type_count () const { return _types.size(); }
+        unsigned int prefix_count () const { return _prefixes.size(); }
+        const string & type (unsigned int type_id) const { return _types[type_id]; }
+        const string & prefix (unsigned int prefix_id) const { return _prefixes[prefix_id]; }
+        // Returns the member bitmap of type_id under prefix_id, or NULL if there is none...
+        const boost::dynamic_bitset<> * members (unsigned int prefix_id, unsigned int type_id) const;
+        // Replaces the members of type_id under prefix_id, taking the bits over...
+        void assign (unsigned int prefix_id, unsigned int type_id, boost::dynamic_bitset<> & bits);
+        const unordered_map<string, unordered_set<string> > & other_members () const { return _other_members; }
+
+        size_t memory_usage () const;
         void print () const;
         void to_str (vector<string> & lines) const;
     private:
-        /// map<string, set<string> > _index;
-        unordered_map<string, unordered_set<string> > _index;
+        static bool split (const string & instance, string & prefix, unsigned int & id);
+
+        unordered_map<string, unsigned int>                 _type_ids;
+        vector<string>                                      _types;
+        unordered_map<string, unsigned int>                 _prefix_ids;
+        vector<string>                                      _prefixes;
+        // _members[type_id][prefix_id] has bit <id> set for every member...
+        vector<vector<boost::dynamic_bitset<> > >           _members;
+        unordered_map<string, unordered_set<string> >       _other_members;
+        // _index[type_id][prefix_id] lists the members in increasing ID order. It is
+        // built by build_index(), and any later insert() invalidates it...
+        vector<vector<vector<unsigned int> > >              _index;
+        bool                                                _indexed;
 };
 
 struct predicate_m_t {
@@ -162,6 +211,8 @@ struct predicate_m_t {
     string                          _range_min;
     string                          _range_max;
     DISTRIBUTION_TYPES::enum_t      _distribution_type;
+    unsigned int                    _random_key;
+    string                          _label_iri;
 
     void init (string label, LITERAL_TYPES::enum_t literal_type);
 
@@ -170,7 +221,9 @@ struct predicate_m_t {
     predicate_m_t (string label, LITERAL_TYPES::enum_t literal_type, string range_min, string range_max, DISTRIBUTION_TYPES::enum_t distribution_type);
     predicate_m_t (const predicate_m_t & rhs);
 
-    string generate (const namespace_map & n_map);
+    string generate ();
+    string generate (unsigned int type_key, unsigned int id, unsigned int group_key);
+    void compile (const namespace_map & n_map);
 
     static predicate_m_t * parse (const string & line);
 };
@@ -179,6 +232,8 @@ struct predicate_group_m_t {
     bool                            _post_process;
     float                           _gen_probability;
     string *                        _type_restriction;
+    string                          _type_restriction_iri;
+    unsigned int                    _type_restriction_id;
     vector<predicate_m_t*>          _predicate_array;
 
     predicate_group_m_t ();
@@ -187,12 +242,16 @@ struct predicate_group_m_t {
     predicate_group_m_t (const predicate_group_m_t & rhs);
     ~predicate_group_m_t();
 
+    void compile (const namespace_map & n_map, type_map & t_map);
+
     static predicate_group_m_t * parse (const string & line);
 };
 
 struct resource_m_t {
     bool                            _scalable;
     string                          _type_prefix;
+    string                          _type_iri;
+    unsigned int                    _type_prefix_id;
     unsigned int                    _scaling_coefficient;
     vector<predicate_group_m_t*>    _predicate_group_array;
 
@@ -200,13 +259,23 @@ struct resource_m_t {
     resource_m_t (const resource_m_t & rhs);
     ~resource_m_t ();
 
-    void generate (const namespace_map & n_map, map<string, unsigned int> & id_cursor_map);
-    void generate_stream_data(const namespace_map & n_map, map<string, unsigned int> & id_cursor_map, ofstream &fos_review, ofstream &fos_purchase, ofstream &fos_offer);
-    void process_type_restrictions (const namespace_map & n_map, const type_map & t_map, const map<string, unsigned int> & id_cursor_map);
+    void generate (map<string, unsigned int> & id_cursor_map, output_buffer & out);
+    void generate (unsigned int id_begin, unsigned int id_end, output_buffer & out);
+    void generate_stream_data (map<string, unsigned int> & id_cursor_map);
+    void process_type_restrictions (const type_map & t_map, const map<string, unsigned int> & id_cursor_map, output_buffer & out);
+    void process_type_restrictions (const type_map & t_map, unsigned int id_begin, unsigned int id_end, output_buffer & out);
+    void compile (const namespace_map & n_map, type_map & t_map);
 
     static resource_m_t * parse (const string & line);
 };
 
+// A type assertion saved by ID: instance <_id> under prefix _prefix_id is of type _type_id...
+struct type_assertion_st {
+    unsigned int                    _prefix_id;
+    unsigned int                    _id;
+    unsigned int                    _type_id;
+};
+
 struct association_m_t {
     bool                            _post_process;
 
@@ -217,6 +286,19 @@ struct association_m_t {
     string *                        _subject_type_restriction;
     string *                        _object_type_restriction;
 
+    // Expanded IRIs and type_map IDs, set by compile()...
+    string                          _subject_type_iri;
+    string                          _predicate_iri;
+    string                          _object_type_iri;
+    string                          _subject_type_restriction_iri;
+    string                          _object_type_restriction_iri;
+    unsigned int                    _subject_prefix_id;
+    unsigned int                    _subject_type_restriction_id;
+    unsigned int                    _object_prefix_id;
+    unsigned int                    _object_type_restriction_id;
+    // Type IDs of the right instances of an rdf:type association, see intern_object_types()...
+    vector<unsigned int>            _object_type_ids;
+
     unsigned int                    _left_cardinality;
     unsigned int                    _right_cardinality;
     DISTRIBUTION_TYPES::enum_t      _right_cardinality_distribution;
@@ -224,6 +306,10 @@ struct association_m_t {
     float                           _left_cover;
     DISTRIBUTION_TYPES::enum_t      _right_distribution;
 
+    unsigned int                    _random_key;
+    // Edges that could not be generated, because every right instance was already mapped...
+    unsigned long long              _dropped_edge_count;
+
     void init (string subject_type, string predicate, string object_type);
 
     association_m_t (string subject_type, string predicate, string object_type);
@@ -233,10 +319,19 @@ struct association_m_t {
     association_m_t (string subject_type, string predicate, string object_type, unsigned int left_cardinality, unsigned int right_cardinality, float left_cover, DISTRIBUTION_TYPES::enum_t right_distribution, const string * subject_type_restriction, const string * object_type_restriction);
     ~association_m_t ();
 
-    void generate (const namespace_map & n_map, type_map & t_map, const map<string, unsigned int> & id_cursor_map);
-    void generate_stream_data (const namespace_map & n_map, type_map & t_map, const map<string, unsigned int> & id_cursor_map, ofstream &fos);
-    void process_type_restrictions (const namespace_map & n_map, const type_map & t_map, const map<string, unsigned int> & id_cursor_map);
-    void process_stream_type_restrictions (const namespace_map & n_map, const type_map & t_map, const map<string, unsigned int> & id_cursor_map, ofstream &fos);
+    void generate (type_map & t_map, const map<string, unsigned int> & id_cursor_map, output_buffer & out);
+    void generate (const map<string, unsigned int> & id_cursor_map, unsigned int left_begin, unsigned int left_end, output_buffer & out, vector<type_assertion_st> & type_assertions);
+    void generate_stream_data (type_map & t_map, const map<string, unsigned int> & id_cursor_map);
+    void process_type_restrictions (const type_map & t_map, const map<string, unsigned int> & id_cursor_map, output_buffer & out);
+    void process_type_restrictions (const type_map & t_map, unsigned int left_begin, unsigned int left_end, const vector<unsigned int> & restricted_right_ids, output_buffer & out);
+    const vector<unsigned int> * get_restricted_right_ids (const type_map & t_map, const map<string, unsigned int> & id_cursor_map, vector<unsigned int> & all_right_ids) const;
+    void check_types (const map<string, unsigned int> & id_cursor_map) const;
+    bool is_shardable () const;
+    void report_dropped_edges () const;
+    void process_stream_type_restrictions (const type_map & t_map, const map<string, unsigned int> & id_cursor_map);
+    void compile (const namespace_map & n_map, type_map & t_map);
+    bool is_type_assertion () const;
+    void intern_object_types (type_map & t_map, unsigned int right_instance_count);
 
     static association_m_t * parse (const map<string, unsigned int> & id_cursor_map, const string & line);
 };
@@ -249,6 +344,8 @@ struct mapping_m_t {
     LITERAL_TYPES::enum_t       _literal_type;
     string                      _resource_type;
     string *                     _type_restriction;
+    string                      _resource_type_iri;
+    string                      _type_restriction_iri;
     DISTRIBUTION_TYPES::enum_t  _distribution_type;
     string                      _range_min;
     string                      _range_max;
@@ -270,6 +367,7 @@ struct mapping_m_t {
 
     string generate (const model & mdl, const query_template_m_t & q_template);
     string generate (const model & mdl, const query_template_m_t & q_template, unsigned int & instance_count);
+    void compile (const namespace_map & n_map);
 
     static mapping_m_t * parse (const string & line);
 };
@@ -283,11 +381,40 @@ struct operation_m_t {
     operation_m_t (const string & target_variable, const string & source_variable, OPERATION_TYPES::enum_t operation, int operand);
     operation_m_t (const operation_m_t & rhs);
 
-    string compute (const map<string, string> & value_mappings);
+    void compute (boost::string_view source_value, string & result) const;
 
     static operation_m_t * parse (const string & line);
 };
 
+// Literal text of a compiled template line, or the value of a variable...
+struct template_fragment_st {
+    int         _slot;      // index into _slot_names, or -1 for literal text
+    string      _text;
+};
+
+// Template line without its [probability] prefix, as a range of _fragments...
+struct template_line_st {
+    float           _probability;
+    unsigned int    _fragment_begin;
+    unsigned int    _fragment_end;
+};
+
+// Pre-sampled values of the mappings of a template. Every distinct value is interned
+// once into _text, and the samples of a mapping are the IDs of their values...
+struct sample_pool_st {
+    string                              _text;
+    vector<size_t>                      _offsets;   // begin of every value in _text, and the end of _text
+    unordered_map<string, unsigned int> _ids;
+    vector<vector<unsigned int> >       _samples;   // value IDs, by variable index
+
+    sample_pool_st ();
+
+    unsigned int intern (const string & value);
+    boost::string_view value (unsigned int id) const { return boost::string_view(_text.data() + _offsets[id], _offsets[id + 1] - _offsets[id]); }
+    // Appends the samples of rhs, which were drawn after those of this pool...
+    void append (const sample_pool_st & rhs);
+};
+
 struct query_template_m_t {
     const model *                              _mdl;
     vector<mapping_m_t*>                        _variable_mapping_array;
@@ -296,22 +423,60 @@ struct query_template_m_t {
     map<string, pair<volatility_gen*, float> >  _volatility_table;
     int                                         _instantiationCount;
 
+    // The template lines, compiled by parse() and parse_str()...
+    vector<template_line_st>                    _compiled_lines;
+    vector<template_fragment_st>                _fragments;
+    vector<string>                              _slot_names;
+
+    // Variables of the mappings and then of the operations, by index. The mappings of a
+    // variable share its samples, and the first definition of a variable wins. -1 marks a
+    // redefinition by an operation or, for a slot, an unknown variable...
+    unsigned int                                _variable_count;
+    vector<int>                                 _mapping_variables;
+    vector<bool>                                _mapping_defines;
+    vector<int>                                 _operation_sources;
+    vector<int>                                 _operation_targets;
+    vector<int>                                 _slot_variables;
+
     query_template_m_t(const model * mdl);
     query_template_m_t(const query_template_m_t & rhs);
     ~query_template_m_t();
 
     void instantiate (unsigned int query_count, unsigned int recurrence, vector<string> & result_array);
+    // Writes every query as soon as it is instantiated, and returns false once the writer
+    // stops taking queries. template_index picks the random streams of the template...
+    bool instantiate (unsigned int template_index, unsigned int query_count, unsigned int recurrence, workload_writer & writer);
+    void generate_samples (unsigned int begin, unsigned int end, sample_pool_st & pool) const;
+    void instantiate_query (const sample_pool_st & pool, int (*draw)(), string & query);
+    bool is_dynamic () const;
 
     void parse (const string filename);
     void parse_str (const string & content);
+    void compile_line (const string & line);
+    boost::string_view fragment_text (const template_fragment_st & fragment, const vector<boost::string_view> & values) const;
+    void bind_variables ();
+
+    // Streams query_count queries of every template to the sink, in template order...
+    static void instantiate (const vector<query_template_m_t *> & templates, unsigned int query_count, unsigned int recurrence,
+                             unsigned int thread_count, output_sink & sink);
 };
 
+// Degree histograms of the subjects and objects of one predicate. The prefixes, the
+// predicate and the type restrictions are compiled once, so that collecting a triple
+// costs a few comparisons and two integer parses...
 struct statistics_m_t {
     string              _predicate;
     string              _subject_type;
     string              _object_type;
     string *            _subject_type_restriction;
     string *            _object_type_restriction;
+    string              _predicate_iri;
+    string              _subject_type_iri;
+    string              _object_type_iri;
+    int                 _subject_prefix_id;
+    int                 _object_prefix_id;
+    int                 _subject_type_restriction_id;
+    int                 _object_type_restriction_id;
     unsigned int        _left_count;
     int *               _left_statistics;
     unsigned int        _right_count;
@@ -323,7 +488,11 @@ struct statistics_m_t {
     statistics_m_t (const statistics_m_t & rhs);
     ~statistics_m_t();
 
-    void collect (const model * mdl, const string & subject, const string & predicate, const string & object);
+    // Collects a triple of the predicate into partial histograms of _left_count and
+    // _right_count entries, where -1 marks an instance that violates its restriction...
+    void collect (const model * mdl, const triple_view_st & triple, int * left_statistics, int * right_statistics) const;
+    void merge (const int * left_statistics, const int * right_statistics);
+    void summarize (statistics_record_st & record) const;
     void report () const;
 
     static statistics_m_t * parse (const model * mdl, const string & line);
@@ -341,18 +510,24 @@ struct model{
     ~model();
 
     void parse (const char * filename);
+    void compile ();
 
-    void generate (int scale_factor);
+    void generate (int scale_factor, output_sink & sink);
+    void generate (int scale_factor, unsigned int thread_count, output_sink & sink);
     void generate_stream_data (int static_scale_factor, int stream_scale_factor);
-    void compute_statistics (const vector<triple_st> & triples);
+    void compute_statistics (const vector<triple_view_st> & triples, const char * filename=NULL, unsigned int thread_count=0);
 
     void load (const char * filename);
     void save (const char * filename) const;
 
+    static void seed_random (unsigned int seed);
+    static void seek_random (const string & type_prefix, unsigned int id, const string & predicate);
+    static void seek_random (unsigned int type_key, unsigned int id, unsigned int predicate_key);
+    static unsigned int derive_seed (unsigned int phase, unsigned int index, unsigned int offset);
+
     static string generate_literal (LITERAL_TYPES::enum_t literal_type, DISTRIBUTION_TYPES::enum_t distribution_type, const string & range_min, const string & range_max);
     static double generate_random (DISTRIBUTION_TYPES::enum_t distribution_type, int item_count=-1);
     static double generate_zipfian (int item_count);
-    static void clear_zipfian_cache ();
 };
 
 #endif // MODEL_H
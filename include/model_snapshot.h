@@ -0,0 +1,81 @@
+#ifndef MODEL_SNAPSHOT_H
+#define MODEL_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "model.h"
+
+using namespace std;
+
+namespace SET_ENCODINGS {
+    enum enum_t {
+        BITMAP,     // 64-bit words of the member bitmap
+        RUNS,       // (first ID, length) pairs of uint32_t
+        ARRAY,      // sorted uint32_t IDs
+        UNDEFINED
+    };
+};
+
+// Offset and length of a string in the string table...
+struct snapshot_ref_st{
+    uint32_t    _offset;
+    uint32_t    _length;
+};
+
+struct snapshot_cursor_st{
+    snapshot_ref_st     _type;
+    uint32_t            _value;
+    uint32_t            _padding;
+};
+
+// Members of one (type, prefix) pair, as indexes into the type and prefix tables...
+struct snapshot_set_st{
+    uint32_t    _type_index;
+    uint32_t    _prefix_index;
+    uint32_t    _encoding;
+    uint32_t    _cardinality;
+    uint64_t    _bit_count;
+    uint64_t    _data_offset;
+    uint64_t    _data_length;
+};
+
+struct snapshot_member_st{
+    snapshot_ref_st     _type;
+    snapshot_ref_st     _instance;
+};
+
+struct snapshot_header_st{
+    char        _magic[8];
+    uint32_t    _version;
+    uint32_t    _cursor_count;
+    uint32_t    _type_count;
+    uint32_t    _prefix_count;
+    uint32_t    _set_count;
+    uint32_t    _member_count;
+    uint64_t    _cursor_offset;
+    uint64_t    _type_offset;
+    uint64_t    _prefix_offset;
+    uint64_t    _set_offset;
+    uint64_t    _member_offset;
+    uint64_t    _data_offset;
+    uint64_t    _string_offset;
+    uint64_t    _file_size;
+};
+
+// Binary replacement of saved.txt: the ID cursors and type assertions of a generated
+// dataset. Every section is 8-byte aligned in native byte order, so that a snapshot is
+// loaded by mapping it and copying the member sets into the type_map, without parsing
+// IRIs. Each set is stored in the smallest of its encodings. Types and prefixes are
+// matched by name on load, since their IDs depend on the order of interning...
+class model_snapshot{
+    public:
+        static void save (const model & mdl, const char * filename);
+        // Returns false if the file is missing or is not a snapshot of this version...
+        static bool load (model & mdl, const char * filename);
+
+        // Compares the load times of the text and binary formats of the same state...
+        static void benchmark (model & mdl, const char * text_filename, const char * snapshot_filename);
+};
+
+#endif // MODEL_SNAPSHOT_H
@@ -0,0 +1,73 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+
+using namespace std;
+
+struct output_sink;
+
+// Growable byte buffer used to assemble N-Triples without going through iostreams.
+// Integers are formatted by hand. When a sink is attached, the buffer is handed over
+// to the sink every time it grows past its flush threshold...
+struct output_buffer{
+    vector<char>            _data;
+    size_t                  _size;
+    size_t                  _flush_threshold;
+    output_sink *           _sink;
+
+    output_buffer ();
+    output_buffer (output_sink * sink, size_t flush_threshold=OUTPUT_BUFFER_SIZE);
+    ~output_buffer ();
+
+    void append (char c);
+    void append (const char * data, size_t length);
+    void append (const string & str);
+    void append_uint (unsigned long long value);
+    void append_iri (const string & prefix, unsigned long long id);
+
+    const char * data () const { return _data.data(); }
+    size_t size () const { return _size; }
+    bool empty () const { return _size == 0; }
+    void clear () { _size = 0; }
+    void flush ();
+
+    static size_t format_uint (unsigned long long value, char * result);
+
+    static const size_t OUTPUT_BUFFER_SIZE = 4 << 20;
+    private:
+        void reserve (size_t length);
+};
+
+// Destination of the generated triples: stdout, a file or a pipe to a command.
+// Data is written with write(2)/writev(2) directly on the file descriptor, so a mode
+// that writes through an output_sink must not write to cout at the same time...
+struct output_sink{
+    int                                 _fd;
+    FILE *                              _pipe;
+    bool                                _owns_fd;
+    string                              _target;
+    unsigned long long                  _bytes_written;
+    boost::posix_time::ptime            _start_time;
+
+    output_sink ();
+    ~output_sink ();
+
+    void write (const char * data, size_t length);
+    void write (const vector<const output_buffer *> & buffers);
+    void close ();
+    void report () const;
+
+    // "-" is stdout, "|<command>" is a pipe to <command>, "tcp:<port>" is the first client
+    // to connect to 127.0.0.1:<port>, a name ending in ".gz" is a file compressed by gzip,
+    // anything else is a file (or an existing FIFO)...
+    static output_sink * open (const string & target);
+    private:
+        void open_pipe (const string & command);
+};
+
+#endif // OUTPUT_SINK_H
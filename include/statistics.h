@@ -2,6 +2,8 @@
 #define STATISTICS_H
 
 #include "model.h"
+#include "triple_file.h"
+#include "triple_store.h"
 #include <vector>
 #include <string>
 
@@ -46,7 +48,7 @@ ostream& operator<<(ostream& os, const statistics_st & stats);
 
 class statistics{
     public:
-        statistics(const model * mdl, const vector<triple_st> & triple_array, int maxQSize, int qCount, int constCount, bool constJoinVertexAllowed, bool dupEdgesAllowed, bool isStream);
+        statistics(const model * mdl, vector<triple_view_st> & triple_array, int maxQSize, int qCount, int constCount, bool constJoinVertexAllowed, bool dupEdgesAllowed, bool isStream);
         ~statistics();
 
         ///void compute();
@@ -54,11 +56,10 @@ class statistics{
     private:
         const model * _model;
         map<string, set<statistics_st> > graph;
-        vector<triple_st> _spo_index;
-        vector<triple_st> _ops_index;
+        triple_store _store;
         map<string, pair<double, double> > _statistics_table;
 
-        void index_triples(const vector<triple_st> & triple_array);
+        void index_triples(vector<triple_view_st> & triple_array);
 
         void extract_schema(const model & mdl);
         void populate_graph(const vector<statistics_st> & tuples);
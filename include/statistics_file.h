@@ -0,0 +1,112 @@
+#ifndef STATISTICS_FILE_H
+#define STATISTICS_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+using namespace std;
+
+// Number of instances with a given degree...
+struct degree_count_st{
+    uint32_t    _degree;
+    uint32_t    _count;
+};
+
+// Degree summary of one side of a #statistics line. Instances that violate a type
+// restriction are not counted, and covered instances are those with a degree > 0.
+// The histogram lists the degrees of the covered instances in increasing order...
+struct degree_summary_st{
+    uint64_t    _instance_count;
+    uint64_t    _covered_count;
+    uint32_t    _min;
+    uint32_t    _max;
+    double      _mean;
+    double      _cover;
+    uint64_t    _histogram_offset;
+    uint64_t    _histogram_length;
+
+    static void summarize (const int * statistics, unsigned int count, degree_summary_st & summary, vector<degree_count_st> & histogram);
+};
+
+// Offset and length of a string in the string table, NULL_STRING for a missing one...
+struct string_ref_st{
+    uint32_t    _offset;
+    uint32_t    _length;
+};
+
+struct statistics_entry_st{
+    string_ref_st       _predicate;
+    string_ref_st       _subject_type;
+    string_ref_st       _object_type;
+    string_ref_st       _subject_type_restriction;
+    string_ref_st       _object_type_restriction;
+    degree_summary_st   _left;
+    degree_summary_st   _right;
+};
+
+struct statistics_file_header_st{
+    char        _magic[8];
+    uint32_t    _version;
+    uint32_t    _entry_count;
+    uint64_t    _histogram_offset;
+    uint64_t    _string_offset;
+    uint64_t    _file_size;
+};
+
+// In-memory form of an entry. The restrictions point into the statistics_m_t that the
+// record was summarized from...
+struct statistics_record_st{
+    string                  _predicate;
+    string                  _subject_type;
+    string                  _object_type;
+    const string *          _subject_type_restriction;
+    const string *          _object_type_restriction;
+    degree_summary_st       _left;
+    degree_summary_st       _right;
+    vector<degree_count_st> _left_histogram;
+    vector<degree_count_st> _right_histogram;
+};
+
+// Read-only memory mapping of a binary statistics file, laid out as
+//
+//      header | entries | histograms (degree_count_st) | string table
+//
+// in native byte order, with every section 8-byte aligned, so that the entries and
+// histograms can be used in place right after mapping the file...
+class statistics_file{
+    public:
+        statistics_file (const char * filename);
+        ~statistics_file ();
+
+        uint32_t entry_count () const { return _header->_entry_count; }
+        const statistics_entry_st & entry (uint32_t index) const { return _entries[index]; }
+        boost::string_view get_string (const string_ref_st & ref) const;
+        const degree_count_st * histogram (const degree_summary_st & summary) const;
+
+        // Returns NULL if the file has no entry for the predicate and types...
+        const statistics_entry_st * find (const string & predicate, const string & subject_type, const string & object_type) const;
+        void report (uint32_t index, ostream & os) const;
+
+        static void write (const char * filename, const vector<statistics_record_st> & records);
+        static void report (const statistics_record_st & record, ostream & os);
+
+        static const uint32_t NULL_STRING = 0xFFFFFFFF;
+    private:
+        string                              _filename;
+        const char *                        _data;
+        size_t                              _size;
+        const statistics_file_header_st *   _header;
+        const statistics_entry_st *         _entries;
+
+        static void report (boost::string_view predicate, boost::string_view subject_type, boost::string_view object_type,
+                            const boost::string_view * subject_type_restriction, const boost::string_view * object_type_restriction,
+                            const degree_summary_st & left, const degree_count_st * left_histogram,
+                            const degree_summary_st & right, const degree_count_st * right_histogram, ostream & os);
+};
+
+#endif // STATISTICS_FILE_H
@@ -0,0 +1,56 @@
+#ifndef STREAM_PLAYER_H
+#define STREAM_PLAYER_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct output_sink;
+
+// Replays a stream file (one triple per line, as written by -sd) in real time at a
+// target rate, for stream engines that consume triples as they arrive.
+//
+// Triple n is due at the time where the cumulative rate of the burst profile reaches
+// n, measured from the start of the replay, so that the schedule does not drift. The
+// player writes every triple that is due in one batch, then waits for the next one:
+// it sleeps with nanosleep(2) until shortly before the deadline and busy-waits for
+// the rest, which keeps the lateness in the microseconds without burning a core at
+// low rates...
+class stream_player{
+    public:
+        stream_player (double rate);
+
+        // Burst profile: comma-separated <seconds>:<factor> phases, repeated for the
+        // whole replay, each running at factor times the base rate (e.g. "9:1,1:10")...
+        void set_burst_profile (const string & profile);
+        void set_report_interval (double seconds);
+
+        void play (const string & stream_file, output_sink & sink);
+        void report () const;
+    private:
+        struct phase_st{
+            double      _seconds;
+            double      _rate;
+        };
+
+        double                  _rate;
+        vector<phase_st>        _phases;
+        double                  _cycle_seconds;
+        double                  _cycle_triples;
+        double                  _report_interval;
+
+        unsigned long long      _triple_count;
+        unsigned long long      _write_count;
+        double                  _elapsed;
+        // Lateness of every batch behind its schedule, in seconds (Welford's method)...
+        double                  _lateness_mean;
+        double                  _lateness_m2;
+        double                  _lateness_max;
+
+        double due_time (unsigned long long index) const;
+        unsigned long long due_count (double seconds) const;
+        void record_lateness (double lateness);
+};
+
+#endif // STREAM_PLAYER_H
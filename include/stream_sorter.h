@@ -0,0 +1,70 @@
+#ifndef STREAM_SORTER_H
+#define STREAM_SORTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// External merge sort of tab-separated stream records on their 4th column (the
+// timestamp), in the order of `sort -s -t '\t' -g -k 4`: ascending numeric keys,
+// records without a numeric key first, and ties kept in the order they were added.
+//
+// Records are buffered until the memory budget is reached. Every full buffer is sorted
+// into a run file by a worker thread while the next one is being filled. finish()
+// merges the runs with whatever is still in memory straight into the output file;
+// if everything fits into one buffer, no run file is written at all. Empty records
+// are dropped...
+class stream_sorter{
+    public:
+        stream_sorter (const string & output_file, size_t memory_budget=DEFAULT_MEMORY_BUDGET, unsigned int thread_count=0);
+        ~stream_sorter ();
+
+        void add (const string & record);
+        void add (const char * record, size_t length);
+        void finish ();
+
+        unsigned long long record_count () const { return _record_count; }
+        size_t run_count () const { return _run_files.size(); }
+
+        static double parse_key (const char * record, size_t length);
+
+        static const size_t DEFAULT_MEMORY_BUDGET = 256 << 20;
+    private:
+        struct record_st{
+            double      _key;
+            uint32_t    _offset;
+            uint32_t    _length;
+        };
+
+        struct chunk_st{
+            vector<char>        _text;
+            vector<record_st>   _records;
+
+            size_t memory_usage () const { return _text.size() + _records.size() * sizeof(record_st); }
+            void sort ();
+        };
+
+        struct run_reader_st;
+
+        string                  _output_file;
+        size_t                  _memory_budget;
+        size_t                  _chunk_limit;
+        unsigned int            _thread_count;
+        chunk_st *              _chunk;
+        deque<thread>           _workers;
+        vector<string>          _run_files;
+        unsigned long long      _record_count;
+        bool                    _finished;
+
+        void spill ();
+        void wait_for_workers (size_t max_pending);
+        void merge ();
+        static void write_run (chunk_st * chunk, string run_file);
+};
+
+#endif // STREAM_SORTER_H
@@ -0,0 +1,57 @@
+#ifndef TRIPLE_FILE_H
+#define TRIPLE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+using namespace std;
+
+// Triple whose terms point into a mapped triple_file, so that it stays valid only as
+// long as the file. IRIs are stored without their angle brackets, which makes the
+// terms of N-Triples and stream files comparable; literals keep their quotes...
+struct triple_view_st{
+    const char *    _subject;
+    uint32_t        _subject_length;
+    uint32_t        _predicate_offset;
+    uint32_t        _predicate_length;
+    uint32_t        _object_offset;
+    uint32_t        _object_length;
+
+    boost::string_view subject () const { return boost::string_view(_subject, _subject_length); }
+    boost::string_view predicate () const { return boost::string_view(_subject + _predicate_offset, _predicate_length); }
+    boost::string_view object () const { return boost::string_view(_subject + _object_offset, _object_length); }
+
+    // Adds the angle brackets back to an IRI...
+    static string to_term (boost::string_view term);
+};
+
+// Read-only memory mapping of a tab-separated triple file: N-Triples as written by -d
+// (<s>\t<p>\t<o> .) or a stream file as written by -sd (s\tp\to\t<time>).
+//
+// parse() splits the mapping into one chunk per thread at line boundaries. Every
+// thread counts the lines of its chunk first, so that the triples can be tokenized
+// straight into their final place in the result, without intermediate copies...
+class triple_file{
+    public:
+        triple_file (const char * filename, bool stream);
+        ~triple_file ();
+
+        size_t size () const { return _size; }
+
+        // Appends the triples of the file to result, in file order. Lines with fewer
+        // than three terms are skipped...
+        void parse (vector<triple_view_st> & result, unsigned int thread_count=0) const;
+    private:
+        string          _filename;
+        bool            _stream;
+        const char *    _data;
+        size_t          _size;
+
+        size_t tokenize (const char * begin, const char * end, triple_view_st * result) const;
+};
+
+#endif // TRIPLE_FILE_H
@@ -0,0 +1,93 @@
+#ifndef TRIPLE_STORE_H
+#define TRIPLE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+#include "triple_file.h"
+
+using namespace std;
+
+// Interns RDF terms as 32-bit IDs. The dictionary is split into shards by hash, each
+// with its own lock, an open-addressing table and an arena for the term bytes, so
+// that many threads can intern at once. The low bits of an ID name its shard, the
+// rest is the position of the term within the shard...
+class term_dictionary{
+    public:
+        term_dictionary ();
+        ~term_dictionary ();
+
+        // Thread-safe...
+        uint32_t intern (boost::string_view term);
+        // Returns NOT_FOUND for a term that was never interned...
+        uint32_t lookup (boost::string_view term) const;
+        boost::string_view term (uint32_t id) const;
+
+        size_t size () const;
+        size_t memory_usage () const;
+
+        static const uint32_t NOT_FOUND = 0xFFFFFFFF;
+    private:
+        struct entry_st{
+            const char *    _data;
+            uint32_t        _length;
+            uint32_t        _hash;
+        };
+
+        struct shard_st{
+            mutex               _mutex;
+            // Position of the term in _entries plus 1, 0 for an empty slot...
+            vector<uint32_t>    _slots;
+            vector<entry_st>    _entries;
+            vector<char *>      _blocks;
+            size_t              _block_used;
+        };
+
+        static const int SHARD_BITS = 8;
+        static const uint32_t SHARD_COUNT = 1 << SHARD_BITS;
+
+        shard_st *  _shards;
+
+        static uint64_t hash (boost::string_view term);
+        static uint32_t find_slot (const shard_st & shard, boost::string_view term, uint32_t hash);
+        static void grow (shard_st & shard);
+};
+
+// Dictionary-encoded triples, indexed per predicate. For every predicate, the store
+// keeps the sorted (subject << 32 | object) and (object << 32 | subject) keys of its
+// triples, so that the triples of a (subject, predicate) or (object, predicate) pair
+// form one contiguous range. That is 16 bytes per triple for both indexes, plus the
+// dictionary. Keys are sorted by a parallel LSD radix sort...
+class triple_store{
+    public:
+        triple_store ();
+
+        // Adds the triples to the store. They are released as soon as they are encoded,
+        // which keeps them from adding to the peak memory of the indexes...
+        void build (vector<triple_view_st> & triples, unsigned int thread_count=0);
+
+        const term_dictionary & dictionary () const { return _dictionary; }
+        size_t triple_count () const { return _triple_count; }
+        size_t memory_usage () const;
+
+        // Number of triples with the given subject (or object) and predicate...
+        size_t count_objects (uint32_t subject_id, uint32_t predicate_id) const;
+        size_t count_subjects (uint32_t object_id, uint32_t predicate_id) const;
+
+        static void radix_sort (vector<uint64_t> & keys, unsigned int thread_count);
+    private:
+        term_dictionary                         _dictionary;
+        size_t                                  _triple_count;
+        unordered_map<uint32_t, uint32_t>       _predicate_index;
+        vector<vector<uint64_t> >               _so_keys;
+        vector<vector<uint64_t> >               _os_keys;
+
+        static size_t count_range (const vector<uint64_t> & keys, uint32_t prefix);
+};
+
+#endif // TRIPLE_STORE_H
@@ -16,14 +16,19 @@ namespace VOLATILITY_MODEL {
     };
 };
 
-
+// Frequencies of the entities of a dynamic model, which drift by a random log-increase
+// every time the model advances. They are kept in a Fenwick tree, so that an entity is
+// sampled, and its frequency updated, in O(log n). With an advance fraction below 1, a
+// tick advances a random subset of that fraction of the entities instead of all...
 class volatility_gen{
     public:
-        volatility_gen(const char * frequency_sample_file, double location, VOLATILITY_MODEL::enum_t distribution, const char * volatility_sample_file);
+        volatility_gen(const char * frequency_sample_file, double location, VOLATILITY_MODEL::enum_t distribution, const char * volatility_sample_file,
+                       double advance_fraction=1.0);
         volatility_gen(const volatility_gen & rhs);
         ~volatility_gen();
 
         void initialize (int model_size);
+        void seed (unsigned int seed);
         bool is_initialized () const;
 
         int get_model_size () const;
@@ -32,12 +37,14 @@ class volatility_gen{
         double get_volatility_value (int index) const;
         double get_next_ln_increase (int index) const;
         double get_probability (int index) const;
+        double get_cumulative_frequency (int count) const;
 
         int next_rand_index () const;
 
         double advance ();
         void warmup ();
 
+        // #dynamic <name> <location> <distribution> <frequency-file> <volatility-file> <advance-pr> [<advance-fraction>]...
         static volatility_gen * parse (const string & line, string & name, float & advance_pr);
 
         static void test ();
@@ -55,10 +62,23 @@ class volatility_gen{
         vector<double> _volatility_sample;
         vector<double> _gen_volatility;
 
+        double _advance_fraction;
+
         double * _dynamic_frequency_array;
-        double * _cum_density_array;
+        // 1-based Fenwick tree over _dynamic_frequency_array...
+        vector<double> _frequency_tree;
+        int _tree_step;
+        double _total_frequency;
+        // Updates since the tree was last rebuilt, which bounds the rounding drift...
+        int _update_count;
+        // Tick at which every entity was last selected by a partial advance()...
+        vector<unsigned int> _selected_tick;
+        unsigned int _tick;
 
         double next_uniform() const;
+        double next_frequency (int index) const;
+        void build_tree ();
+        void update_frequency (int index, double frequency);
 
         template <typename T> int sgn(T val) const {
             return (T(0) < val) - (val < T(0));
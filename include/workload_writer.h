@@ -0,0 +1,43 @@
+#ifndef WORKLOAD_WRITER_H
+#define WORKLOAD_WRITER_H
+
+#include <string>
+#include <vector>
+
+#include "output_sink.h"
+
+using namespace std;
+
+// Writes instantiated queries to an output_sink as soon as they are produced, through
+// a small buffer, so that memory does not grow with the size of the workload.
+//
+// In pull mode the consumer paces the workload: it asks for queries by writing their
+// number on a line (an empty line asks for one), either on the connection of a tcp:
+// sink or on stdin, and every query is followed by a line "#end". The buffer is flushed
+// whenever the requested queries are written, and write() returns false once the
+// consumer has closed its side...
+class workload_writer{
+    public:
+        workload_writer (output_sink * sink, bool pull);
+        ~workload_writer ();
+
+        bool write (const string & query);
+        void flush ();
+
+        unsigned long long query_count () const { return _query_count; }
+
+        static const size_t FLUSH_THRESHOLD = 64 << 10;
+    private:
+        output_sink *           _sink;
+        output_buffer           _buffer;
+        bool                    _pull;
+        int                     _request_fd;
+        vector<char>            _request;
+        bool                    _closed;
+        unsigned long long      _credit;
+        unsigned long long      _query_count;
+
+        bool wait_for_credit ();
+};
+
+#endif // WORKLOAD_WRITER_H
@@ -0,0 +1,77 @@
+#ifndef ZIPF_SAMPLER_H
+#define ZIPF_SAMPLER_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// Sampler for the Zipfian distribution over item_count ranks, where rank i
+// (0-based) has weight 1/(i+1).
+//
+// Up to table_limit() items, a Walker/Vose alias table is used: a draw picks a
+// column uniformly and then either keeps it or takes its alias, so it costs O(1)
+// regardless of item_count. Above the limit, ranks are drawn by rejection-inversion
+// (Hormann & Derflinger, 1996), which needs no table at all and accepts after
+// about one trial on average.
+//
+// Samplers are immutable once built, and get() keeps one per item count for the
+// lifetime of the process, so they can be shared by all generator threads...
+class zipf_sampler{
+    public:
+        zipf_sampler(unsigned int item_count, bool use_table);
+
+        // next_bits returns independent uniform values in [0, 2^31)...
+        template <typename Generator>
+        unsigned int draw(Generator & next_bits) const {
+            if (!_columns.empty()){
+                uint32_t index_bits = next_bits();
+                uint32_t coin_bits = next_bits();
+                unsigned int index = (unsigned int) (((uint64_t) index_bits * _item_count) >> 31);
+                const column_st & column = _columns[index];
+                return (coin_bits < column._threshold) ? index : column._alias;
+            }
+            // With H(x) = log(x) as the integral of h(x) = 1/x, invert H at a uniform point
+            // between H(1.5) - 1 and H(n + 0.5), and accept the nearest rank unless the point
+            // falls into the part of the hat that rank k does not cover...
+            while (true){
+                uint64_t high = (uint32_t) next_bits();
+                uint64_t low = (uint32_t) next_bits();
+                double u = (double) ((high << 22) | (low >> 9)) * (1.0 / 9007199254740992.0);
+                u = _h_integral_n + u * (_h_integral_x1 - _h_integral_n);
+                double x = exp(u);
+                double k = floor(x + 0.5);
+                k = (k < 1.0) ? 1.0 : ((k > (double) _item_count) ? (double) _item_count : k);
+                if (k - x <= _squeeze || u >= log(k + 0.5) - 1.0 / k){
+                    return (unsigned int) k - 1;
+                }
+            }
+        }
+
+        unsigned int item_count() const { return _item_count; }
+        size_t memory_usage() const;
+
+        static const zipf_sampler * get(unsigned int item_count);
+        static unsigned int table_limit();
+        static void set_table_limit(unsigned int item_count);
+
+        static void benchmark();
+    private:
+        struct column_st{
+            uint32_t    _threshold;
+            uint32_t    _alias;
+        };
+
+        unsigned int        _item_count;
+        vector<column_st>   _columns;
+        // Rejection-inversion constants...
+        double              _h_integral_x1;
+        double              _h_integral_n;
+        double              _squeeze;
+
+        void build_table();
+};
+
+#endif // ZIPF_SAMPLER_H
@@ -0,0 +1,106 @@
+#include "counter_rng.h"
+
+static const uint32_t PHILOX_M0 = 0xD2511F53;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+static const uint32_t PHILOX_W0 = 0x9E3779B9;
+static const uint32_t PHILOX_W1 = 0xBB67AE85;
+static const int PHILOX_ROUNDS = 10;
+
+counter_rng::counter_rng(uint32_t substream){
+    _counter[3] = substream;
+    seed(0);
+}
+
+// Positions the engine at the beginning of the sequential stream of the given seed...
+void counter_rng::seed(uint32_t seed){
+    seek(seed, 0, 0, 0);
+}
+
+// Positions the engine at the beginning of the stream of a (seed, type, id, predicate) coordinate...
+void counter_rng::seek(uint32_t seed, uint32_t type_key, uint32_t id, uint32_t predicate_key){
+    _key[0] = seed;
+    _key[1] = type_key;
+    _counter[0] = id;
+    _counter[1] = predicate_key;
+    _counter[2] = 0;
+    _cursor = 4;
+}
+
+counter_rng::result_type counter_rng::operator()(){
+    if (_cursor == 4){
+        philox(_counter, _key, _output);
+        _counter[2]++;
+        _cursor = 0;
+    }
+    return _output[_cursor++];
+}
+
+// FNV-1a...
+uint32_t counter_rng::hash(const string & label){
+    uint32_t result = 2166136261u;
+    for (unsigned int i=0; i<label.size(); i++){
+        result ^= (unsigned char) label[i];
+        result *= 16777619u;
+    }
+    return result;
+}
+
+void counter_rng::philox(const uint32_t counter[4], const uint32_t key[2], uint32_t result[4]){
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round=0; round<PHILOX_ROUNDS; round++){
+        uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+        uint32_t n0 = ((uint32_t) (p1 >> 32)) ^ c1 ^ k0;
+        uint32_t n1 = (uint32_t) p1;
+        uint32_t n2 = ((uint32_t) (p0 >> 32)) ^ c3 ^ k1;
+        uint32_t n3 = (uint32_t) p0;
+        c0 = n0; c1 = n1; c2 = n2; c3 = n3;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    result[0] = c0;
+    result[1] = c1;
+    result[2] = c2;
+    result[3] = c3;
+}
+
+feistel_permutation::feistel_permutation(uint32_t size, uint32_t seed, uint32_t key){
+    _size = size;
+    _half_bits = 1;
+    while (_half_bits < 16 && ((uint64_t) 1 << (2 * _half_bits)) < size){
+        _half_bits++;
+    }
+    _half_mask = ((uint32_t) 1 << _half_bits) - 1;
+    uint32_t counter[4] = {seed, key, 0, 0x46454953};
+    uint32_t philox_key[2] = {seed, key};
+    counter_rng::philox(counter, philox_key, _round_keys);
+}
+
+// Murmur3 finalizer of the right half, keyed per round...
+static uint32_t feistel_round(uint32_t half, uint32_t round_key){
+    uint32_t h = half ^ round_key;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+// Every value is walked at most until it lands in [0, size), which takes fewer than
+// 4 steps on average since the domain is less than 4 times the size...
+uint32_t feistel_permutation::operator()(uint32_t index) const{
+    uint64_t value = index;
+    do {
+        uint32_t left = (uint32_t) (value >> _half_bits) & _half_mask;
+        uint32_t right = (uint32_t) value & _half_mask;
+        for (int round=0; round<4; round++){
+            uint32_t next = left ^ (feistel_round(right, _round_keys[round]) & _half_mask);
+            left = right;
+            right = next;
+        }
+        value = ((uint64_t) left << _half_bits) | right;
+    } while (value >= _size);
+    return (uint32_t) value;
+}
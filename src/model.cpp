@@ -1,22 +1,40 @@
+#include "../include/counter_rng.h"
 #include "../include/dictionary.h"
 #include "../include/model.h"
+#include "../include/model_snapshot.h"
+#include "../include/output_sink.h"
 #include "../include/statistics.h"
+#include "../include/statistics_file.h"
+#include "../include/stream_player.h"
+#include "../include/stream_sorter.h"
+#include "../include/triple_file.h"
 #include "../include/volatility_gen.h"
+#include "../include/zipf_sampler.h"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <random>
 ///#include <set>
 #include <unordered_set>
 #include <sstream>
 #include <stack>
+#include <thread>
 
 #include <math.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/date_time/local_time/local_time.hpp>
 #include "boost/date_time/posix_time/posix_time.hpp"
 #include "boost/date_time/posix_time/posix_time_types.hpp"
@@ -24,10 +42,12 @@
 
 namespace bpt = boost::posix_time;
 
-static unsigned int MAX_LOOP_COUNTER = 50;
 static int MAX_LITERAL_WORDS = 25;
-
-static map<int, vector<double> *> zipfian_cache;
+static unsigned int SHARD_SIZE = 4096;
+// Queries, and samples, per batch of the parallel query_template_m_t::instantiate()...
+static unsigned int QUERY_BATCH_SIZE = 1024;
+// Triples are not split into chunks smaller than this for compute_statistics()...
+static size_t MIN_STATISTICS_CHUNK = 1 << 16;
 
 struct hashfunc {
     template<typename T, typename U>
@@ -45,12 +65,140 @@ static unordered_map<string, vector<string>> offerRetailer;
 static unordered_map<string, vector<string>> offerCountry;
 static unordered_map<string, vector<string>> offerProduct;
 static unordered_map<string, vector<long>> offerTime;
+// Timed edges of one predicate (likes, follows or subscribes) as (left ID, right ID)
+// pairs. The edges of an association are added together, so every run of them keeps
+// only the index of its first edge and the association...
+struct stream_edges_st {
+    vector<pair<unsigned int, unsigned int> > _ids;
+    vector<pair<size_t, const association_m_t *> > _runs;
+
+    void add(const association_m_t *association, unsigned int left_id, unsigned int right_id) {
+        if (_runs.empty() || _runs.back().second != association) {
+            _runs.push_back(make_pair(_ids.size(), association));
+        }
+        _ids.push_back(make_pair(left_id, right_id));
+    }
+};
+
+// Attribute triples of a review, purchase or offer, as "s\tp\to" records. The subject
+// keeps its brackets, since it is the key into the maps above...
+struct stream_entity_st {
+    string _subject;
+    vector<string> _records;
+};
+
+// Stream data of model::generate_stream_data(), in the order it was generated. Timed
+// edges go straight to streamSorter if there is one, and are kept per predicate IRI
+// otherwise. Entities without attribute triples are not kept...
+static stream_sorter *streamSorter = NULL;
+static unordered_map<string, stream_edges_st> streamEdges;
+static vector<stream_entity_st> reviewEntities;
+static vector<stream_entity_st> purchaseEntities;
+static vector<stream_entity_st> offerEntities;
+
+// Picks the right instances of an association whose right instances may be mapped only
+// once (left cardinality 1), without replacement. Uniform draws walk a keyed permutation
+// of the instance indexes, which is exact and O(1) per draw. Other distributions draw as
+// usual and take the next unused index on a collision, found through a path-compressed
+// successor array in near-constant time. next() only fails once every instance is used...
+struct distinct_sampler_st {
+    unsigned int                _instance_count;
+    unsigned int                _used_count;
+    DISTRIBUTION_TYPES::enum_t  _distribution;
+    feistel_permutation         _permutation;
+    vector<unsigned int>        _next_unused;
+
+    distinct_sampler_st(unsigned int instance_count, DISTRIBUTION_TYPES::enum_t distribution, unsigned int seed,
+                        unsigned int key) : _permutation(instance_count, seed, key) {
+        _instance_count = instance_count;
+        _used_count = 0;
+        _distribution = distribution;
+    }
+
+    bool next(unsigned int &index) {
+        if (_used_count >= _instance_count) {
+            return false;
+        }
+        if (_distribution == DISTRIBUTION_TYPES::UNIFORM) {
+            index = _permutation(_used_count++);
+            return true;
+        }
+        if (_next_unused.empty()) {
+            // The extra slot is a sentinel that sends the search back to index 0...
+            _next_unused.resize(_instance_count + 1);
+            for (unsigned int i = 0; i <= _instance_count; i++) {
+                _next_unused[i] = i;
+            }
+        }
+        double r_value = model::generate_random(_distribution, _instance_count);
+        index = round(r_value * _instance_count);
+        index = (index >= _instance_count) ? (_instance_count - 1) : index;
+        index = find_unused(index);
+        if (index == _instance_count) {
+            index = find_unused(0);
+        }
+        _next_unused[index] = index + 1;
+        _used_count++;
+        return true;
+    }
 
-static boost::mt19937 BOOST_RND_GEN = boost::mt19937(static_cast<unsigned> (time(0)));
+    unsigned int find_unused(unsigned int index) {
+        while (_next_unused[index] != index) {
+            _next_unused[index] = _next_unused[_next_unused[index]];
+            index = _next_unused[index];
+        }
+        return index;
+    }
+};
+
+// Sets result to <prefix><id>, reusing the capacity of result...
+static void assign_iri(string &result, const string &prefix, unsigned int id) {
+    char digits[20];
+    result.assign(1, '<');
+    result.append(prefix);
+    result.append(digits, output_buffer::format_uint(id, digits));
+    result.append(1, '>');
+}
+
+// Every thread owns its generators, so that shards generated in parallel can be
+// seeded independently (see model::derive_seed())...
+// The generators are counter-based, and model::seek_random() positions them on the
+// stream of a (seed, type, id, predicate) coordinate. The normal and uniform
+// generators use different substreams of the same coordinate...
+static unsigned int RAND_SEED = 1024;
 static boost::uniform_int<> BOOST_INT_UNIFORM = boost::uniform_int<>(0, RAND_MAX);
 static boost::normal_distribution<double> BOOST_NORMAL_DIST = boost::normal_distribution<double>(0.5, (0.5/3.0));
-static boost::variate_generator<boost::mt19937, boost::normal_distribution<double> > BOOST_NORMAL_DIST_GEN (BOOST_RND_GEN, BOOST_NORMAL_DIST);
-static boost::variate_generator<boost::mt19937, boost::uniform_int<int> > BOOST_UNIFORM_DIST_GEN (BOOST_RND_GEN, BOOST_INT_UNIFORM);
+static thread_local boost::variate_generator<counter_rng, boost::normal_distribution<double> > BOOST_NORMAL_DIST_GEN (counter_rng(1), BOOST_NORMAL_DIST);
+static thread_local boost::variate_generator<counter_rng, boost::uniform_int<int> > BOOST_UNIFORM_DIST_GEN (counter_rng(0), BOOST_INT_UNIFORM);
+
+string removeBracket(const string &ss) {
+    if (!ss.size()) return ss;
+    size_t found = ss.find('>');
+    return ss.substr(1, found - 1);
+}
+
+// Adds a timed edge to the stream. Its time is drawn in either case, so that the
+// draws that follow do not depend on the stream writer...
+static void add_stream_edge(const association_m_t *association, unsigned int left_id, unsigned int right_id) {
+    unsigned int time = BOOST_UNIFORM_DIST_GEN();
+    if (streamSorter == NULL) {
+        streamEdges[association->_predicate_iri].add(association, left_id, right_id);
+        return;
+    }
+    // The stream is generated sequentially, so the same string is reused for every edge...
+    static string record;
+    char digits[20];
+    record.assign(association->_subject_type_iri);
+    record.append(digits, output_buffer::format_uint(left_id, digits));
+    record.append(1, '\t');
+    record.append(association->_predicate_iri);
+    record.append(1, '\t');
+    record.append(association->_object_type_iri);
+    record.append(digits, output_buffer::format_uint(right_id, digits));
+    record.append(1, '\t');
+    record.append(digits, output_buffer::format_uint(time, digits));
+    streamSorter->add(record);
+}
 
 ostream &operator<<(ostream &os, const DISTRIBUTION_TYPES::enum_t &distribution) {
     switch (distribution) {
@@ -109,28 +257,28 @@ bool triple_st::operator==(const triple_st &rhs) const {
 
 //parse the triple file
 vector<triple_st> triple_st::parse_file(const char *filename) {
+    triple_file file(filename, false);
+    vector<triple_view_st> views;
+    file.parse(views);
     vector<triple_st> result;
-    ifstream ifs(filename);
-    string line;
-    while (getline(ifs, line)) {
-        triple_st cur_triple(line);
-        result.push_back(cur_triple);
-        //cout << cur_triple << "\n";
+    result.reserve(views.size());
+    for (vector<triple_view_st>::const_iterator itr = views.begin(); itr != views.end(); itr++) {
+        result.push_back(triple_st(triple_view_st::to_term(itr->subject()), triple_view_st::to_term(itr->predicate()),
+                                   triple_view_st::to_term(itr->object())));
     }
-    ifs.close();
     return result;
 }
 
 vector<triple_st> triple_st::parse_stream_file(const char *filename) {
+    triple_file file(filename, true);
+    vector<triple_view_st> views;
+    file.parse(views);
     vector<triple_st> result;
-    ifstream ifs(filename);
-    string line;
-    while (getline(ifs, line)) {
-        triple_st cur_triple(line, true);
-        result.push_back(cur_triple);
-        //cout << cur_triple << "\n";
+    result.reserve(views.size());
+    for (vector<triple_view_st>::const_iterator itr = views.begin(); itr != views.end(); itr++) {
+        result.push_back(triple_st(triple_view_st::to_term(itr->subject()), triple_view_st::to_term(itr->predicate()),
+                                   triple_view_st::to_term(itr->object())));
     }
-    ifs.close();
     return result;
 }
 
@@ -219,84 +367,279 @@ void namespace_map::to_str(vector<string> &lines) const {
 }
 
 type_map::type_map() {
-
+    _indexed = false;
 }
 
 type_map::~type_map() {
 
 }
 
+// Forgets all memberships, but keeps the interned types and prefixes, so that the IDs
+// stored in the model structs remain valid...
 void type_map::clear() {
+    for (unsigned int t = 0; t < _members.size(); t++) {
+        _members[t].clear();
+    }
+    _other_members.clear();
     _index.clear();
+    _indexed = false;
+}
+
+// Splits <prefix><id> into its parts. Returns false if the instance does not end with an ID
+// that can be formatted back to the same string...
+bool type_map::split(const string &instance, string &prefix, unsigned int &id) {
+    size_t pos = instance.size();
+    while (pos > 0 && instance[pos - 1] >= '0' && instance[pos - 1] <= '9') {
+        pos--;
+    }
+    size_t digits = instance.size() - pos;
+    if (digits == 0 || digits > 9 || (digits > 1 && instance[pos] == '0')) {
+        return false;
+    }
+    id = 0;
+    for (size_t i = pos; i < instance.size(); i++) {
+        id = id * 10 + (instance[i] - '0');
+    }
+    prefix.assign(instance, 0, pos);
+    return true;
+}
+
+unsigned int type_map::intern_type(const string &type) {
+    unordered_map<string, unsigned int>::const_iterator f_it = _type_ids.find(type);
+    if (f_it != _type_ids.end()) {
+        return f_it->second;
+    }
+    unsigned int result = _types.size();
+    _type_ids.insert(pair<string, unsigned int>(type, result));
+    _types.push_back(type);
+    _members.push_back(vector<boost::dynamic_bitset<> >());
+    return result;
+}
+
+unsigned int type_map::intern_prefix(const string &prefix) {
+    unordered_map<string, unsigned int>::const_iterator f_it = _prefix_ids.find(prefix);
+    if (f_it != _prefix_ids.end()) {
+        return f_it->second;
+    }
+    unsigned int result = _prefixes.size();
+    _prefix_ids.insert(pair<string, unsigned int>(prefix, result));
+    _prefixes.push_back(prefix);
+    return result;
+}
+
+int type_map::type_id(const string &type) const {
+    unordered_map<string, unsigned int>::const_iterator f_it = _type_ids.find(type);
+    return (f_it != _type_ids.end()) ? (int) f_it->second : -1;
+}
+
+int type_map::prefix_id(const string &prefix) const {
+    unordered_map<string, unsigned int>::const_iterator f_it = _prefix_ids.find(prefix);
+    return (f_it != _prefix_ids.end()) ? (int) f_it->second : -1;
 }
 
 void type_map::insert(const string &instance, const string &type) {
-    if (_index.find(type) == _index.end()) {
-        _index.insert(pair<string, unordered_set<string> >(type, unordered_set<string>()));
+    string prefix;
+    unsigned int id = 0;
+    if (split(instance, prefix, id)) {
+        insert(intern_prefix(prefix), id, intern_type(type));
+    } else {
+        _other_members[type].insert(instance);
+    }
+}
+
+void type_map::insert(unsigned int prefix_id, unsigned int id, unsigned int type_id) {
+    _indexed = false;
+    vector<boost::dynamic_bitset<> > &type_members = _members[type_id];
+    if (type_members.size() <= prefix_id) {
+        type_members.resize(prefix_id + 1);
+    }
+    boost::dynamic_bitset<> &bits = type_members[prefix_id];
+    if (bits.size() <= id) {
+        bits.resize(max((size_t) id + 1, bits.size() * 2));
+    }
+    bits.set(id);
+}
+
+bool type_map::instanceof(unsigned int prefix_id, unsigned int id, unsigned int type_id) const {
+    if (type_id >= _members.size() || prefix_id >= _members[type_id].size()) {
+        return false;
     }
-    _index[type].insert(instance);
+    const boost::dynamic_bitset<> &bits = _members[type_id][prefix_id];
+    return id < bits.size() && bits.test(id);
 }
 
 bool type_map::instanceof(const string &instance, const string &type) const {
-    unordered_map<string, unordered_set<string> >::const_iterator f_it1 = _index.find(type);
-    if (f_it1 != _index.end()) {
-        unordered_set<string>::const_iterator f_it2 = f_it1->second.find(instance);
-        if (f_it2 != f_it1->second.end()) {
-            return true;
+    string prefix;
+    unsigned int id = 0;
+    if (split(instance, prefix, id)) {
+        int t_id = type_id(type), p_id = prefix_id(prefix);
+        return t_id >= 0 && p_id >= 0 && instanceof(p_id, id, t_id);
+    }
+    unordered_map<string, unordered_set<string> >::const_iterator f_it1 = _other_members.find(type);
+    return f_it1 != _other_members.end() && f_it1->second.find(instance) != f_it1->second.end();
+}
+
+const boost::dynamic_bitset<> *type_map::members(unsigned int prefix_id, unsigned int type_id) const {
+    if (type_id >= _members.size() || prefix_id >= _members[type_id].size()) {
+        return NULL;
+    }
+    return &(_members[type_id][prefix_id]);
+}
+
+void type_map::assign(unsigned int prefix_id, unsigned int type_id, boost::dynamic_bitset<> &bits) {
+    _indexed = false;
+    vector<boost::dynamic_bitset<> > &type_members = _members[type_id];
+    if (type_members.size() <= prefix_id) {
+        type_members.resize(prefix_id + 1);
+    }
+    type_members[prefix_id].swap(bits);
+}
+
+// Returns the IDs of the members of type_id under prefix_id in increasing order...
+void type_map::get_instances(unsigned int prefix_id, unsigned int type_id, vector<unsigned int> &ids) const {
+    if (type_id >= _members.size() || prefix_id >= _members[type_id].size()) {
+        return;
+    }
+    const boost::dynamic_bitset<> &bits = _members[type_id][prefix_id];
+    for (size_t id = bits.find_first(); id != boost::dynamic_bitset<>::npos; id = bits.find_next(id)) {
+        ids.push_back(id);
+    }
+}
+
+// Materializes the members of every (type, prefix) pair as a sorted ID array. Call it once
+// the type assertions are complete; the index is then shared read-only...
+void type_map::build_index() {
+    _index.assign(_members.size(), vector<vector<unsigned int> >());
+    for (unsigned int t = 0; t < _members.size(); t++) {
+        _index[t].resize(_members[t].size());
+        for (unsigned int p = 0; p < _members[t].size(); p++) {
+            _index[t][p].reserve(_members[t][p].count());
+            get_instances(p, t, _index[t][p]);
         }
     }
-    return false;
+    _indexed = true;
+}
+
+// Returns the IDs of the members of type_id under prefix_id in increasing order, or NULL
+// if there are none. Requires build_index()...
+const vector<unsigned int> *type_map::instance_ids(unsigned int prefix_id, unsigned int type_id) const {
+    if (!_indexed) {
+        cerr << "[type_map::instance_ids()]\tThe instance index is not built..." << "\n";
+        exit(0);
+    }
+    if (type_id >= _index.size() || prefix_id >= _index[type_id].size() || _index[type_id][prefix_id].empty()) {
+        return NULL;
+    }
+    return &(_index[type_id][prefix_id]);
 }
 
+// Returns the instances of type whose IRI starts with entity, or NULL if type has no instances...
 vector<string> *type_map::get_instances(const string &entity, const string &type) const {
-    //cout<<"Looking up type restriction:"<<type<<"\n";
-    unordered_map<string, unordered_set<string> >::const_iterator f_it1 = _index.find(type);
-    if (f_it1 != _index.end()) {
-        vector<string> *result = new vector<string>();
+    int t_id = type_id(type);
+    bool found = false;
+    vector<string> *result = new vector<string>();
+    if (t_id >= 0) {
+        const vector<boost::dynamic_bitset<> > &type_members = _members[t_id];
+        for (unsigned int p_id = 0; p_id < type_members.size(); p_id++) {
+            if (type_members[p_id].none()) {
+                continue;
+            }
+            found = true;
+            if (boost::starts_with(_prefixes[p_id], entity)) {
+                vector<unsigned int> ids;
+                get_instances(p_id, t_id, ids);
+                char digits[20];
+                for (vector<unsigned int>::const_iterator itr = ids.begin(); itr != ids.end(); itr++) {
+                    string instance = _prefixes[p_id];
+                    instance.append(digits, output_buffer::format_uint(*itr, digits));
+                    result->push_back(instance);
+                }
+            }
+        }
+    }
+    unordered_map<string, unordered_set<string> >::const_iterator f_it1 = _other_members.find(type);
+    if (f_it1 != _other_members.end()) {
+        found = true;
         for (unordered_set<string>::const_iterator f_it2 = f_it1->second.begin();
              f_it2 != f_it1->second.end(); f_it2++) {
-            string instance = *f_it2;
-            if (boost::starts_with(instance, entity)) {
+            if (boost::starts_with(*f_it2, entity)) {
                 result->push_back(*f_it2);
             }
         }
-        return result;
     }
-    //cout<<"Type restriction not found..."<<"\n";
-    //cout<<"Listing contents under type_map..."<<"\n";
-    //for (map<string, set<string> >::const_iterator itr1=_index.begin(); itr1!=_index.end(); itr1++){
-    //cout<<"\t"<<itr1->first<<"\n";
-    //}
-    //cout<<"Contents listed..."<<"\n";
-    return NULL;
+    if (!found) {
+        delete result;
+        return NULL;
+    }
+    return result;
 }
 
-void type_map::print() const {
-    for (unordered_map<string, unordered_set<string> >::const_iterator itr1 = _index.begin();
-         itr1 != _index.end(); itr1++) {
-        cout << "Type:::\t" << itr1->first << "\n";
+// Approximate heap footprint of the type_map in bytes...
+size_t type_map::memory_usage() const {
+    size_t result = sizeof(type_map);
+    for (unsigned int t = 0; t < _types.size(); t++) {
+        result += 2 * (sizeof(string) + _types[t].capacity()) + sizeof(unsigned int) + 2 * sizeof(void *);
+        result += _members[t].capacity() * sizeof(boost::dynamic_bitset<>);
+        for (unsigned int p = 0; p < _members[t].size(); p++) {
+            result += _members[t][p].num_blocks() * sizeof(boost::dynamic_bitset<>::block_type);
+        }
+    }
+    for (unsigned int p = 0; p < _prefixes.size(); p++) {
+        result += 2 * (sizeof(string) + _prefixes[p].capacity()) + sizeof(unsigned int) + 2 * sizeof(void *);
+    }
+    for (unordered_map<string, unordered_set<string> >::const_iterator itr1 = _other_members.begin();
+         itr1 != _other_members.end(); itr1++) {
+        result += sizeof(string) + itr1->first.capacity() + 2 * sizeof(void *);
         for (unordered_set<string>::const_iterator itr2 = itr1->second.begin(); itr2 != itr1->second.end(); itr2++) {
-            cout << "\t\t\t" << *itr2 << "\n";
+            result += sizeof(string) + itr2->capacity() + 2 * sizeof(void *);
+        }
+    }
+    return result;
+}
+
+void type_map::print() const {
+    for (unsigned int t = 0; t < _types.size(); t++) {
+        vector<string> *instances = get_instances("", _types[t]);
+        if (instances == NULL) {
+            continue;
+        }
+        cout << "Type:::\t" << _types[t] << "\n";
+        for (vector<string>::const_iterator itr = instances->begin(); itr != instances->end(); itr++) {
+            cout << "\t\t\t" << *itr << "\n";
         }
+        delete instances;
     }
 }
 
 void type_map::to_str(vector<string> &lines) const {
-    for (unordered_map<string, unordered_set<string> >::const_iterator itr1 = _index.begin();
-         itr1 != _index.end(); itr1++) {
+    set<string> types;
+    for (unsigned int t = 0; t < _types.size(); t++) {
+        types.insert(_types[t]);
+    }
+    for (unordered_map<string, unordered_set<string> >::const_iterator itr1 = _other_members.begin();
+         itr1 != _other_members.end(); itr1++) {
+        types.insert(itr1->first);
+    }
+    for (set<string>::const_iterator itr1 = types.begin(); itr1 != types.end(); itr1++) {
+        vector<string> *instances = get_instances("", *itr1);
+        if (instances == NULL) {
+            continue;
+        }
         string line = "";
-        line.append(itr1->first);
+        line.append(*itr1);
         line.append(" ");
-        for (unordered_set<string>::const_iterator itr2 = itr1->second.begin(); itr2 != itr1->second.end(); itr2++) {
+        for (vector<string>::const_iterator itr2 = instances->begin(); itr2 != instances->end(); itr2++) {
             line.append(*itr2);
             line.append(" ");
         }
         lines.push_back(line);
+        delete instances;
     }
 }
 
 void predicate_m_t::init(string label, LITERAL_TYPES::enum_t literal_type) {
     _label = label;
+    _random_key = counter_rng::hash(label);
     _literal_type = literal_type;
     switch (_literal_type) {
         case LITERAL_TYPES::INTEGER: {
@@ -341,6 +684,8 @@ predicate_m_t::predicate_m_t(string label, LITERAL_TYPES::enum_t literal_type, s
 
 predicate_m_t::predicate_m_t(const predicate_m_t &rhs) {
     _label = rhs._label;
+    _label_iri = rhs._label_iri;
+    _random_key = rhs._random_key;
     _literal_type = rhs._literal_type;
     _range_min = rhs._range_min;
     _range_max = rhs._range_max;
@@ -417,11 +762,20 @@ predicate_m_t *predicate_m_t::parse(const string &line) {
     }
 }
 
-string predicate_m_t::generate(const namespace_map &n_map) {
+// Generates the value of this predicate for instance <id> of the given type...
+// The literal only depends on the coordinate (seed, type, id, predicate)...
+string predicate_m_t::generate(unsigned int type_key, unsigned int id,
+                               unsigned int group_key) {
+    model::seek_random(type_key, id, _random_key ^ group_key);
+    return generate();
+}
+
+string predicate_m_t::generate() {
     string result = "";
     string literal = model::generate_literal(_literal_type, _distribution_type, _range_min, _range_max);
+    result.reserve(_label_iri.size() + literal.size() + 5);
     result.append("<");
-    result.append(n_map.replace(_label));
+    result.append(_label_iri);
     result.append(">");
     result.append("\t");
     result.append("\"");
@@ -430,6 +784,10 @@ string predicate_m_t::generate(const namespace_map &n_map) {
     return result;
 }
 
+void predicate_m_t::compile(const namespace_map &n_map) {
+    _label_iri = n_map.replace(_label);
+}
+
 predicate_group_m_t::predicate_group_m_t() {
     _post_process = false;
     _gen_probability = 1.0;
@@ -451,7 +809,9 @@ predicate_group_m_t::predicate_group_m_t(float gen_probability, const string &ty
 predicate_group_m_t::predicate_group_m_t(const predicate_group_m_t &rhs) {
     _post_process = rhs._post_process;
     _gen_probability = rhs._gen_probability;
-    _type_restriction = new string(*(rhs._type_restriction));
+    _type_restriction = (rhs._type_restriction != NULL) ? new string(*(rhs._type_restriction)) : NULL;
+    _type_restriction_iri = rhs._type_restriction_iri;
+    _type_restriction_id = rhs._type_restriction_id;
     for (unsigned int i = 0; i < rhs._predicate_array.size(); i++) {
         _predicate_array.push_back(new predicate_m_t(*(rhs._predicate_array[i])));
     }
@@ -464,6 +824,16 @@ predicate_group_m_t::~predicate_group_m_t() {
     delete _type_restriction;
 }
 
+void predicate_group_m_t::compile(const namespace_map &n_map, type_map &t_map) {
+    if (_type_restriction != NULL) {
+        _type_restriction_iri = n_map.replace(*_type_restriction);
+        _type_restriction_id = t_map.intern_type(_type_restriction_iri);
+    }
+    for (unsigned int i = 0; i < _predicate_array.size(); i++) {
+        _predicate_array[i]->compile(n_map);
+    }
+}
+
 // example input: <pgroup>  0.8  @wsdbm:ProductCategory0
 // gen_probability = 0.8
 // type_restriction = wsdbm:ProductCategory0
@@ -522,6 +892,8 @@ resource_m_t::resource_m_t(bool scalable, string type_prefix, unsigned int scali
 resource_m_t::resource_m_t(const resource_m_t &rhs) {
     _scalable = rhs._scalable;
     _type_prefix = rhs._type_prefix;
+    _type_iri = rhs._type_iri;
+    _type_prefix_id = rhs._type_prefix_id;
     _scaling_coefficient = rhs._scaling_coefficient;
     for (unsigned int i = 0; i < rhs._predicate_group_array.size(); i++) {
         _predicate_group_array.push_back(new predicate_group_m_t(*(rhs._predicate_group_array[i])));
@@ -534,83 +906,73 @@ resource_m_t::~resource_m_t() {
     }
 }
 
-void resource_m_t::generate(const namespace_map &n_map, map<string, unsigned int> &id_cursor_map) {
+void resource_m_t::compile(const namespace_map &n_map, type_map &t_map) {
+    _type_iri = n_map.replace(_type_prefix);
+    _type_prefix_id = t_map.intern_prefix(_type_iri);
+    for (unsigned int i = 0; i < _predicate_group_array.size(); i++) {
+        _predicate_group_array[i]->compile(n_map, t_map);
+    }
+}
+
+void resource_m_t::generate(map<string, unsigned int> &id_cursor_map, output_buffer &out) {
     if (id_cursor_map.find(_type_prefix) == id_cursor_map.end()) {
         id_cursor_map[_type_prefix] = 0;
     }
-    for (unsigned int id = id_cursor_map[_type_prefix];
-         id < (id_cursor_map[_type_prefix] + _scaling_coefficient); id++) {
-        string subject = "";
-        subject.append("<");
-        subject.append(n_map.replace(_type_prefix));
-        subject.append(boost::lexical_cast<string>(id));
-        subject.append(">");
-
-        for (vector<predicate_group_m_t *>::const_iterator itr2 = _predicate_group_array.begin();
-             itr2 != _predicate_group_array.end(); itr2++) {
-            predicate_group_m_t *predicate_group = *itr2;
+    generate(id_cursor_map[_type_prefix], id_cursor_map[_type_prefix] + _scaling_coefficient, out);
+    id_cursor_map[_type_prefix] += _scaling_coefficient;
+}
+
+// Generates the attributes of the instances in [id_begin, id_end)...
+void resource_m_t::generate(unsigned int id_begin, unsigned int id_end, output_buffer &out) {
+    unsigned int type_key = counter_rng::hash(_type_prefix);
+    for (unsigned int id = id_begin; id < id_end; id++) {
+
+        for (unsigned int group_id = 0; group_id < _predicate_group_array.size(); group_id++) {
+            predicate_group_m_t *predicate_group = _predicate_group_array[group_id];
             if (!predicate_group->_post_process) {
+                model::seek_random(type_key, id, group_id);
                 float draw = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
                 //float draw = ((float) rand())/((float)RAND_MAX);
                 if (draw <= predicate_group->_gen_probability) {
                     for (vector<predicate_m_t *>::const_iterator itr3 = predicate_group->_predicate_array.begin();
                          itr3 != predicate_group->_predicate_array.end(); itr3++) {
                         predicate_m_t *predicate = *itr3;
-                        string triple_str = "";
-                        triple_str.append(subject);
-                        triple_str.append("\t");
-                        triple_str.append(predicate->generate(n_map));
-
-                        int tab1_index = triple_str.find("\t");
-                        int tab2_index = triple_str.find("\t", tab1_index + 1);
-
-                        //triple_lines.push_back(triple_st(triple_str.substr(0, tab1_index), triple_str.substr((tab1_index+1), (tab2_index-tab1_index-1)), triple_str.substr(tab2_index+1)));
-                        triple_st line(triple_str.substr(0, tab1_index),
-                                       triple_str.substr((tab1_index + 1), (tab2_index - tab1_index - 1)),
-                                       triple_str.substr(tab2_index + 1));
-                        cout << line << " .\n";
+                        out.append_iri(_type_iri, id);
+                        out.append('\t');
+                        out.append(predicate->generate(type_key, id, group_id * 0x9E3779B9u));
+                        out.append(" .\n", 3);
                     }
                 }
             }
         }
     }
-    id_cursor_map[_type_prefix] += _scaling_coefficient;
 }
 
-void resource_m_t::process_type_restrictions(const namespace_map &n_map, const type_map &t_map,
-                                             const map<string, unsigned int> &id_cursor_map) {
+void resource_m_t::process_type_restrictions(const type_map &t_map,
+                                             const map<string, unsigned int> &id_cursor_map, output_buffer &out) {
     unsigned int max_count = (id_cursor_map.find(_type_prefix))->second;
-    for (unsigned int id = 0; id < max_count; id++) {
-        string subject = "";
-        subject.append(n_map.replace(_type_prefix));
-        subject.append(boost::lexical_cast<string>(id));
-
-        for (vector<predicate_group_m_t *>::const_iterator itr2 = _predicate_group_array.begin();
-             itr2 != _predicate_group_array.end(); itr2++) {
-            predicate_group_m_t *predicate_group = *itr2;
+    process_type_restrictions(t_map, 0, max_count, out);
+}
+
+void resource_m_t::process_type_restrictions(const type_map &t_map,
+                                             unsigned int id_begin, unsigned int id_end, output_buffer &out) {
+    unsigned int type_key = counter_rng::hash(_type_prefix);
+    for (unsigned int id = id_begin; id < id_end; id++) {
+        for (unsigned int group_id = 0; group_id < _predicate_group_array.size(); group_id++) {
+            predicate_group_m_t *predicate_group = _predicate_group_array[group_id];
             if (predicate_group->_post_process &&
-                t_map.instanceof(subject, n_map.replace(*(predicate_group->_type_restriction)))) {
+                t_map.instanceof(_type_prefix_id, id, predicate_group->_type_restriction_id)) {
+                model::seek_random(type_key, id, group_id);
                 float draw = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
 //                float draw = ((float) rand())/((float)RAND_MAX);
                 if (draw <= predicate_group->_gen_probability) {
                     for (vector<predicate_m_t *>::const_iterator itr3 = predicate_group->_predicate_array.begin();
                          itr3 != predicate_group->_predicate_array.end(); itr3++) {
                         predicate_m_t *predicate = *itr3;
-                        string triple_str = "";
-                        triple_str.append("<");
-                        triple_str.append(subject);
-                        triple_str.append(">");
-                        triple_str.append("\t");
-                        triple_str.append(predicate->generate(n_map));
-
-                        int tab1_index = triple_str.find("\t");
-                        int tab2_index = triple_str.find("\t", tab1_index + 1);
-
-                        //triple_lines.push_back(triple_st(triple_str.substr(0, tab1_index), triple_str.substr((tab1_index+1), (tab2_index-tab1_index-1)), triple_str.substr(tab2_index+1)));
-                        triple_st line(triple_str.substr(0, tab1_index),
-                                       triple_str.substr((tab1_index + 1), (tab2_index - tab1_index - 1)),
-                                       triple_str.substr(tab2_index + 1));
-                        cout << line << " .\n";
+                        out.append_iri(_type_iri, id);
+                        out.append('\t');
+                        out.append(predicate->generate(type_key, id, group_id * 0x9E3779B9u));
+                        out.append(" .\n", 3);
                     }
                 }
             }
@@ -673,17 +1035,14 @@ namespace_map::~namespace_map() {
 }
 
 void namespace_map::insert(const namespace_m_t &namespace_declaration) {
-    if (_index.find(namespace_declaration._alias) == _index.end()) {
-        _index.insert(pair<string, string>(namespace_declaration._alias, namespace_declaration._prefix));
-    } else {
-        cerr << "[namespace_map::insert()] Warning: trying to insert an already existing namespace declaration..." <<
-        "\n";
-    }
+    insert(namespace_declaration._alias, namespace_declaration._prefix);
 }
 
 void namespace_map::insert(const string &alias, const string &prefix) {
     if (_index.find(alias) == _index.end()) {
         _index.insert(pair<string, string>(alias, prefix));
+        _aliases.push_back(alias);
+        _expansions.push_back(prefix);
     } else {
         cerr << "[namespace_map::insert()] Warning: trying to insert an already existing namespace declaration..." <<
         "\n";
@@ -700,17 +1059,42 @@ string namespace_map::lookup(const string &alias) const {
     }
 }
 
+// Returns the ID of the alias, or -1 if it is not declared...
+// There are only a handful of namespaces, so a linear scan is cheaper than the map lookup.
+int namespace_map::alias_id(const char *alias, size_t length) const {
+    for (unsigned int i = 0; i < _aliases.size(); i++) {
+        if (_aliases[i].size() == length && memcmp(_aliases[i].data(), alias, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const string &namespace_map::expansion(int alias_id) const {
+    return _expansions[alias_id];
+}
+
 string namespace_map::replace(const string &content) const {
-    unsigned int pos = content.find_first_of(':');
-    if (pos != string::npos) {
-        string alias = content.substr(0, pos);
-        string suffix = content.substr(pos + 1);
-        string result = lookup(alias);
-        result.append(suffix);
-        return result;
-    } else {
-        return content;
+    string result = "";
+    replace(content, result);
+    return result;
+}
+
+// Appends the expansion of content to result, without copying the alias or the suffix...
+void namespace_map::replace(const string &content, string &result) const {
+    size_t pos = content.find(':');
+    if (pos == string::npos) {
+        result.append(content);
+        return;
+    }
+    int id = alias_id(content.data(), pos);
+    if (id < 0) {
+        cerr << content.substr(0, pos) + "[namespace_map::lookup()] Error: alias does not exist..." << "\n";
+        exit(0);
     }
+    result.reserve(result.size() + _expansions[id].size() + (content.size() - pos - 1));
+    result.append(_expansions[id]);
+    result.append(content, pos + 1, string::npos);
 }
 
 void association_m_t::init(string subject_type, string predicate, string object_type) {
@@ -725,6 +1109,8 @@ void association_m_t::init(string subject_type, string predicate, string object_
     _right_distribution = DISTRIBUTION_TYPES::UNIFORM;
     _subject_type_restriction = NULL;
     _object_type_restriction = NULL;
+    _random_key = counter_rng::hash(predicate);
+    _dropped_edge_count = 0;
 }
 
 association_m_t::association_m_t(string subject_type, string predicate, string object_type) {
@@ -785,8 +1171,7 @@ association_m_t::~association_m_t() {
     delete _object_type_restriction;
 }
 
-void association_m_t::generate(const namespace_map &n_map, type_map &t_map,
-                               const map<string, unsigned int> &id_cursor_map) {
+void association_m_t::check_types(const map<string, unsigned int> &id_cursor_map) const {
     if (id_cursor_map.find(_subject_type) == id_cursor_map.end()) {
         cerr << "[association_m_t::parse()] Error: association cannot be defined over undefined resource '" <<
         _subject_type << "'..." << "\n";
@@ -797,79 +1182,75 @@ void association_m_t::generate(const namespace_map &n_map, type_map &t_map,
         _object_type << "'..." << "\n";
         exit(0);
     }
+}
 
-    model::clear_zipfian_cache();
-
-    if (!_post_process) {
-        unsigned int left_instance_count = id_cursor_map.find(_subject_type)->second;
-        unsigned int right_instance_count = id_cursor_map.find(_object_type)->second;
-        unordered_set<unsigned int> mapped_instances;
-
-        boost::posix_time::ptime t1(bpt::microsec_clock::universal_time());
+// Expands the prefixes of the association once, so that generation does not go through
+// the namespace_map for every edge...
+void association_m_t::compile(const namespace_map &n_map, type_map &t_map) {
+    _subject_type_iri = n_map.replace(_subject_type);
+    _predicate_iri = n_map.replace(_predicate);
+    _object_type_iri = n_map.replace(_object_type);
+    _subject_prefix_id = t_map.intern_prefix(_subject_type_iri);
+    if (_subject_type_restriction != NULL) {
+        _subject_type_restriction_iri = n_map.replace(*_subject_type_restriction);
+        _subject_type_restriction_id = t_map.intern_type(_subject_type_restriction_iri);
+    }
+    _object_prefix_id = t_map.intern_prefix(_object_type_iri);
+    if (_object_type_restriction != NULL) {
+        _object_type_restriction_iri = n_map.replace(*_object_type_restriction);
+        _object_type_restriction_id = t_map.intern_type(_object_type_restriction_iri);
+    }
+}
 
-        for (unsigned int left_id = 0; left_id < left_instance_count; left_id++) {
-            float pr = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
-//            float pr = ((float) rand()) / ((float) RAND_MAX);
-            if (pr <= _left_cover) {
-                unsigned int right_size = _right_cardinality;
-                if (_right_cardinality_distribution != DISTRIBUTION_TYPES::UNDEFINED) {
-                    right_size = round((double) right_size * model::generate_random(_right_cardinality_distribution));
-                    right_size = (right_size > _right_cardinality) ? _right_cardinality : right_size;
-                }
-                for (unsigned int j = 0; j < right_size; j++) {
-                    unsigned int loop_counter = 0;
-                    unsigned int right_id = 0;
-                    do {
-                        double r_value = model::generate_random(_right_distribution, right_instance_count);
-                        right_id = round(r_value * right_instance_count);
-                        right_id = (right_id >= right_instance_count) ? (right_instance_count - 1) : right_id;
-                        loop_counter++;
-                    } while (mapped_instances.find(right_id) != mapped_instances.end() &&
-                             loop_counter < MAX_LOOP_COUNTER);
-                    if (loop_counter < MAX_LOOP_COUNTER) {
-                        if (_left_cardinality == 1) {
-                            mapped_instances.insert(right_id);
-                        }
-                        string subject(""), predicate(""), object(""), triple("");
+// An association can be split over ranges of left IDs, unless every right instance
+// may be mapped only once (i.e., left cardinality 1), which couples all left IDs...
+bool association_m_t::is_shardable() const {
+    return _left_cardinality != 1;
+}
 
-                        // FIXME:: You need to add replace-command...
-                        subject.append(n_map.replace(_subject_type));
-                        subject.append(boost::lexical_cast<string>(left_id));
+bool association_m_t::is_type_assertion() const {
+    return _predicate_iri.compare("http://www.w3.org/1999/02/22-rdf-syntax-ns#type") == 0;
+}
 
-                        object.append(n_map.replace(_object_type));
-                        object.append(boost::lexical_cast<string>(right_id));
+// Interns the type of every right instance up to right_instance_count, so that type
+// assertions are saved by ID. The type_map is not thread-safe, so this is done before
+// the association is generated...
+void association_m_t::intern_object_types(type_map &t_map, unsigned int right_instance_count) {
+    char digits[20];
+    string type_iri;
+    for (unsigned int right_id = _object_type_ids.size(); right_id < right_instance_count; right_id++) {
+        type_iri.assign(_object_type_iri);
+        type_iri.append(digits, output_buffer::format_uint(right_id, digits));
+        _object_type_ids.push_back(t_map.intern_type(type_iri));
+    }
+}
 
-                        predicate.append(n_map.replace(_predicate));
+void association_m_t::report_dropped_edges() const {
+    if (_dropped_edge_count > 0) {
+        cerr << "[association_m_t]\t" << _subject_type << " " << _predicate << " " << _object_type << ":\t"
+             << _dropped_edge_count << " edges dropped, every right instance is already mapped..." << "\n";
+    }
+}
 
-                        string subject_str(""), predicate_str(""), object_str("");
-                        subject_str.append("<");
-                        subject_str.append(subject);
-                        subject_str.append(">");
+void association_m_t::generate(type_map &t_map,
+                               const map<string, unsigned int> &id_cursor_map, output_buffer &out) {
+    check_types(id_cursor_map);
 
-                        predicate_str.append("<");
-                        predicate_str.append(predicate);
-                        predicate_str.append(">");
+    if (!_post_process) {
+        unsigned int left_instance_count = id_cursor_map.find(_subject_type)->second;
+        vector<type_assertion_st> type_assertions;
+        if (is_type_assertion()) {
+            intern_object_types(t_map, id_cursor_map.find(_object_type)->second);
+        }
 
-                        object_str.append("<");
-                        object_str.append(object);
-                        object_str.append(">");
+        boost::posix_time::ptime t1(bpt::microsec_clock::universal_time());
 
-                        //triple_lines.push_back(triple_st(subject_str, predicate_str, object_str));
-                        triple_st line(subject_str, predicate_str, object_str);
-                        cout << line << " .\n";
+        generate(id_cursor_map, 0, left_instance_count, out, type_assertions);
 
-                        // Save type assertions...
-                        if (predicate.compare("http://www.w3.org/1999/02/22-rdf-syntax-ns#type") == 0) {
-                            t_map.insert(subject, object);
-                        }
-                    } else {
-                        //cout<<"[association_m_t::generate] Warning:: failed to greedily satisfy cardinality constraints..."<<"\n";
-                        //cout<<"[association_m_t::generate] Ignoring association "
-                        //<<_subject_type<<left_id<<"-->"
-                        //<<_object_type<<right_id<<" after"<<MAX_LOOP_COUNTER<<" trials..."<<"\n";
-                    }
-                }
-            }
+        // Save type assertions...
+        for (vector<type_assertion_st>::const_iterator itr = type_assertions.begin();
+             itr != type_assertions.end(); itr++) {
+            t_map.insert(itr->_prefix_id, itr->_id, itr->_type_id);
         }
 
         boost::posix_time::ptime t2(bpt::microsec_clock::universal_time());
@@ -880,92 +1261,137 @@ void association_m_t::generate(const namespace_map &n_map, type_map &t_map,
     }
 }
 
-void association_m_t::process_type_restrictions(const namespace_map &n_map, const type_map &t_map,
-                                                const map<string, unsigned int> &id_cursor_map) {
-    if (id_cursor_map.find(_subject_type) == id_cursor_map.end()) {
-        cerr << "[association_m_t::parse()] Error: association cannot be defined over undefined resource '" <<
-        _subject_type << "'..." << "\n";
-        exit(0);
+// Generates the association for the left instances in [left_begin, left_end)...
+// Type assertions are returned in type_assertions instead of being inserted into
+// the type_map, so that shards can be generated concurrently. The types of the right
+// instances must have been interned by intern_object_types()...
+void association_m_t::generate(const map<string, unsigned int> &id_cursor_map,
+                               unsigned int left_begin, unsigned int left_end, output_buffer &out,
+                               vector<type_assertion_st> &type_assertions) {
+    unsigned int right_instance_count = id_cursor_map.find(_object_type)->second;
+    distinct_sampler_st distinct_right(right_instance_count, _right_distribution, RAND_SEED, _random_key);
+    unsigned int type_key = counter_rng::hash(_subject_type);
+
+    // The prefixes are expanded by compile(), only the IDs are formatted per edge...
+    bool save_types = is_type_assertion();
+
+    for (unsigned int left_id = left_begin; left_id < left_end; left_id++) {
+        model::seek_random(type_key, left_id, _random_key);
+        float pr = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
+//        float pr = ((float) rand()) / ((float) RAND_MAX);
+        if (pr <= _left_cover) {
+            unsigned int right_size = _right_cardinality;
+            if (_right_cardinality_distribution != DISTRIBUTION_TYPES::UNDEFINED) {
+                right_size = round((double) right_size * model::generate_random(_right_cardinality_distribution));
+                right_size = (right_size > _right_cardinality) ? _right_cardinality : right_size;
+            }
+            for (unsigned int j = 0; j < right_size; j++) {
+                unsigned int right_id = 0;
+                bool found = true;
+                if (_left_cardinality == 1) {
+                    found = distinct_right.next(right_id);
+                } else {
+                    double r_value = model::generate_random(_right_distribution, right_instance_count);
+                    right_id = round(r_value * right_instance_count);
+                    right_id = (right_id >= right_instance_count) ? (right_instance_count - 1) : right_id;
+                }
+                if (found) {
+                    out.append_iri(_subject_type_iri, left_id);
+                    out.append('\t');
+                    out.append('<');
+                    out.append(_predicate_iri);
+                    out.append(">\t", 2);
+                    out.append_iri(_object_type_iri, right_id);
+                    out.append(" .\n", 3);
+
+                    // Save type assertions...
+                    if (save_types) {
+                        type_assertion_st type_assertion = {_subject_prefix_id, left_id, _object_type_ids[right_id]};
+                        type_assertions.push_back(type_assertion);
+                    }
+                } else {
+                    _dropped_edge_count++;
+                }
+            }
+        }
     }
-    if (id_cursor_map.find(_object_type) == id_cursor_map.end()) {
-        cerr << "[association_m_t::parse()] Error: association cannot be defined over undefined resource '" <<
-        _object_type << "'..." << "\n";
-        exit(0);
+}
+
+// Returns the IDs of the right instances that satisfy the object type restriction, straight
+// from the type_map index, or NULL if there are none. Without a restriction, all object IDs
+// are listed in all_right_ids...
+const vector<unsigned int> *association_m_t::get_restricted_right_ids(const type_map &t_map,
+                                                                     const map<string, unsigned int> &id_cursor_map,
+                                                                     vector<unsigned int> &all_right_ids) const {
+    if (_object_type_restriction != NULL) {
+        return t_map.instance_ids(_object_prefix_id, _object_type_restriction_id);
     }
+    unsigned int right_instance_count = id_cursor_map.find(_object_type)->second;
+    all_right_ids.resize(right_instance_count);
+    for (unsigned int right_id = 0; right_id < right_instance_count; right_id++) {
+        all_right_ids[right_id] = right_id;
+    }
+    return &all_right_ids;
+}
 
+void association_m_t::process_type_restrictions(const type_map &t_map,
+                                                const map<string, unsigned int> &id_cursor_map, output_buffer &out) {
+    check_types(id_cursor_map);
 
     if (_post_process) {
         unsigned int left_instance_count = id_cursor_map.find(_subject_type)->second;
-        vector<string> *restricted_right_instances = NULL;
-        if (_object_type_restriction != NULL) {
-            restricted_right_instances = t_map.get_instances(n_map.replace(_object_type),
-                                                             n_map.replace(*_object_type_restriction));
-        } else {
-            restricted_right_instances = new vector<string>();
-            unsigned int right_instance_count = id_cursor_map.find(_object_type)->second;
-            for (unsigned int right_id = 0; right_id < right_instance_count; right_id++) {
-                string instance = n_map.replace(_object_type);
-                instance.append(boost::lexical_cast<string>(right_id));
-                restricted_right_instances->push_back(instance);
-            }
-        }
-        if (restricted_right_instances != NULL) {
-            unsigned int right_instance_count = restricted_right_instances->size();
-            set<string> mapped_instances;
-            for (unsigned int left_id = 0; left_id < left_instance_count; left_id++) {
-                string subject = "";
-                subject.append(n_map.replace(_subject_type));
-                subject.append(boost::lexical_cast<string>(left_id));
-                if (_subject_type_restriction == NULL ||
-                    t_map.instanceof(subject, n_map.replace(*_subject_type_restriction))) {
-                    float pr = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
-//                    float pr = ((float) rand()) / ((float) RAND_MAX);
-                    if (pr <= _left_cover) {
-                        unsigned int right_size = _right_cardinality;
-                        if (_right_cardinality_distribution != DISTRIBUTION_TYPES::UNDEFINED) {
-                            right_size = round(
-                                    (double) right_size * model::generate_random(_right_cardinality_distribution));
-                            right_size = (right_size > _right_cardinality) ? _right_cardinality : right_size;
-                        }
-                        for (unsigned int j = 0; j < right_size; j++) {
-                            string predicate = "", object = "", triple = "";
-                            unsigned int loop_counter = 0;
-                            do {
-                                double r_value = model::generate_random(_right_distribution, right_instance_count);
-                                unsigned int right_index = round(r_value * right_instance_count);
-                                right_index = (right_index >= right_instance_count) ? (right_instance_count - 1)
-                                                                                    : right_index;
-                                object = (*restricted_right_instances)[right_index];
-                                loop_counter++;
-                            } while (mapped_instances.find(object) != mapped_instances.end() &&
-                                     loop_counter < MAX_LOOP_COUNTER);
-                            if (loop_counter < MAX_LOOP_COUNTER) {
-                                if (_left_cardinality == 1) {
-                                    mapped_instances.insert(object);
-                                }
-
-                                predicate.append(n_map.replace(_predicate));
-
-                                string subject_str = "", predicate_str = "", object_str = "";
-                                subject_str.append("<");
-                                subject_str.append(subject);
-                                subject_str.append(">");
-                                predicate_str.append("<");
-                                predicate_str.append(predicate);
-                                predicate_str.append(">");
-                                object_str.append("<");
-                                object_str.append(object);
-                                object_str.append(">");
-
-                                //triple_lines.push_back(triple_st(subject_str, predicate_str, object_str));
-                                triple_st line(subject_str, predicate_str, object_str);
-                                cout << line << " .\n";
-                            }
-                        }
+        vector<unsigned int> all_right_ids;
+        const vector<unsigned int> *restricted_right_ids = get_restricted_right_ids(t_map, id_cursor_map, all_right_ids);
+        if (restricted_right_ids != NULL) {
+            process_type_restrictions(t_map, 0, left_instance_count, *restricted_right_ids, out);
+        }
+    }
+}
+
+void association_m_t::process_type_restrictions(const type_map &t_map,
+                                                unsigned int left_begin, unsigned int left_end,
+                                                const vector<unsigned int> &restricted_right_ids, output_buffer &out) {
+    unsigned int right_instance_count = restricted_right_ids.size();
+    distinct_sampler_st distinct_right(right_instance_count, _right_distribution, RAND_SEED, _random_key);
+    unsigned int type_key = counter_rng::hash(_subject_type);
+
+    for (unsigned int left_id = left_begin; left_id < left_end; left_id++) {
+        if (_subject_type_restriction == NULL ||
+            t_map.instanceof(_subject_prefix_id, left_id, _subject_type_restriction_id)) {
+            model::seek_random(type_key, left_id, _random_key);
+            float pr = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
+//            float pr = ((float) rand()) / ((float) RAND_MAX);
+            if (pr <= _left_cover) {
+                unsigned int right_size = _right_cardinality;
+                if (_right_cardinality_distribution != DISTRIBUTION_TYPES::UNDEFINED) {
+                    right_size = round(
+                            (double) right_size * model::generate_random(_right_cardinality_distribution));
+                    right_size = (right_size > _right_cardinality) ? _right_cardinality : right_size;
+                }
+                for (unsigned int j = 0; j < right_size; j++) {
+                    unsigned int right_index = 0;
+                    bool found = true;
+                    // The restricted instances are distinct, so their indexes identify them...
+                    if (_left_cardinality == 1) {
+                        found = distinct_right.next(right_index);
+                    } else {
+                        double r_value = model::generate_random(_right_distribution, right_instance_count);
+                        right_index = round(r_value * right_instance_count);
+                        right_index = (right_index >= right_instance_count) ? (right_instance_count - 1)
+                                                                            : right_index;
+                    }
+                    if (found) {
+                        out.append_iri(_subject_type_iri, left_id);
+                        out.append("\t<", 2);
+                        out.append(_predicate_iri);
+                        out.append(">\t", 2);
+                        out.append_iri(_object_type_iri, restricted_right_ids[right_index]);
+                        out.append(" .\n", 3);
+                    } else {
+                        _dropped_edge_count++;
                     }
                 }
             }
-            delete restricted_right_instances;
         }
     }
 }
@@ -1080,6 +1506,9 @@ association_m_t *association_m_t::parse(const map<string, unsigned int> &id_curs
         exit(0);
     }
     result->_right_cardinality_distribution = right_cardinality_distribution;
+    // The same (subject, predicate, object) can be declared several times with different
+    // parameters, so the random stream is keyed on the whole declaration...
+    result->_random_key = counter_rng::hash(line);
     delete subject_type_restriction;
     delete object_type_restriction;
     return result;
@@ -1173,7 +1602,9 @@ mapping_m_t::mapping_m_t(const mapping_m_t &rhs) {
     _is_literal_type = rhs._is_literal_type;
     _literal_type = rhs._literal_type;
     _resource_type = rhs._resource_type;
-    _type_restriction = new string(*(rhs._type_restriction));
+    _type_restriction = (rhs._type_restriction != NULL) ? new string(*(rhs._type_restriction)) : NULL;
+    _resource_type_iri = rhs._resource_type_iri;
+    _type_restriction_iri = rhs._type_restriction_iri;
     _distribution_type = rhs._distribution_type;
     _range_min = rhs._range_min;
     _range_max = rhs._range_max;
@@ -1184,6 +1615,15 @@ mapping_m_t::~mapping_m_t() {
     delete _type_restriction;
 }
 
+void mapping_m_t::compile(const namespace_map &n_map) {
+    if (!_is_literal_type) {
+        _resource_type_iri = n_map.replace(_resource_type);
+        if (_type_restriction != NULL) {
+            _type_restriction_iri = n_map.replace(*_type_restriction);
+        }
+    }
+}
+
 string mapping_m_t::generate(const model &mdl, const query_template_m_t &q_template) {
     unsigned int count = 0;
     return generate(mdl, q_template, count);
@@ -1232,15 +1672,22 @@ string mapping_m_t::generate(const model &mdl, const query_template_m_t &q_templ
 
             id = (id >= instance_count) ? (instance_count - 1) : id;
             result.append("<");
-            result.append(mdl._namespace_map.replace(_resource_type));
+            result.append(_resource_type_iri);
             result.append(boost::lexical_cast<string>(id));
             result.append(">");
             return result;
         } else {
             string result = "";
-            vector<string> *restricted_instances = mdl._type_map.get_instances(
-                    mdl._namespace_map.replace(_resource_type), mdl._namespace_map.replace(*_type_restriction));
-            instance_count = restricted_instances->size();
+            int prefix_id = mdl._type_map.prefix_id(_resource_type_iri);
+            int type_id = mdl._type_map.type_id(_type_restriction_iri);
+            const vector<unsigned int> *restricted_ids = (prefix_id >= 0 && type_id >= 0) ?
+                    mdl._type_map.instance_ids(prefix_id, type_id) : NULL;
+            if (restricted_ids == NULL) {
+                cerr << "[mapping_m_t::generate()]\tType " << *_type_restriction << " has no instances of " <<
+                _resource_type << "..." << "\n";
+                exit(0);
+            }
+            instance_count = restricted_ids->size();
 
             unsigned int index = 0;
 
@@ -1276,9 +1723,9 @@ string mapping_m_t::generate(const model &mdl, const query_template_m_t &q_templ
 
             index = (index >= instance_count) ? (instance_count - 1) : index;
             result.append("<");
-            result.append((*restricted_instances)[index]);
+            result.append(_resource_type_iri);
+            result.append(boost::lexical_cast<string>((*restricted_ids)[index]));
             result.append(">");
-            delete restricted_instances;
             return result;
         }
     }
@@ -1413,8 +1860,9 @@ operation_m_t::operation_m_t(const operation_m_t &rhs) {
     _operand = rhs._operand;
 }
 
-string operation_m_t::compute(const map<string, string> &value_mappings) {
-    int value = boost::lexical_cast<int>(value_mappings.find(_source_variable)->second);
+// Writes the result into result, which keeps its capacity between queries...
+void operation_m_t::compute(boost::string_view source_value, string &result) const {
+    int value = boost::lexical_cast<int>(source_value.data(), source_value.size());
     if (_operation == OPERATION_TYPES::ADDITION) {
         value = value + _operand;
     } else if (_operation == OPERATION_TYPES::MULTIPLICATION) {
@@ -1422,7 +1870,14 @@ string operation_m_t::compute(const map<string, string> &value_mappings) {
     } else if (_operation == OPERATION_TYPES::MOD) {
         value = value % _operand;
     }
-    return boost::lexical_cast<string>(value);
+    long long magnitude = value;
+    result.clear();
+    if (magnitude < 0) {
+        result.push_back('-');
+        magnitude = -magnitude;
+    }
+    char digits[20];
+    result.append(digits, output_buffer::format_uint(magnitude, digits));
 }
 
 operation_m_t *operation_m_t::parse(const string &line) {
@@ -1474,9 +1929,41 @@ operation_m_t *operation_m_t::parse(const string &line) {
     }
 }
 
+sample_pool_st::sample_pool_st() {
+    _offsets.push_back(0);
+}
+
+unsigned int sample_pool_st::intern(const string &value) {
+    unordered_map<string, unsigned int>::const_iterator itr = _ids.find(value);
+    if (itr != _ids.end()) {
+        return itr->second;
+    }
+    unsigned int id = _offsets.size() - 1;
+    _text.append(value);
+    _offsets.push_back(_text.size());
+    _ids.insert(pair<string, unsigned int>(value, id));
+    return id;
+}
+
+void sample_pool_st::append(const sample_pool_st &rhs) {
+    vector<unsigned int> id_map (rhs._offsets.size() - 1);
+    for (unsigned int id = 0; id < id_map.size(); id++) {
+        id_map[id] = intern(rhs.value(id).to_string());
+    }
+    if (_samples.size() < rhs._samples.size()) {
+        _samples.resize(rhs._samples.size());
+    }
+    for (unsigned int m = 0; m < rhs._samples.size(); m++) {
+        for (vector<unsigned int>::const_iterator itr = rhs._samples[m].cbegin(); itr != rhs._samples[m].cend(); itr++) {
+            _samples[m].push_back(id_map[*itr]);
+        }
+    }
+}
+
 query_template_m_t::query_template_m_t(const model *mdl) {
     _mdl = mdl;
     _instantiationCount = 0;
+    _variable_count = 0;
 }
 
 query_template_m_t::query_template_m_t(const query_template_m_t &rhs) {
@@ -1500,6 +1987,15 @@ query_template_m_t::query_template_m_t(const query_template_m_t &rhs) {
     }
     _template_lines.insert(_template_lines.end(), rhs._template_lines.cbegin(), rhs._template_lines.cend());
     _instantiationCount = rhs._instantiationCount;
+    _compiled_lines = rhs._compiled_lines;
+    _fragments = rhs._fragments;
+    _slot_names = rhs._slot_names;
+    _variable_count = rhs._variable_count;
+    _mapping_variables = rhs._mapping_variables;
+    _mapping_defines = rhs._mapping_defines;
+    _operation_sources = rhs._operation_sources;
+    _operation_targets = rhs._operation_targets;
+    _slot_variables = rhs._slot_variables;
 }
 
 query_template_m_t::~query_template_m_t() {
@@ -1521,118 +2017,213 @@ query_template_m_t::~query_template_m_t() {
 }
 
 void query_template_m_t::instantiate(unsigned int query_count, unsigned int recurrence, vector<string> &result_array) {
-    map<string, vector<string> > sample_map;
+    sample_pool_st pool;
     unsigned int sample_count = (int) ((float) query_count / (float) recurrence) + 1;
-    for (unsigned i = 0; i < sample_count; i++) {
-        for (vector<mapping_m_t *>::const_iterator itr = _variable_mapping_array.cbegin();
-             itr != _variable_mapping_array.cend(); itr++) {
-            mapping_m_t *mapping = *itr;
-            if (mapping->_distribution_type != DISTRIBUTION_TYPES::DYNAMIC) {
-                if (sample_map.find(mapping->_var_name) == sample_map.end()) {
-                    sample_map.insert(pair<string, vector<string>>(mapping->_var_name, vector<string>()));
-                }
-                sample_map[mapping->_var_name].push_back(mapping->generate(*_mdl, *this));
-            }
-        }
-    }
+    generate_samples(0, sample_count, pool);
 
+    string query;
     for (unsigned i = 0; i < query_count; i++) {
-        string query = "";
-        map<string, string> value_map;
-        ///////////////////////////////////////////////////////////////////////////////////////////
-        // Instead of populating value_map using mapping_m_t
-        //  just sample values from sample_map...
-        ///////////////////////////////////////////////////////////////////////////////////////////
-
-        for (vector<mapping_m_t *>::const_iterator itr = _variable_mapping_array.cbegin();
-             itr != _variable_mapping_array.cend(); itr++) {
-            mapping_m_t *mapping = *itr;
-            if (mapping->_distribution_type == DISTRIBUTION_TYPES::DYNAMIC) {
-                value_map.insert(pair<string, string>(mapping->_var_name, mapping->generate(*_mdl, *this)));
-            } else {
-                vector<string> samples = sample_map[mapping->_var_name];
-                value_map.insert(pair<string, string>(mapping->_var_name, samples[rand() % samples.size()]));
+        instantiate_query(pool, rand, query);
+        result_array.push_back(query);
+        _instantiationCount++;
+    }
+}
+
+// Appends samples [begin, end) of every mapping that is not dynamic to the pool...
+void query_template_m_t::generate_samples(unsigned int begin, unsigned int end, sample_pool_st &pool) const {
+    pool._samples.resize(_variable_count);
+    for (unsigned i = begin; i < end; i++) {
+        for (unsigned int m = 0; m < _variable_mapping_array.size(); m++) {
+            mapping_m_t *mapping = _variable_mapping_array[m];
+            if (mapping->_distribution_type != DISTRIBUTION_TYPES::DYNAMIC) {
+                pool._samples[_mapping_variables[m]].push_back(pool.intern(mapping->generate(*_mdl, *this)));
             }
         }
+    }
+}
+
+bool query_template_m_t::is_dynamic() const {
+    for (vector<mapping_m_t *>::const_iterator itr = _variable_mapping_array.cbegin();
+         itr != _variable_mapping_array.cend(); itr++) {
+        if ((*itr)->_distribution_type == DISTRIBUTION_TYPES::DYNAMIC) {
+            return true;
+        }
+    }
+    return false;
+}
 
-        /*
-        for (map<string, vector<string> >::iterator itr=sample_map.begin(); itr!=sample_map.end(); itr++){
-            vector<string> samples = itr->second;
-            value_map.insert(pair<string, string>(itr->first, samples[rand()%samples.size()]));
+// Variable values of the query being instantiated, reused by every query of the thread.
+// The values point into the sample pool or into _computed_values, which keeps its strings
+// and their capacity from one query to the next...
+struct query_scratch_st {
+    vector<boost::string_view>  _values;
+    vector<string>              _computed_values;
+};
+static thread_local query_scratch_st QUERY_SCRATCH;
+
+// Writes one query into query. The samples and the optional lines are picked with draw,
+// which returns integers in [0, RAND_MAX]. Dynamic mappings advance their models on the
+// schedule of _instantiationCount, which the caller maintains...
+void query_template_m_t::instantiate_query(const sample_pool_st &pool, int (*draw)(), string &query) {
+    vector<boost::string_view> &values = QUERY_SCRATCH._values;
+    vector<string> &computed_values = QUERY_SCRATCH._computed_values;
+    values.assign(_variable_count, boost::string_view());
+    if (computed_values.size() < _variable_mapping_array.size() + _operation_array.size()) {
+        computed_values.resize(_variable_mapping_array.size() + _operation_array.size());
+    }
+
+    for (unsigned int m = 0; m < _variable_mapping_array.size(); m++) {
+        mapping_m_t *mapping = _variable_mapping_array[m];
+        boost::string_view value;
+        if (mapping->_distribution_type == DISTRIBUTION_TYPES::DYNAMIC) {
+            computed_values[m] = mapping->generate(*_mdl, *this);
+            value = computed_values[m];
+        } else {
+            const vector<unsigned int> &samples = pool._samples[_mapping_variables[m]];
+            value = pool.value(samples[draw() % samples.size()]);
+        }
+        if (_mapping_defines[m]) {
+            values[_mapping_variables[m]] = value;
         }
-        */
+    }
 
-        for (vector<operation_m_t *>::const_iterator itr = _operation_array.cbegin();
-             itr != _operation_array.cend(); itr++) {
-            operation_m_t *operation = *itr;
-            string value = operation->compute(value_map);
-            value_map.insert(pair<string, string>(operation->_target_variable, value));
+    for (unsigned int o = 0; o < _operation_array.size(); o++) {
+        if (_operation_targets[o] >= 0) {
+            string &value = computed_values[_variable_mapping_array.size() + o];
+            _operation_array[o]->compute(values[_operation_sources[o]], value);
+            values[_operation_targets[o]] = value;
         }
-        for (vector<string>::const_iterator itr = _template_lines.cbegin(); itr != _template_lines.cend(); itr++) {
-            string line = *itr;
-            float probability = 1.01;
+    }
 
-            string line_cpy = line;
-            boost::trim(line_cpy);
-            if (line_cpy[0] == '[') {
-                int begin_pos = line.find_first_of("[");
-                int end_pos = line.find_first_of("]");
-                string line_prefix = line.substr(0, begin_pos);
-                string probability_str = line.substr(begin_pos + 1, end_pos - begin_pos - 1);
-                string line_suffix = line.substr(end_pos + 1);
-                probability = boost::lexical_cast<float>(probability_str);
-                line = line_prefix;
-                line.append(line_suffix);
-            }
+    query.clear();
+    for (vector<template_line_st>::const_iterator itr = _compiled_lines.cbegin(); itr != _compiled_lines.cend(); itr++) {
+        /// Now you randomly generate a number, and check if it satisfies the probability.
+        /// If not you do not include this triple pattern in the query...
+        float random_f = ((float) draw()) / ((float) RAND_MAX);
+        if (random_f > itr->_probability) {
+            continue;
+        }
 
-            /// Now you randomly generate a number, and check if it satisfies the probability.
-            /// If not you do not include this triple pattern in the query...
-            float random_f = ((float) rand()) / ((float) RAND_MAX);
-            if (random_f > probability) {
-                continue;
+        // Unknown variables are replaced by an empty string. A line that ends with '.' is
+        // indented, which is decided by its last non-empty fragment before it is written...
+        for (unsigned int j = itr->_fragment_end; j > itr->_fragment_begin; j--) {
+            boost::string_view text = fragment_text(_fragments[j - 1], values);
+            if (!text.empty()) {
+                if (text.back() == '.') {
+                    query.push_back('\t');
+                }
+                break;
             }
+        }
+        for (unsigned int j = itr->_fragment_begin; j < itr->_fragment_end; j++) {
+            boost::string_view text = fragment_text(_fragments[j], values);
+            query.append(text.data(), text.size());
+        }
+        query.append("\n");
+    }
+}
 
-            string modified_line = "";
+boost::string_view query_template_m_t::fragment_text(const template_fragment_st &fragment, const vector<boost::string_view> &values) const {
+    if (fragment._slot < 0) {
+        return fragment._text;
+    }
+    int variable = _slot_variables[fragment._slot];
+    return (variable < 0) ? boost::string_view() : values[variable];
+}
 
-            // FIXME :: You need to implement a much better version of replace_all()...
-            string token;
-            int token_count = 0;
-            stringstream tokenizer(line);
-            while (tokenizer >> token) {
-                token_count++;
-            }
+// Resolves the variables of the mappings, the operations and the slots to indexes, once
+// the whole template is parsed...
+void query_template_m_t::bind_variables() {
+    map<string, int> variables;
+    _mapping_variables.clear();
+    _mapping_defines.clear();
+    for (vector<mapping_m_t *>::const_iterator itr = _variable_mapping_array.cbegin();
+         itr != _variable_mapping_array.cend(); itr++) {
+        int index = variables.size();
+        pair<map<string, int>::iterator, bool> variable = variables.insert(pair<string, int>((*itr)->_var_name, index));
+        _mapping_variables.push_back(variable.first->second);
+        _mapping_defines.push_back(variable.second);
+    }
+    _operation_sources.clear();
+    _operation_targets.clear();
+    for (vector<operation_m_t *>::const_iterator itr = _operation_array.cbegin(); itr != _operation_array.cend(); itr++) {
+        map<string, int>::const_iterator source = variables.find((*itr)->_source_variable);
+        if (source == variables.end()) {
+            cerr << "[query_template_m_t::bind_variables()]\tOperation on an undefined variable " << (*itr)->_source_variable << "..." << "\n";
+            exit(0);
+        }
+        _operation_sources.push_back(source->second);
+        int index = variables.size();
+        _operation_targets.push_back(variables.insert(pair<string, int>((*itr)->_target_variable, index)).second ? index : -1);
+    }
+    _slot_variables.clear();
+    for (vector<string>::const_iterator itr = _slot_names.cbegin(); itr != _slot_names.cend(); itr++) {
+        map<string, int>::const_iterator variable = variables.find(*itr);
+        _slot_variables.push_back((variable == variables.end()) ? -1 : variable->second);
+    }
+    _variable_count = variables.size();
+}
 
-            int counter = 0;
-            stringstream tokenizer2(line);
-            while (tokenizer2 >> token) {
-                if (token.find(":") != string::npos) {
-                    modified_line.append("<");
-                    modified_line.append(_mdl->_namespace_map.replace(token));
-                    modified_line.append(">");
-                } else {
-                    modified_line.append(token);
-                }
-                counter++;
-                if (counter < token_count) {
-                    modified_line.append(" ");
-                }
-            }
+// Compiles a template line the way instantiate() used to rewrite it for every query:
+// the [probability] prefix is cut out, the tokens are joined by single spaces, prefixed
+// names are expanded into <IRI>s, and every %variable% placeholder becomes a slot...
+void query_template_m_t::compile_line(const string &line) {
+    template_line_st compiled;
+    compiled._probability = 1.01;
+    compiled._fragment_begin = _fragments.size();
+
+    string body = line;
+    string line_cpy = line;
+    boost::trim(line_cpy);
+    if (line_cpy[0] == '[') {
+        size_t begin_pos = line.find_first_of("[");
+        size_t end_pos = line.find_first_of("]");
+        compiled._probability = boost::lexical_cast<float>(line.substr(begin_pos + 1, end_pos - begin_pos - 1));
+        body = line.substr(0, begin_pos);
+        body.append(line.substr(end_pos + 1));
+    }
 
-            while (modified_line.find('%', 0) != string::npos) {
-                int begin = modified_line.find('%', 0);
-                int end = modified_line.find('%', begin + 1);
-                string var_name = modified_line.substr(begin + 1, end - begin - 1);
-                modified_line = modified_line.replace(begin, end - begin + 1, value_map[var_name]);
-            }
-            if (modified_line[modified_line.size() - 1] == '.') {
-                query.append("\t");
-            }
-            query.append(modified_line);
-            query.append("\n");
+    string expanded = "";
+    string token;
+    stringstream tokenizer(body);
+    while (tokenizer >> token) {
+        if (!expanded.empty()) {
+            expanded.append(" ");
         }
-        result_array.push_back(query);
-        _instantiationCount++;
+        if (token.find(":") != string::npos) {
+            expanded.append("<");
+            _mdl->_namespace_map.replace(token, expanded);
+            expanded.append(">");
+        } else {
+            expanded.append(token);
+        }
+    }
+
+    // A placeholder without a closing '%' takes the rest of the line...
+    size_t pos = 0;
+    while (pos < expanded.size()) {
+        size_t begin = expanded.find('%', pos);
+        template_fragment_st fragment;
+        fragment._slot = -1;
+        fragment._text = expanded.substr(pos, (begin == string::npos) ? string::npos : begin - pos);
+        if (!fragment._text.empty()) {
+            _fragments.push_back(fragment);
+        }
+        if (begin == string::npos) break;
+        size_t end = expanded.find('%', begin + 1);
+        string var_name = expanded.substr(begin + 1, (end == string::npos) ? string::npos : end - begin - 1);
+        vector<string>::const_iterator slot = find(_slot_names.begin(), _slot_names.end(), var_name);
+        fragment._slot = slot - _slot_names.begin();
+        fragment._text.clear();
+        if (slot == _slot_names.end()) {
+            _slot_names.push_back(var_name);
+        }
+        _fragments.push_back(fragment);
+        pos = (end == string::npos) ? expanded.size() : end + 1;
     }
+
+    compiled._fragment_end = _fragments.size();
+    _compiled_lines.push_back(compiled);
 }
 
 void query_template_m_t::parse(const string filename) {
@@ -1643,6 +2234,7 @@ void query_template_m_t::parse(const string filename) {
         if (fis.good() && !fis.eof()) {
             if (boost::starts_with(line, "#mapping")) {
                 mapping_m_t *mapping = mapping_m_t::parse(line);
+                mapping->compile(_mdl->_namespace_map);
                 _variable_mapping_array.push_back(mapping);
             } else if (boost::starts_with(line, "#operation")) {
                 operation_m_t *operation = operation_m_t::parse(line);
@@ -1652,6 +2244,8 @@ void query_template_m_t::parse(const string filename) {
                 float advance_pr = -1.0;
                 volatility_gen *v_gen = volatility_gen::parse(line, name, advance_pr);
                 if (_volatility_table.find(name) == _volatility_table.end()) {
+                    // Every dynamic model draws from its own stream, so that workloads are reproducible...
+                    v_gen->seed(model::derive_seed(6, counter_rng::hash(name), 0));
                     _volatility_table.insert(pair<string, pair<volatility_gen *, float> >(name,
                                                                                           pair<volatility_gen *, float>(
                                                                                                   v_gen, advance_pr)));
@@ -1660,10 +2254,12 @@ void query_template_m_t::parse(const string filename) {
                 }
             } else {
                 _template_lines.push_back(line);
+                compile_line(line);
             }
         }
     }
     fis.close();
+    bind_variables();
 }
 
 void query_template_m_t::parse_str(const string &content) {
@@ -1672,6 +2268,7 @@ void query_template_m_t::parse_str(const string &content) {
     while (getline(sstream, line, '\n')) {
         if (boost::starts_with(line, "#mapping")) {
             mapping_m_t *mapping = mapping_m_t::parse(line);
+            mapping->compile(_mdl->_namespace_map);
             _variable_mapping_array.push_back(mapping);
         } else if (boost::starts_with(line, "#operation")) {
             operation_m_t *operation = operation_m_t::parse(line);
@@ -1681,6 +2278,8 @@ void query_template_m_t::parse_str(const string &content) {
             float advance_pr = -1.0;
             volatility_gen *v_gen = volatility_gen::parse(line, name, advance_pr);
             if (_volatility_table.find(name) == _volatility_table.end()) {
+                // Every dynamic model draws from its own stream, so that workloads are reproducible...
+                v_gen->seed(model::derive_seed(6, counter_rng::hash(name), 0));
                 _volatility_table.insert(pair<string, pair<volatility_gen *, float> >(name,
                                                                                       pair<volatility_gen *, float>(
                                                                                               v_gen, advance_pr)));
@@ -1689,8 +2288,10 @@ void query_template_m_t::parse_str(const string &content) {
             }
         } else {
             _template_lines.push_back(line);
+            compile_line(line);
         }
     }
+    bind_variables();
 }
 
 model::model(const char *filename) {
@@ -1708,18 +2309,19 @@ model::~model() {
 }
 
 // model::generate() -- generate data
-// resource_m_t -> generate(_namespace_map, _id_cursor_map)
-// association_m_t -> generate(_namespace_map, _type_map, _id_cursor_map)
+// resource_m_t -> generate(_id_cursor_map)
+// association_m_t -> generate(_type_map, _id_cursor_map)
 // resource_m_t -> process_type_restrictions()
 // association_m_t -> process_type_restrictions()
 //
-void model::generate(int scale_factor) {
+void model::generate(int scale_factor, output_sink &sink) {
+    output_buffer out(&sink);
     boost::posix_time::ptime t1(bpt::microsec_clock::universal_time());
     for (int i = 0; i < scale_factor; i++) {
         for (vector<resource_m_t *>::iterator itr2 = _resource_array.begin(); itr2 != _resource_array.end(); itr2++) {
             resource_m_t *resource = *itr2;
             if (i == 0 || resource->_scalable) {
-                resource->generate(_namespace_map, _id_cursor_map);
+                resource->generate(_id_cursor_map, out);
             }
         }
     }
@@ -1729,15 +2331,17 @@ void model::generate(int scale_factor) {
     for (vector<association_m_t *>::iterator itr1 = _association_array.begin();
          itr1 != _association_array.end(); itr1++) {
         association_m_t *association = *itr1;
-        association->generate(_namespace_map, _type_map, _id_cursor_map);
+        association->generate(_type_map, _id_cursor_map, out);
     }
 
 
+    _type_map.build_index();
+
     boost::posix_time::ptime t3(bpt::microsec_clock::universal_time());
 
     for (vector<resource_m_t *>::iterator itr1 = _resource_array.begin(); itr1 != _resource_array.end(); itr1++) {
         resource_m_t *resource = *itr1;
-        resource->process_type_restrictions(_namespace_map, _type_map, _id_cursor_map);
+        resource->process_type_restrictions(_type_map, _id_cursor_map, out);
     }
 
     boost::posix_time::ptime t4(bpt::microsec_clock::universal_time());
@@ -1745,7 +2349,13 @@ void model::generate(int scale_factor) {
     for (vector<association_m_t *>::iterator itr1 = _association_array.begin();
          itr1 != _association_array.end(); itr1++) {
         association_m_t *association = *itr1;
-        association->process_type_restrictions(_namespace_map, _type_map, _id_cursor_map);
+        association->process_type_restrictions(_type_map, _id_cursor_map, out);
+    }
+    out.flush();
+
+    for (vector<association_m_t *>::iterator itr1 = _association_array.begin();
+         itr1 != _association_array.end(); itr1++) {
+        (*itr1)->report_dropped_edges();
     }
 
     boost::posix_time::ptime t5(bpt::microsec_clock::universal_time());
@@ -1756,25 +2366,393 @@ void model::generate(int scale_factor) {
     //cerr << "[t4--t5]" << " " << (t5-t4).total_microseconds() << "\n";
 }
 
-void model::compute_statistics(const vector<triple_st> &triples) {
+// Re-seeds the generators of the calling thread only...
+static void seed_thread_generators(unsigned int seed) {
+    BOOST_NORMAL_DIST_GEN.engine().seed(seed);
+    BOOST_NORMAL_DIST_GEN.distribution().reset();
+    BOOST_UNIFORM_DIST_GEN.engine().seed(seed);
+    BOOST_UNIFORM_DIST_GEN.distribution().reset();
+}
+
+// A shard is an independent unit of generation work. It draws from its own random
+// stream (seeded with _seed) and writes its triples into a private buffer...
+struct shard_st {
+    unsigned int                                                        _seed;
+    function<void(output_buffer &, vector<type_assertion_st> &)>        _task;
+    output_buffer                                                       _output;
+    vector<type_assertion_st>                                           _type_assertions;
+    bool                                                                _done;
+
+    shard_st(unsigned int seed, const function<void(output_buffer &, vector<type_assertion_st> &)> &task) {
+        _seed = seed;
+        _task = task;
+        _done = false;
+    }
+};
+
+// Runs shards on thread_count workers, and writes their output to the sink in shard order.
+// Consecutive shards that are already done are written with a single writev(2).
+// Workers are never more than a few shards ahead of the writer, so memory stays bounded.
+// Since every shard is seeded from its own coordinates, the result does not depend on
+// the number of threads...
+static void run_shards(vector<shard_st *> &shards, unsigned int thread_count, type_map *t_map, output_sink &sink) {
+    mutex shard_mutex;
+    condition_variable work_cond, done_cond;
+    size_t next_shard = 0, written_shards = 0;
+    size_t window_size = thread_count * 4;
+
+    vector<thread> workers;
+    for (unsigned int t = 0; t < thread_count; t++) {
+        workers.push_back(thread([&]() {
+            unique_lock<mutex> lock(shard_mutex);
+            while (true) {
+                work_cond.wait(lock, [&]() {
+                    return next_shard >= shards.size() || next_shard < written_shards + window_size;
+                });
+                if (next_shard >= shards.size()) {
+                    break;
+                }
+                shard_st *shard = shards[next_shard++];
+                lock.unlock();
+                seed_thread_generators(shard->_seed);
+                shard->_task(shard->_output, shard->_type_assertions);
+                lock.lock();
+                shard->_done = true;
+                done_cond.notify_all();
+            }
+        }));
+    }
+
+    size_t first = 0;
+    while (first < shards.size()) {
+        size_t last = first;
+        {
+            unique_lock<mutex> lock(shard_mutex);
+            done_cond.wait(lock, [&]() { return shards[first]->_done; });
+            while (last + 1 < shards.size() && shards[last + 1]->_done) {
+                last++;
+            }
+        }
+        vector<const output_buffer *> buffers;
+        for (size_t i = first; i <= last; i++) {
+            buffers.push_back(&(shards[i]->_output));
+        }
+        sink.write(buffers);
+        for (size_t i = first; i <= last; i++) {
+            shard_st *shard = shards[i];
+            if (t_map != NULL) {
+                for (vector<type_assertion_st>::const_iterator itr = shard->_type_assertions.begin();
+                     itr != shard->_type_assertions.end(); itr++) {
+                    t_map->insert(itr->_prefix_id, itr->_id, itr->_type_id);
+                }
+            }
+            delete shard;
+            shards[i] = NULL;
+        }
+        {
+            unique_lock<mutex> lock(shard_mutex);
+            written_shards = last + 1;
+        }
+        work_cond.notify_all();
+        first = last + 1;
+    }
+
+    for (vector<thread>::iterator itr = workers.begin(); itr != workers.end(); itr++) {
+        itr->join();
+    }
+    shards.clear();
+}
+
+// model::generate(scale_factor, thread_count) -- generate data in parallel
+// Same phases as model::generate(scale_factor), except that the ID range of every
+// resource_m_t and the left-ID range of every association_m_t are split into shards
+// of SHARD_SIZE instances...
+//
+void model::generate(int scale_factor, unsigned int thread_count, output_sink &sink) {
+    thread_count = (thread_count == 0) ? 1 : thread_count;
+    vector<shard_st *> shards;
+
+    for (int i = 0; i < scale_factor; i++) {
+        for (unsigned int r = 0; r < _resource_array.size(); r++) {
+            resource_m_t *resource = _resource_array[r];
+            if (i == 0 || resource->_scalable) {
+                if (_id_cursor_map.find(resource->_type_prefix) == _id_cursor_map.end()) {
+                    _id_cursor_map[resource->_type_prefix] = 0;
+                }
+                unsigned int id_begin = _id_cursor_map[resource->_type_prefix];
+                unsigned int id_end = id_begin + resource->_scaling_coefficient;
+                for (unsigned int begin = id_begin; begin < id_end; begin += SHARD_SIZE) {
+                    unsigned int end = min(id_end, begin + SHARD_SIZE);
+                    shards.push_back(new shard_st(derive_seed(0, r, begin),
+                        [this, resource, begin, end](output_buffer &out, vector<type_assertion_st> &) {
+                            resource->generate(begin, end, out);
+                        }));
+                }
+                _id_cursor_map[resource->_type_prefix] = id_end;
+            }
+        }
+    }
+    run_shards(shards, thread_count, NULL, sink);
+
+    for (unsigned int a = 0; a < _association_array.size(); a++) {
+        association_m_t *association = _association_array[a];
+        association->check_types(_id_cursor_map);
+        if (association->_post_process) {
+            continue;
+        }
+        if (association->is_type_assertion()) {
+            association->intern_object_types(_type_map, _id_cursor_map.find(association->_object_type)->second);
+        }
+        unsigned int left_count = _id_cursor_map.find(association->_subject_type)->second;
+        unsigned int shard_size = association->is_shardable() ? SHARD_SIZE : max(left_count, 1u);
+        for (unsigned int begin = 0; begin < left_count; begin += shard_size) {
+            unsigned int end = min(left_count, begin + shard_size);
+            shards.push_back(new shard_st(derive_seed(1, a, begin),
+                [this, association, begin, end](output_buffer &out, vector<type_assertion_st> &type_assertions) {
+                    association->generate(_id_cursor_map, begin, end, out, type_assertions);
+                }));
+        }
+    }
+    run_shards(shards, thread_count, &_type_map, sink);
+    _type_map.build_index();
+
+    for (unsigned int r = 0; r < _resource_array.size(); r++) {
+        resource_m_t *resource = _resource_array[r];
+        unsigned int id_count = _id_cursor_map.find(resource->_type_prefix)->second;
+        for (unsigned int begin = 0; begin < id_count; begin += SHARD_SIZE) {
+            unsigned int end = min(id_count, begin + SHARD_SIZE);
+            shards.push_back(new shard_st(derive_seed(2, r, begin),
+                [this, resource, begin, end](output_buffer &out, vector<type_assertion_st> &) {
+                    resource->process_type_restrictions(_type_map, begin, end, out);
+                }));
+        }
+    }
+    run_shards(shards, thread_count, NULL, sink);
+
+    vector<vector<unsigned int> *> all_right_id_lists;
+    for (unsigned int a = 0; a < _association_array.size(); a++) {
+        association_m_t *association = _association_array[a];
+        if (!association->_post_process) {
+            continue;
+        }
+        vector<unsigned int> *all_right_ids = new vector<unsigned int>();
+        all_right_id_lists.push_back(all_right_ids);
+        const vector<unsigned int> *restricted_right_ids = association->get_restricted_right_ids(
+                _type_map, _id_cursor_map, *all_right_ids);
+        if (restricted_right_ids == NULL) {
+            continue;
+        }
+        unsigned int left_count = _id_cursor_map.find(association->_subject_type)->second;
+        unsigned int shard_size = association->is_shardable() ? SHARD_SIZE : max(left_count, 1u);
+        for (unsigned int begin = 0; begin < left_count; begin += shard_size) {
+            unsigned int end = min(left_count, begin + shard_size);
+            shards.push_back(new shard_st(derive_seed(3, a, begin),
+                [this, association, begin, end, restricted_right_ids](
+                        output_buffer &out, vector<type_assertion_st> &) {
+                    association->process_type_restrictions(_type_map, begin, end,
+                                                           *restricted_right_ids, out);
+                }));
+        }
+    }
+    run_shards(shards, thread_count, NULL, sink);
+    for (vector<vector<unsigned int> *>::iterator itr = all_right_id_lists.begin();
+         itr != all_right_id_lists.end(); itr++) {
+        delete *itr;
+    }
+    for (unsigned int a = 0; a < _association_array.size(); a++) {
+        _association_array[a]->report_dropped_edges();
+    }
+}
+
+// Draws from the uniform generator of the calling thread, in the range of rand()...
+static int thread_rand() {
+    return BOOST_UNIFORM_DIST_GEN();
+}
+
+// Draws the samples and the queries from the random streams of the batches of the
+// parallel instantiate() below, so the workload is the same as with -j...
+bool query_template_m_t::instantiate(unsigned int template_index, unsigned int query_count, unsigned int recurrence,
+                                     workload_writer &writer) {
+    sample_pool_st pool;
+    unsigned int sample_count = (int) ((float) query_count / (float) recurrence) + 1;
+    for (unsigned int begin = 0; begin < sample_count; begin += QUERY_BATCH_SIZE) {
+        seed_thread_generators(model::derive_seed(4, template_index, begin));
+        generate_samples(begin, min(begin + QUERY_BATCH_SIZE, sample_count), pool);
+    }
+
+    string query;
+    for (unsigned i = 0; i < query_count; i++) {
+        if (i % QUERY_BATCH_SIZE == 0) {
+            seed_thread_generators(model::derive_seed(5, template_index, i));
+        }
+        instantiate_query(pool, thread_rand, query);
+        if (!writer.write(query)) {
+            return false;
+        }
+        _instantiationCount++;
+    }
+    return true;
+}
+
+// query_template_m_t::instantiate(templates, ...) -- instantiate a workload in parallel
+// The samples and the queries of every template are split into batches of
+// QUERY_BATCH_SIZE, and every batch draws from its own random stream (see
+// model::derive_seed()), so the workload does not depend on the number of threads.
+// Dynamic mappings advance their models on the schedule of _instantiationCount, so the
+// batches of a template with dynamic mappings take turns, in order...
+//
+void query_template_m_t::instantiate(const vector<query_template_m_t *> &templates, unsigned int query_count,
+                                     unsigned int recurrence, unsigned int thread_count, output_sink &sink) {
+    thread_count = (thread_count == 0) ? 1 : thread_count;
+    unsigned int sample_count = (int) ((float) query_count / (float) recurrence) + 1;
+
+    // (template, first sample) of every sample batch. The batches of a template are
+    // concatenated in order once they are all drawn...
+    vector<pair<unsigned int, unsigned int> > sample_batches;
+    for (unsigned int t = 0; t < templates.size(); t++) {
+        for (unsigned int begin = 0; begin < sample_count; begin += QUERY_BATCH_SIZE) {
+            sample_batches.push_back(pair<unsigned int, unsigned int>(t, begin));
+        }
+    }
+    vector<sample_pool_st> batch_pools (sample_batches.size());
+    atomic<size_t> next_batch (0);
+    vector<thread> workers;
+    for (unsigned int w = 0; w < thread_count; w++) {
+        workers.push_back(thread([&]() {
+            for (size_t b = next_batch++; b < sample_batches.size(); b = next_batch++) {
+                unsigned int t = sample_batches[b].first, begin = sample_batches[b].second;
+                seed_thread_generators(model::derive_seed(4, t, begin));
+                templates[t]->generate_samples(begin, min(begin + QUERY_BATCH_SIZE, sample_count), batch_pools[b]);
+            }
+        }));
+    }
+    for (vector<thread>::iterator itr = workers.begin(); itr != workers.end(); itr++) {
+        itr->join();
+    }
+    vector<sample_pool_st> pools (templates.size());
+    for (size_t b = 0; b < sample_batches.size(); b++) {
+        pools[sample_batches[b].first].append(batch_pools[b]);
+        batch_pools[b] = sample_pool_st();
+    }
+
+    struct turn_st {
+        mutex               _mutex;
+        condition_variable  _cond;
+        unsigned int        _next;
+    };
+    vector<turn_st> turns (templates.size());
+    vector<int> base_counts;
+    vector<shard_st *> shards;
+    for (unsigned int t = 0; t < templates.size(); t++) {
+        query_template_m_t *q_template = templates[t];
+        const sample_pool_st *pool = &pools[t];
+        turn_st *turn = q_template->is_dynamic() ? &turns[t] : NULL;
+        int base_count = q_template->_instantiationCount;
+        base_counts.push_back(base_count);
+        turns[t]._next = 0;
+        for (unsigned int begin = 0, batch = 0; begin < query_count; begin += QUERY_BATCH_SIZE, batch++) {
+            unsigned int end = min(begin + QUERY_BATCH_SIZE, query_count);
+            shards.push_back(new shard_st(model::derive_seed(5, t, begin), [=](output_buffer &out, vector<type_assertion_st> &) {
+                if (turn != NULL) {
+                    unique_lock<mutex> lock(turn->_mutex);
+                    turn->_cond.wait(lock, [&]() { return turn->_next == batch; });
+                }
+                string query;
+                for (unsigned int i = begin; i < end; i++) {
+                    if (turn != NULL) {
+                        q_template->_instantiationCount = base_count + i;
+                    }
+                    q_template->instantiate_query(*pool, thread_rand, query);
+                    out.append(query);
+                }
+                if (turn != NULL) {
+                    lock_guard<mutex> lock(turn->_mutex);
+                    turn->_next++;
+                    turn->_cond.notify_all();
+                }
+            }));
+        }
+    }
+    // Batches are started in order, so a batch that waits for its turn never waits for
+    // one that has not started yet...
+    run_shards(shards, thread_count, NULL, sink);
+    for (unsigned int t = 0; t < templates.size(); t++) {
+        templates[t]->_instantiationCount = base_counts[t] + query_count;
+    }
+}
+
+// Single pass over the triples: a table from predicate IRIs to the statistics of the
+// predicate dispatches every triple, and each thread collects its chunk into partial
+// histograms of its own, which are merged once all threads are done...
+void model::compute_statistics(const vector<triple_view_st> &triples, const char *filename, unsigned int thread_count) {
     vector<statistics_m_t *> statistics_array;
     for (vector<string>::iterator itr = _statistics_lines.begin(); itr != _statistics_lines.end(); itr++) {
         statistics_m_t *statistics = statistics_m_t::parse(this, *itr);
         statistics_array.push_back(statistics);
     }
-    if (!statistics_array.empty()) {
-        for (vector<triple_st>::const_iterator itr1 = triples.begin(); itr1 != triples.end(); itr1++) {
-            for (vector<statistics_m_t *>::iterator itr2 = statistics_array.begin();
-                 itr2 != statistics_array.end(); itr2++) {
-                statistics_m_t *statistics = *itr2;
-                statistics->collect(this, itr1->_subject, itr1->_predicate, itr1->_object);
+    if (statistics_array.empty()) {
+        return;
+    }
+    unordered_map<boost::string_view, vector<unsigned int>, boost::hash<boost::string_view> > dispatch_table;
+    for (unsigned int i = 0; i < statistics_array.size(); i++) {
+        dispatch_table[boost::string_view(statistics_array[i]->_predicate_iri)].push_back(i);
+    }
+
+    if (thread_count == 0) {
+        thread_count = thread::hardware_concurrency();
+    }
+    size_t chunk_count = max((size_t) 1, min((size_t) max(thread_count, 1u), triples.size() / MIN_STATISTICS_CHUNK));
+    // Partial histograms are allocated on the first triple of their statistics...
+    vector<vector<vector<int> > > left_partials (chunk_count, vector<vector<int> >(statistics_array.size()));
+    vector<vector<vector<int> > > right_partials (chunk_count, vector<vector<int> >(statistics_array.size()));
+    vector<thread> workers;
+    for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+        workers.push_back(thread([&, chunk]() {
+            size_t begin = (triples.size() * chunk) / chunk_count, end = (triples.size() * (chunk + 1)) / chunk_count;
+            for (size_t i = begin; i < end; i++) {
+                unordered_map<boost::string_view, vector<unsigned int>, boost::hash<boost::string_view> >::const_iterator f_it =
+                        dispatch_table.find(triples[i].predicate());
+                if (f_it == dispatch_table.end()) {
+                    continue;
+                }
+                for (vector<unsigned int>::const_iterator itr = f_it->second.begin(); itr != f_it->second.end(); itr++) {
+                    const statistics_m_t *statistics = statistics_array[*itr];
+                    vector<int> &left = left_partials[chunk][*itr];
+                    vector<int> &right = right_partials[chunk][*itr];
+                    // One spare entry keeps the partials of empty types from looking unallocated...
+                    if (left.empty()) {
+                        left.assign(statistics->_left_count + 1, 0);
+                        right.assign(statistics->_right_count + 1, 0);
+                    }
+                    statistics->collect(this, triples[i], left.data(), right.data());
+                }
+            }
+        }));
+    }
+    for (vector<thread>::iterator itr = workers.begin(); itr != workers.end(); itr++) {
+        itr->join();
+    }
+
+    vector<statistics_record_st> records (statistics_array.size());
+    for (unsigned int i = 0; i < statistics_array.size(); i++) {
+        statistics_m_t *statistics = statistics_array[i];
+        for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+            if (!left_partials[chunk][i].empty()) {
+                statistics->merge(left_partials[chunk][i].data(), right_partials[chunk][i].data());
+                vector<int>().swap(left_partials[chunk][i]);
+                vector<int>().swap(right_partials[chunk][i]);
             }
         }
-        for (vector<statistics_m_t *>::iterator itr = statistics_array.begin(); itr != statistics_array.end(); itr++) {
-            statistics_m_t *statistics = *itr;
-            statistics->report();
-            delete statistics;
-        }
+        statistics->summarize(records[i]);
+        // The reports go to cerr, so that the workload can be piped from stdout...
+        statistics_file::report(records[i], cerr);
+    }
+    // The histograms are kept, so that later runs can load them instead of the triples...
+    if (filename != NULL) {
+        statistics_file::write(filename, records);
+    }
+    for (vector<statistics_m_t *>::iterator itr = statistics_array.begin(); itr != statistics_array.end(); itr++) {
+        delete *itr;
     }
 }
 
@@ -1833,6 +2811,50 @@ void model::parse(const char *filename) {
         _resource_array.push_back((resource_m_t *) object_stack.top().second);
         object_stack.pop();
     }
+    compile();
+}
+
+// Expands the namespace prefixes of all resources and associations once, after parsing...
+void model::compile() {
+    for (vector<resource_m_t *>::iterator itr = _resource_array.begin(); itr != _resource_array.end(); itr++) {
+        (*itr)->compile(_namespace_map, _type_map);
+    }
+    for (vector<association_m_t *>::iterator itr = _association_array.begin(); itr != _association_array.end(); itr++) {
+        (*itr)->compile(_namespace_map, _type_map);
+    }
+}
+
+void model::seed_random(unsigned int seed) {
+    RAND_SEED = seed;
+    seed_thread_generators(seed);
+}
+
+// Positions the generators of the calling thread on the random stream of the given
+// coordinate. Whatever is drawn afterwards only depends on (seed, type, id, predicate)...
+void model::seek_random(const string &type_prefix, unsigned int id, const string &predicate) {
+    seek_random(counter_rng::hash(type_prefix), id, counter_rng::hash(predicate));
+}
+
+void model::seek_random(unsigned int type_key, unsigned int id, unsigned int predicate_key) {
+    BOOST_NORMAL_DIST_GEN.engine().seek(RAND_SEED, type_key, id, predicate_key);
+    BOOST_NORMAL_DIST_GEN.distribution().reset();
+    BOOST_UNIFORM_DIST_GEN.engine().seek(RAND_SEED, type_key, id, predicate_key);
+    BOOST_UNIFORM_DIST_GEN.distribution().reset();
+}
+
+// Derives the seed of a shard from the global seed and the shard's coordinates
+// (generation phase, index of the resource/association, first ID in the shard)...
+unsigned int model::derive_seed(unsigned int phase, unsigned int index, unsigned int offset) {
+    uint64_t state = RAND_SEED;
+    uint64_t coordinates[3] = {phase, index, offset};
+    for (int i = 0; i < 3; i++) {
+        // splitmix64 finalizer...
+        state += 0x9E3779B97F4A7C15ULL + coordinates[i];
+        state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        state = (state ^ (state >> 27)) * 0x94D049BB133111EBULL;
+        state = state ^ (state >> 31);
+    }
+    return (unsigned int) (state ^ (state >> 32));
 }
 
 string model::generate_literal(LITERAL_TYPES::enum_t literal_type, DISTRIBUTION_TYPES::enum_t distribution_type,
@@ -1934,41 +2956,16 @@ double model::generate_random(DISTRIBUTION_TYPES::enum_t distribution_type, int
     return result;
 }
 
+// Draws a rank from the shared sampler of item_count, and scales it to [0, 1)...
 double model::generate_zipfian(int item_count) {
-    vector<double> *intervals = NULL;
-
-    if (zipfian_cache.find(item_count) == zipfian_cache.end()) {
-        intervals = new vector<double>();
-        double offset = 0.0;
-        for (int i = 1; i <= item_count; i++) {
-            offset += 1.0 / ((double) (i));
-            intervals->push_back(offset);
-        }
-        double scale_factor = 1.0 / offset;
-        for (int cursor = 0; cursor < item_count; cursor++) {
-            (*intervals)[cursor] = (*intervals)[cursor] * scale_factor;
-        }
-        zipfian_cache.insert(pair<int, vector<double> *>(item_count, intervals));
-    } else {
-        intervals = zipfian_cache[item_count];
+    if (item_count <= 0) {
+        return 0.0;
     }
-
-    double random_value = ((double) BOOST_UNIFORM_DIST_GEN()) / ((double) RAND_MAX);
-//    double random_value = ((double) rand()) / ((double) RAND_MAX);
-    vector<double>::iterator pivot = lower_bound(intervals->begin(), intervals->end(), random_value);
-    double result = (pivot - intervals->begin()) * (1.0 / ((double) item_count));
+    const zipf_sampler *sampler = zipf_sampler::get(item_count);
+    double result = sampler->draw(BOOST_UNIFORM_DIST_GEN) * (1.0 / ((double) item_count));
     return result;
 }
 
-void model::clear_zipfian_cache() {
-    for (map<int, vector<double> *>::iterator itr = zipfian_cache.begin(); itr != zipfian_cache.end(); itr++) {
-        vector<double> *value = itr->second;
-        delete value;
-        itr->second = NULL;
-    }
-    zipfian_cache.clear();
-}
-
 void statistics_m_t::init(const model *mdl, const string &predicate, const string &subject_type,
                           const string &object_type) {
     _predicate = predicate;
@@ -1977,6 +2974,14 @@ void statistics_m_t::init(const model *mdl, const string &predicate, const strin
     _subject_type_restriction = NULL;
     _object_type_restriction = NULL;
 
+    _predicate_iri = mdl->_namespace_map.replace(predicate);
+    _subject_type_iri = mdl->_namespace_map.replace(subject_type);
+    _object_type_iri = mdl->_namespace_map.replace(object_type);
+    _subject_prefix_id = mdl->_type_map.prefix_id(_subject_type_iri);
+    _object_prefix_id = mdl->_type_map.prefix_id(_object_type_iri);
+    _subject_type_restriction_id = -1;
+    _object_type_restriction_id = -1;
+
     _left_count = mdl->_id_cursor_map.find(subject_type)->second;
     _left_statistics = new int[_left_count];
     for (unsigned int i = 0; i < _left_count; i++) {
@@ -2000,9 +3005,11 @@ statistics_m_t::statistics_m_t(const model *mdl, const string &predicate, const
     init(mdl, predicate, subject_type, object_type);
     if (subject_type_restriction != NULL) {
         _subject_type_restriction = new string(*subject_type_restriction);
+        _subject_type_restriction_id = mdl->_type_map.type_id(mdl->_namespace_map.replace(*subject_type_restriction));
     }
     if (object_type_restriction != NULL) {
         _object_type_restriction = new string(*object_type_restriction);
+        _object_type_restriction_id = mdl->_type_map.type_id(mdl->_namespace_map.replace(*object_type_restriction));
     }
 }
 
@@ -2020,6 +3027,13 @@ statistics_m_t::statistics_m_t(const statistics_m_t &rhs) {
     } else {
         _object_type_restriction = NULL;
     }
+    _predicate_iri = rhs._predicate_iri;
+    _subject_type_iri = rhs._subject_type_iri;
+    _object_type_iri = rhs._object_type_iri;
+    _subject_prefix_id = rhs._subject_prefix_id;
+    _object_prefix_id = rhs._object_prefix_id;
+    _subject_type_restriction_id = rhs._subject_type_restriction_id;
+    _object_type_restriction_id = rhs._object_type_restriction_id;
     _left_count = rhs._left_count;
     _left_statistics = new int[_left_count];
     for (unsigned int i = 0; i < _left_count; i++) {
@@ -2039,132 +3053,86 @@ statistics_m_t::~statistics_m_t() {
     delete[] _right_statistics;
 }
 
-void statistics_m_t::collect(const model *mdl, const string &subject, const string &predicate, const string &object) {
-    string p_uri = "";
-    p_uri.append("<");
-    p_uri.append(mdl->_namespace_map.replace(_predicate));
-    p_uri.append(">");
-    if (p_uri.compare(predicate) == 0) {
-        string s_prefix = "", o_prefix = "";
-        s_prefix.append("<");
-        s_prefix.append(mdl->_namespace_map.replace(_subject_type));
-        o_prefix.append("<");
-        o_prefix.append(mdl->_namespace_map.replace(_object_type));
-        if (boost::starts_with(subject, s_prefix) && boost::starts_with(object, o_prefix)) {
-            // FIXME::Also check for type restrictions if they exist...
-            string s_instance = subject.substr(1, subject.size() - 2);
-            string o_instance = object.substr(1, object.size() - 2);
-            unsigned int s_id = boost::lexical_cast<unsigned int>(
-                    subject.substr(s_prefix.size(), (subject.size() - s_prefix.size() - 1)));
-            unsigned int o_id = boost::lexical_cast<unsigned int>(
-                    object.substr(o_prefix.size(), (object.size() - o_prefix.size() - 1)));
-            if ((_subject_type_restriction == NULL ||
-                 mdl->_type_map.instanceof(s_instance, mdl->_namespace_map.replace(*_subject_type_restriction))) &&
-                (_object_type_restriction == NULL ||
-                 mdl->_type_map.instanceof(o_instance, mdl->_namespace_map.replace(*_object_type_restriction)))) {
-                _left_statistics[s_id] = _left_statistics[s_id] + 1;
-                _right_statistics[o_id] = _right_statistics[o_id] + 1;
-            } else {
-                if (!(_subject_type_restriction == NULL ||
-                      mdl->_type_map.instanceof(s_instance, mdl->_namespace_map.replace(*_subject_type_restriction)))) {
-                    _left_statistics[s_id] = -1;
-                }
-                if (!(_object_type_restriction == NULL ||
-                      mdl->_type_map.instanceof(o_instance, mdl->_namespace_map.replace(*_object_type_restriction)))) {
-                    _right_statistics[o_id] = -1;
-                }
-            }
+// Parses the ID of <prefix><id> the way type_map::split does, so that the ID can be
+// looked up in the type_map...
+static bool extract_id(boost::string_view instance, const string &prefix, unsigned int &id) {
+    if (instance.size() <= prefix.size() || instance.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    size_t digits = instance.size() - prefix.size();
+    const char *cursor = instance.data() + prefix.size();
+    if (digits > 9 || (digits > 1 && *cursor == '0')) {
+        return false;
+    }
+    id = 0;
+    for (size_t i = 0; i < digits; i++) {
+        if (cursor[i] < '0' || cursor[i] > '9') {
+            return false;
         }
+        id = id * 10 + (cursor[i] - '0');
     }
+    return true;
 }
 
-void statistics_m_t::report() const {
-    float left_cover = 0.0;
-    unsigned int left_actual_count = 0;
-    unsigned int left_min = numeric_limits<unsigned int>::max();
-    unsigned int left_max = numeric_limits<unsigned int>::min();
-    float left_mean = 0.0;
-    vector<unsigned int> left_distribution;
-
-    for (unsigned int i = 0; i < _left_count; i++) {
-        if (_left_statistics[i] > 0) {
-            left_cover += 1.0;
-            if (_left_statistics[i] < left_min) {
-                left_min = _left_statistics[i];
-            }
-            if (_left_statistics[i] > left_max) {
-                left_max = _left_statistics[i];
-            }
-            left_mean += _left_statistics[i];
-            left_distribution.push_back(_left_statistics[i]);
-        }
-        if (_left_statistics[i] >= 0) {
-            ++left_actual_count;
-        }
+// An instance that violates its restriction does so in every triple, so it never
+// gets counted in any partial histogram...
+void statistics_m_t::collect(const model *mdl, const triple_view_st &triple, int *left_statistics,
+                             int *right_statistics) const {
+    unsigned int s_id = 0, o_id = 0;
+    if (!extract_id(triple.subject(), _subject_type_iri, s_id) || !extract_id(triple.object(), _object_type_iri, o_id) ||
+        s_id >= _left_count || o_id >= _right_count) {
+        return;
     }
-    left_mean = left_mean / left_cover;
-    left_cover = left_cover / ((float) left_actual_count);
-    sort(left_distribution.begin(), left_distribution.end());
-
-    float right_cover = 0.0;
-    unsigned int right_actual_count = 0;
-    unsigned int right_min = numeric_limits<unsigned int>::max();
-    unsigned int right_max = numeric_limits<unsigned int>::min();
-    float right_mean = 0.0;
-    vector<unsigned int> right_distribution;
-
-    for (unsigned int i = 0; i < _right_count; i++) {
-        if (_right_statistics[i] > 0) {
-            right_cover += 1.0;
-            if (_right_statistics[i] < right_min) {
-                right_min = _right_statistics[i];
-            }
-            if (_right_statistics[i] > right_max) {
-                right_max = _right_statistics[i];
-            }
-            right_mean += _right_statistics[i];
-            right_distribution.push_back(_right_statistics[i]);
+    bool s_valid = _subject_type_restriction == NULL ||
+                   (_subject_prefix_id >= 0 && _subject_type_restriction_id >= 0 &&
+                    mdl->_type_map.instanceof(_subject_prefix_id, s_id, _subject_type_restriction_id));
+    bool o_valid = _object_type_restriction == NULL ||
+                   (_object_prefix_id >= 0 && _object_type_restriction_id >= 0 &&
+                    mdl->_type_map.instanceof(_object_prefix_id, o_id, _object_type_restriction_id));
+    if (s_valid && o_valid) {
+        left_statistics[s_id]++;
+        right_statistics[o_id]++;
+    } else {
+        if (!s_valid) {
+            left_statistics[s_id] = -1;
         }
-        if (_right_statistics[i] >= 0) {
-            ++right_actual_count;
+        if (!o_valid) {
+            right_statistics[o_id] = -1;
         }
     }
-    right_mean = right_mean / right_cover;
-    right_cover = right_cover / ((float) right_actual_count);
-    sort(right_distribution.begin(), right_distribution.end());
+}
 
-    cout << "Printing statistics..." << "\n";
-    cout << "\tPredicate:           " << _predicate << "\n";
-    cout << "\tSubject-type:        " << _subject_type << "\n";
-    cout << "\tObject-type:         " << _object_type << "\n";
-    if (_subject_type_restriction != NULL) {
-        cout << "\tSubject-restriction: " << *_subject_type_restriction << "\n";
+void statistics_m_t::merge(const int *left_statistics, const int *right_statistics) {
+    for (unsigned int i = 0; i < _left_count; i++) {
+        if (left_statistics[i] < 0 || _left_statistics[i] < 0) {
+            _left_statistics[i] = min(left_statistics[i], _left_statistics[i]);
+        } else {
+            _left_statistics[i] += left_statistics[i];
+        }
     }
-    if (_object_type_restriction != NULL) {
-        cout << "\tObject-restriction: " << *_object_type_restriction << "\n";
+    for (unsigned int i = 0; i < _right_count; i++) {
+        if (right_statistics[i] < 0 || _right_statistics[i] < 0) {
+            _right_statistics[i] = min(right_statistics[i], _right_statistics[i]);
+        } else {
+            _right_statistics[i] += right_statistics[i];
+        }
     }
+}
 
-    cout << "\t\tSubject-statistics..." << "\n";
-    cout << "\t\t\tCover:        " << left_cover << "\n";
-    cout << "\t\t\tRange:        " << "[" << left_min << "-" << left_max << "]" << "\n";
-    cout << "\t\t\tMean:         " << left_mean << "\n";
-    cout << "\t\t\tDistribution: ";
-    for (vector<unsigned int>::reverse_iterator itr = left_distribution.rbegin();
-         itr != left_distribution.rend(); itr++) {
-        cout << *itr << " ";
-    }
-    cout << "\n";
+void statistics_m_t::summarize(statistics_record_st &record) const {
+    record._predicate = _predicate;
+    record._subject_type = _subject_type;
+    record._object_type = _object_type;
+    record._subject_type_restriction = _subject_type_restriction;
+    record._object_type_restriction = _object_type_restriction;
+    degree_summary_st::summarize(_left_statistics, _left_count, record._left, record._left_histogram);
+    degree_summary_st::summarize(_right_statistics, _right_count, record._right, record._right_histogram);
+}
 
-    cout << "\t\tObject-statistics..." << "\n";
-    cout << "\t\t\tCover:        " << right_cover << "\n";
-    cout << "\t\t\tRange:        " << "[" << right_min << "-" << right_max << "]" << "\n";
-    cout << "\t\t\tMean:         " << right_mean << "\n";
-    cout << "\t\t\tDistribution: ";
-    for (vector<unsigned int>::reverse_iterator itr = right_distribution.rbegin();
-         itr != right_distribution.rend(); itr++) {
-        cout << *itr << " ";
-    }
-    cout << "\n";
+void statistics_m_t::report() const {
+    statistics_record_st record;
+    summarize(record);
+    statistics_file::report(record, cerr);
 }
 
 statistics_m_t *statistics_m_t::parse(const model *mdl, const string &line) {
@@ -2267,6 +3235,7 @@ void model::load(const char *filename) {
             _type_map.insert(token, type);
         }
     }
+    _type_map.build_index();
 
     // You do not need to load namespaces...
     // They come automatically from the model file...
@@ -2323,10 +3292,6 @@ void model::save(const char *filename) const {
 
 void model::generate_stream_data(int static_scale_factor, int stream_scale_factor) {
     boost::posix_time::ptime t1(bpt::microsec_clock::universal_time());
-    ofstream fos_assoc("1_assoc_stream.txt");
-    ofstream fos_review("1_review_stream.txt");
-    ofstream fos_purchase("1_purchase_stream.txt");
-    ofstream fos_offer("1_offer_stream.txt");
     for (vector<resource_m_t *>::iterator itr1 = _resource_array.begin(); itr1 != _resource_array.end(); itr1++) {
         resource_m_t *resource = *itr1;
         int loop = 1;
@@ -2338,7 +3303,7 @@ void model::generate_stream_data(int static_scale_factor, int stream_scale_facto
         }
         for (int i = 0; i < loop; i++) {
             if (i == 0 || resource->_scalable) {
-                resource->generate_stream_data(_namespace_map, _id_cursor_map, fos_review, fos_purchase, fos_offer);
+                resource->generate_stream_data(_id_cursor_map);
             }
         }
     }
@@ -2354,15 +3319,20 @@ void model::generate_stream_data(int static_scale_factor, int stream_scale_facto
             loop = stream_scale_factor;
         }
         for (int i = 0; i < loop; i++) {
-            association->generate_stream_data(_namespace_map, _type_map, _id_cursor_map, fos_assoc);
+            association->generate_stream_data(_type_map, _id_cursor_map);
         }
     }
 
+    _type_map.build_index();
+
     boost::posix_time::ptime t3(bpt::microsec_clock::universal_time());
 
+    // This mode writes through cout, so the type restrictions are collected in a detached buffer...
     for (vector<resource_m_t *>::iterator itr1 = _resource_array.begin(); itr1 != _resource_array.end(); itr1++) {
         resource_m_t *resource = *itr1;
-        resource->process_type_restrictions(_namespace_map, _type_map, _id_cursor_map);
+        output_buffer out;
+        resource->process_type_restrictions(_type_map, _id_cursor_map, out);
+        cout.write(out.data(), out.size());
     }
 
     boost::posix_time::ptime t4(bpt::microsec_clock::universal_time());
@@ -2375,16 +3345,13 @@ void model::generate_stream_data(int static_scale_factor, int stream_scale_facto
             loop = stream_scale_factor;
         }
         for (int i = 0; i < loop; i++) {
-            association->process_stream_type_restrictions(_namespace_map, _type_map, _id_cursor_map, fos_assoc);
+            association->process_stream_type_restrictions(_type_map, _id_cursor_map);
         }
+        association->report_dropped_edges();
     }
 
     boost::posix_time::ptime t5(bpt::microsec_clock::universal_time());
 
-    fos_review.close();
-    fos_purchase.close();
-    fos_assoc.close();
-
     //cerr << "[t1--t2]" << " " << (t2-t1).total_microseconds() << "\n";
     //cerr << "[t2--t3]" << " " << (t3-t2).total_microseconds() << "\n";
     //cerr << "[t3--t4]" << " " << (t4-t3).total_microseconds() << "\n";
@@ -2392,71 +3359,83 @@ void model::generate_stream_data(int static_scale_factor, int stream_scale_facto
 }
 
 
-void resource_m_t::generate_stream_data(const namespace_map &n_map, map<string, unsigned int> &id_cursor_map,
-                                        ofstream &fos_review, ofstream &fos_purchase, ofstream &fos_offer) {
+void resource_m_t::generate_stream_data(map<string, unsigned int> &id_cursor_map) {
     if (id_cursor_map.find(_type_prefix) == id_cursor_map.end()) {
         id_cursor_map[_type_prefix] = 0;
     }
 
     //boost::random::mt19937 gen(static_cast<unsigned> (time(0)));
 
+    // Reviews, purchases and offers are kept for the stream writers, everything else goes to cout...
+    vector<stream_entity_st> *entities = NULL;
+    if (_type_prefix == "wsdbm:Review") {
+        entities = &reviewEntities;
+    } else if (_type_prefix == "wsdbm:Purchase") {
+        entities = &purchaseEntities;
+    } else if (_type_prefix == "wsdbm:Offer") {
+        entities = &offerEntities;
+    }
+
+    unsigned int type_key = counter_rng::hash(_type_prefix);
+    output_buffer out;
+    string subject, record;
     for (unsigned int id = id_cursor_map[_type_prefix];
          id < (id_cursor_map[_type_prefix] + _scaling_coefficient); id++) {
-        string subject = "";
-        subject.append("<");
-        subject.append(n_map.replace(_type_prefix));
-        subject.append(boost::lexical_cast<string>(id));
-        subject.append(">");
-
-        for (vector<predicate_group_m_t *>::const_iterator itr2 = _predicate_group_array.begin();
-             itr2 != _predicate_group_array.end(); itr2++) {
-            predicate_group_m_t *predicate_group = *itr2;
+        assign_iri(subject, _type_iri, id);
+        if (entities != NULL) {
+            entities->push_back(stream_entity_st());
+            entities->back()._subject = subject;
+        }
+
+        for (unsigned int group_id = 0; group_id < _predicate_group_array.size(); group_id++) {
+            predicate_group_m_t *predicate_group = _predicate_group_array[group_id];
             if (!predicate_group->_post_process) {
+                model::seek_random(type_key, id, group_id);
                 float draw = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
 //                float draw = ((float) rand())/((float)RAND_MAX);
                 if (draw <= predicate_group->_gen_probability) {
                     for (vector<predicate_m_t *>::const_iterator itr3 = predicate_group->_predicate_array.begin();
                          itr3 != predicate_group->_predicate_array.end(); itr3++) {
                         predicate_m_t *predicate = *itr3;
-                        string triple_str = "";
-                        triple_str.append(subject);
-                        triple_str.append("\t");
-                        triple_str.append(predicate->generate(n_map));
-
-                        int tab1_index = triple_str.find("\t");
-                        int tab2_index = triple_str.find("\t", tab1_index + 1);
-
-                        triple_st line(triple_str.substr(0, tab1_index),
-                                       triple_str.substr((tab1_index + 1), (tab2_index - tab1_index - 1)),
-                                       triple_str.substr(tab2_index + 1));
-                        if (_type_prefix == "wsdbm:Review") {
-                            fos_review << line << "\n";
-                        } else if (_type_prefix == "wsdbm:Purchase") {
-                            if (purchaseTime.find(subject) == purchaseTime.end())
-                                purchaseTime[subject] = BOOST_UNIFORM_DIST_GEN();
-                            fos_purchase << line << "\n";
-                        } else if (_type_prefix == "wsdbm:Offer") {
-                            fos_offer << line << "\n";
-                        } else {
-                            cout << line << " .\n";
+                        // "<predicate>\tobject"...
+                        string predicate_object = predicate->generate(type_key, id, group_id * 0x9E3779B9u);
+                        size_t tab_index = predicate_object.find("\t");
+                        if (entities == NULL) {
+                            out.append(subject);
+                            out.append('\t');
+                            out.append(predicate_object);
+                            out.append(" .\n", 3);
+                            continue;
                         }
+                        if (entities == &purchaseEntities && purchaseTime.find(subject) == purchaseTime.end()) {
+                            purchaseTime[subject] = BOOST_UNIFORM_DIST_GEN();
+                        }
+                        // "subject\tpredicate\tobject", without the brackets of the subject and the predicate...
+                        size_t predicate_end = min(predicate_object.find('>'), tab_index);
+                        record.assign(subject, 1, subject.size() - 2);
+                        record.append(1, '\t');
+                        record.append(predicate_object, 1, predicate_end - 1);
+                        record.append(1, '\t');
+                        record.append(predicate_object, tab_index + 1, string::npos);
+                        entities->back()._records.push_back(record);
                     }
                 }
             }
         }
-        if (_type_prefix == "wsdbm:Review") {
-            fos_review << '\n';
-        } else if (_type_prefix == "wsdbm:Purchase") {
-            fos_purchase << '\n';
-        } else if (_type_prefix == "wsdbm:Offer") {
-            fos_offer << '\n';
+        if (entities != NULL && entities->back()._records.empty()) {
+            entities->pop_back();
+        }
+        if (out.size() >= output_buffer::OUTPUT_BUFFER_SIZE) {
+            cout.write(out.data(), out.size());
+            out.clear();
         }
     }
+    cout.write(out.data(), out.size());
     id_cursor_map[_type_prefix] += _scaling_coefficient;
 }
 
-void association_m_t::generate_stream_data(const namespace_map &n_map, type_map &t_map,
-                                           const map<string, unsigned int> &id_cursor_map, ofstream &fos) {
+void association_m_t::generate_stream_data(type_map &t_map,
+                                           const map<string, unsigned int> &id_cursor_map) {
     if (id_cursor_map.find(_subject_type) == id_cursor_map.end()) {
         cerr << "[association_m_t::parse()] Error: association cannot be defined over undefined resource '" <<
         _subject_type << "'..." << "\n";
@@ -2468,14 +3447,24 @@ void association_m_t::generate_stream_data(const namespace_map &n_map, type_map
         exit(0);
     }
 
-    model::clear_zipfian_cache();
-
     if (_post_process) return;
 
     unsigned int left_instance_count = id_cursor_map.find(_subject_type)->second;
     unsigned int right_instance_count = id_cursor_map.find(_object_type)->second;
-    unordered_set<unsigned int> mapped_instances;
-    unordered_set<unsigned int> selected_instances;
+    // This mode draws from one sequential stream, so the permutation key is drawn from it too...
+    distinct_sampler_st distinct_right(right_instance_count, _right_distribution, RAND_SEED,
+                                       (_left_cardinality == 1) ? BOOST_UNIFORM_DIST_GEN() : 0);
+    // Right instances are distinct per left instance. selected_left[right_id] is the last
+    // left ID (+1) that selected right_id, so the marks need not be cleared between left IDs...
+    vector<unsigned int> selected_left(right_instance_count, 0);
+
+    // The same strings are reused for every edge...
+    string predicate_str = "<" + _predicate_iri + ">";
+    bool save_types = is_type_assertion();
+    if (save_types) {
+        intern_object_types(t_map, right_instance_count);
+    }
+    string subject_str, object_str, edge;
 
     boost::posix_time::ptime t1(bpt::microsec_clock::universal_time());
 
@@ -2490,50 +3479,31 @@ void association_m_t::generate_stream_data(const namespace_map &n_map, type_map
             right_size = round((double) right_size * model::generate_random(_right_cardinality_distribution));
             right_size = (right_size > _right_cardinality) ? _right_cardinality : right_size;
         }
-        selected_instances.clear();
         for (unsigned int j = 0; j < right_size; j++) {
-            unsigned int loop_counter = 0;
             unsigned int right_id = 0;
-            do {
+            bool found = true;
+            if (_left_cardinality == 1) {
+                // Instances that are mapped only once are also distinct per left instance...
+                found = distinct_right.next(right_id);
+            } else if (j < right_instance_count) {
+                // A right instance that is already selected gives way to the next unselected
+                // one, as in distinct_sampler_st, so every draw yields an edge...
                 double r_value = model::generate_random(_right_distribution, right_instance_count);
                 right_id = round(r_value * right_instance_count);
                 right_id = (right_id >= right_instance_count) ? (right_instance_count - 1) : right_id;
-                loop_counter++;
-            } while ((mapped_instances.find(right_id) != mapped_instances.end() || selected_instances.find(right_id)!=selected_instances.end()) && loop_counter < MAX_LOOP_COUNTER);
-            if (loop_counter < MAX_LOOP_COUNTER) {
-                if (_left_cardinality == 1) {
-                    mapped_instances.insert(right_id);
+                while (selected_left[right_id] == left_id + 1) {
+                    right_id = (right_id + 1 < right_instance_count) ? (right_id + 1) : 0;
                 }
-                selected_instances.insert(right_id);
-                string subject(""), predicate(""), object(""), triple("");
-
-                // FIXME:: You need to add replace-command...
-                subject.append(n_map.replace(_subject_type));
-                subject.append(boost::lexical_cast<string>(left_id));
-
-                object.append(n_map.replace(_object_type));
-                object.append(boost::lexical_cast<string>(right_id));
-
-                predicate.append(n_map.replace(_predicate));
-
-                string subject_str(""), predicate_str(""), object_str("");
-                subject_str.append("<");
-                subject_str.append(subject);
-                subject_str.append(">");
-
-                predicate_str.append("<");
-                predicate_str.append(predicate);
-                predicate_str.append(">");
-
-                object_str.append("<");
-                object_str.append(object);
-                object_str.append(">");
-
-                triple_st line(subject_str, predicate_str, object_str);
+            } else {
+                found = false;
+            }
+            if (found) {
+                selected_left[right_id] = left_id + 1;
+                assign_iri(subject_str, _subject_type_iri, left_id);
+                assign_iri(object_str, _object_type_iri, right_id);
 
                 if (_predicate == "wsdbm:likes") {
-                    fos << line;
-                    fos << "\t" << BOOST_UNIFORM_DIST_GEN() << "\t.\n";
+                    add_stream_edge(this, left_id, right_id);
                 }
                 else if (_predicate == "rev:hasReview") {
                     if (review.find(object_str) == review.end()) {
@@ -2542,7 +3512,6 @@ void association_m_t::generate_stream_data(const namespace_map &n_map, type_map
                     } else {
                         review[object_str].second = subject_str;
                     }
-                    fos << line << "\t.\n";
                 }
                 else if (_predicate == "wsdbm:purchaseFor") {
                     if (purchase.find(subject_str) == purchase.end()) {
@@ -2551,50 +3520,36 @@ void association_m_t::generate_stream_data(const namespace_map &n_map, type_map
                     } else {
                         purchase[subject_str].second = object_str;
                     }
-                    fos << line << "\t.\n";
                 }
                 else if (_predicate == "wsdbm:subscribes") {
-                    fos << line;
-                    fos << "\t" << BOOST_UNIFORM_DIST_GEN() << "\t.\n";
+                    add_stream_edge(this, left_id, right_id);
                 }
                 else if (_predicate == "gr:offers") {
-                    if (offerRetailer.find(object_str) == offerRetailer.end()) {
-                        offerRetailer[object_str] = vector<string>();
-                    }
                     offerRetailer[object_str].push_back(subject_str);
-                    if (offerTime.find(object_str) == offerTime.end()) {
-                        offerTime[object_str] = vector<long>();
-                    }
                     offerTime[object_str].push_back(BOOST_UNIFORM_DIST_GEN());
-                    fos << line << "\t.\n";
                 }
                 else if (_predicate == "gr:includes") {
-                    if (offerProduct.find(subject_str) == offerProduct.end()) {
-                        offerProduct[subject_str] = vector<string>();
-                    }
                     offerProduct[subject_str].push_back(object_str);
-                    fos << line << "\t.\n";
                 }
                 else if (_predicate == "sorg:eligibleRegion") {
-                    if (offerCountry.find(subject_str) == offerCountry.end()) {
-                        offerCountry[subject_str] = vector<string>();
-                    }
                     offerCountry[subject_str].push_back(object_str);
-                    fos << line << "\t.\n";
                 }
                 else {
-                    cout << line << "\t.\n";
+                    edge.assign(subject_str);
+                    edge.append(1, '\t');
+                    edge.append(predicate_str);
+                    edge.append(1, '\t');
+                    edge.append(object_str);
+                    edge.append("\t.\n");
+                    cout.write(edge.data(), edge.size());
                 }
 
                 // Save type assertions...
-                if (predicate.compare("http://www.w3.org/1999/02/22-rdf-syntax-ns#type") == 0) {
-                    t_map.insert(subject, object);
+                if (save_types) {
+                    t_map.insert(_subject_prefix_id, left_id, _object_type_ids[right_id]);
                 }
             } else {
-                //cout<<"[association_m_t::generate] Warning:: failed to greedily satisfy cardinality constraints..."<<"\n";
-                //cout<<"[association_m_t::generate] Ignoring association "
-                //<<_subject_type<<left_id<<"-->"
-                //<<_object_type<<right_id<<" after"<<MAX_LOOP_COUNTER<<" trials..."<<"\n";
+                _dropped_edge_count++;
             }
         }
     }
@@ -2606,8 +3561,8 @@ void association_m_t::generate_stream_data(const namespace_map &n_map, type_map
 
 }
 
-void association_m_t::process_stream_type_restrictions(const namespace_map &n_map, const type_map &t_map,
-                                                       const map<string, unsigned int> &id_cursor_map, ofstream &fos) {
+void association_m_t::process_stream_type_restrictions(const type_map &t_map,
+                                                       const map<string, unsigned int> &id_cursor_map) {
     if (id_cursor_map.find(_subject_type) == id_cursor_map.end()) {
         cerr << "[association_m_t::parse()] Error: association cannot be defined over undefined resource '" <<
         _subject_type << "'..." << "\n";
@@ -2622,28 +3577,22 @@ void association_m_t::process_stream_type_restrictions(const namespace_map &n_ma
     if (!_post_process) return;
 
     unsigned int left_instance_count = id_cursor_map.find(_subject_type)->second;
-    vector<string> *restricted_right_instances = NULL;
-    if (_object_type_restriction != NULL) {
-        restricted_right_instances = t_map.get_instances(n_map.replace(_object_type),
-                                                         n_map.replace(*_object_type_restriction));
-    } else {
-        restricted_right_instances = new vector<string>();
-        unsigned int right_instance_count = id_cursor_map.find(_object_type)->second;
-        for (unsigned int right_id = 0; right_id < right_instance_count; right_id++) {
-            string instance = n_map.replace(_object_type);
-            instance.append(boost::lexical_cast<string>(right_id));
-            restricted_right_instances->push_back(instance);
-        }
-    }
-    if (restricted_right_instances != NULL) {
-        unsigned int right_instance_count = restricted_right_instances->size();
-        set<string> mapped_instances;
+    vector<unsigned int> all_right_ids;
+    const vector<unsigned int> *restricted_right_ids = get_restricted_right_ids(t_map, id_cursor_map, all_right_ids);
+    if (restricted_right_ids != NULL) {
+        unsigned int right_instance_count = restricted_right_ids->size();
+        distinct_sampler_st distinct_right(right_instance_count, _right_distribution, RAND_SEED,
+                                           (_left_cardinality == 1) ? BOOST_UNIFORM_DIST_GEN() : 0);
+
+        // The same strings are reused for every edge...
+        string predicate_str = "<" + _predicate_iri + ">";
+        string subject, subject_str, object_str, edge;
+        char digits[20];
         for (unsigned int left_id = 0; left_id < left_instance_count; left_id++) {
-            string subject = "";
-            subject.append(n_map.replace(_subject_type));
-            subject.append(boost::lexical_cast<string>(left_id));
+            subject.assign(_subject_type_iri);
+            subject.append(digits, output_buffer::format_uint(left_id, digits));
             if (_subject_type_restriction == NULL ||
-                t_map.instanceof(subject, n_map.replace(*_subject_type_restriction))) {
+                t_map.instanceof(_subject_prefix_id, left_id, _subject_type_restriction_id)) {
                 float pr = ((float) BOOST_UNIFORM_DIST_GEN()) / ((float) RAND_MAX);
 //                float pr = ((float) rand()) / ((float) RAND_MAX);
 
@@ -2655,35 +3604,25 @@ void association_m_t::process_stream_type_restrictions(const namespace_map &n_ma
                     right_size = (right_size > _right_cardinality) ? _right_cardinality : right_size;
                 }
                 for (unsigned int j = 0; j < right_size; j++) {
-                    string predicate = "", object = "", triple = "";
-                    unsigned int loop_counter = 0;
-                    do {
+                    unsigned int right_index = 0;
+                    bool found = true;
+                    // The restricted instances are distinct, so their indexes identify them...
+                    if (_left_cardinality == 1) {
+                        found = distinct_right.next(right_index);
+                    } else {
                         double r_value = model::generate_random(_right_distribution, right_instance_count);
-                        unsigned int right_index = round(r_value * right_instance_count);
+                        right_index = round(r_value * right_instance_count);
                         right_index = (right_index >= right_instance_count) ? (right_instance_count - 1) : right_index;
-                        object = (*restricted_right_instances)[right_index];
-                        loop_counter++;
-                    } while (mapped_instances.find(object) != mapped_instances.end() &&
-                             loop_counter < MAX_LOOP_COUNTER);
-                    if (loop_counter < MAX_LOOP_COUNTER) {
-                        if (_left_cardinality == 1) {
-                            mapped_instances.insert(object);
-                        }
-
-                        predicate.append(n_map.replace(_predicate));
+                    }
+                    if (found) {
 
-                        string subject_str = "", predicate_str = "", object_str = "";
-                        subject_str.append("<");
+                        subject_str.assign(1, '<');
                         subject_str.append(subject);
-                        subject_str.append(">");
-                        predicate_str.append("<");
-                        predicate_str.append(predicate);
-                        predicate_str.append(">");
-                        object_str.append("<");
-                        object_str.append(object);
-                        object_str.append(">");
-
-                        triple_st line(subject_str, predicate_str, object_str);
+                        subject_str.append(1, '>');
+                        object_str.assign(1, '<');
+                        object_str.append(_object_type_iri);
+                        object_str.append(digits, output_buffer::format_uint((*restricted_right_ids)[right_index], digits));
+                        object_str.append(1, '>');
 
                         if (_predicate == "rev:reviewer") {
                             if (review.find(subject_str) == review.end()) {
@@ -2692,7 +3631,6 @@ void association_m_t::process_stream_type_restrictions(const namespace_map &n_ma
                             } else {
                                 review[subject_str].first = object_str;
                             }
-                            fos << line << "\t.\n";
                         }
                         else if (_predicate == "wsdbm:makesPurchase") {
                             if (purchase.find(object_str) == purchase.end()) {
@@ -2701,353 +3639,652 @@ void association_m_t::process_stream_type_restrictions(const namespace_map &n_ma
                             } else {
                                 purchase[object_str].first = subject_str;
                             }
-                            fos << line << "\t.\n";
                         }
                         else if (_predicate == "wsdbm:follows") {
-                            fos << line;
-                            fos << "\t" << BOOST_UNIFORM_DIST_GEN() << "\t.\n";
+                            add_stream_edge(this, left_id, (*restricted_right_ids)[right_index]);
                         }
                         else {
-                            cout << line << "\t.\n";
+                            edge.assign(subject_str);
+                            edge.append(1, '\t');
+                            edge.append(predicate_str);
+                            edge.append(1, '\t');
+                            edge.append(object_str);
+                            edge.append("\t.\n");
+                            cout.write(edge.data(), edge.size());
                         }
                     } else {
-                        if (_predicate == "wsdbm:makesPurchase") {
-                            //cout<<"cannot generate more purchase"<<endl;
-                        }
+                        _dropped_edge_count++;
                     }
                 }
             }
         }
-        delete restricted_right_instances;
     }
 }
 
 
-vector<string> split(const string s, char delim) {
-    stringstream ss(s);
-    string item;
-    vector<string> elems;
-    while (getline(ss, item, delim)) {
-        elems.push_back(item);
-        // elems.push_back(std::move(item)); // if C++11 (based on comment from @mchiasson)
+// Joins the reviews, purchases and offers with their associations into the sorter that
+// already holds the timed edges, and sorts the stream into stream.txt...
+void output_stream_file(stream_sorter &sorter) {
+    //build the reviewPurchase
+    for (auto it = purchase.begin(); it != purchase.end(); it++) {
+        reversePurchase[it->second] = it->first;
     }
-    return elems;
-}
 
-string removeBracket(string ss) {
-    if (!ss.size()) return ss;
-    size_t found = ss.find('>');
-    return ss.substr(1, found - 1);
-}
+    for (vector<stream_entity_st>::const_iterator itr = reviewEntities.begin(); itr != reviewEntities.end(); itr++) {
+        const string &curr_review = itr->_subject;
+        bool purchased = reversePurchase.find(review[curr_review]) != reversePurchase.end();
+        long curr_time = purchased ? purchaseTime[reversePurchase[review[curr_review]]] : 0;
+        if (review[curr_review].first.size() == 0 || review[curr_review].second.size() == 0) {
+            // An incomplete review is dropped, but still draws a time for each of its triples...
+            if (!purchased) {
+                for (size_t i = 0; i < itr->_records.size(); i++) BOOST_UNIFORM_DIST_GEN();
+            }
+            continue;
+        }
+        if (!purchased) curr_time = BOOST_UNIFORM_DIST_GEN();
+        for (vector<string>::const_iterator record = itr->_records.begin(); record != itr->_records.end(); record++) {
+            sorter.add(*record + "\t" + to_string(curr_time));
+        }
+        string review1 = removeBracket(curr_review) + "\t" + "http://purl.org/stuff/rev#reviewer" + "\t" +
+                         removeBracket(review[curr_review].first) + "\t" + to_string(curr_time);
+        string review2 =
+                removeBracket(review[curr_review].second) + "\t" + "http://purl.org/stuff/rev#hasReview" + "\t" +
+                removeBracket(curr_review) + "\t" + to_string(curr_time);
+        sorter.add(review1);
+        sorter.add(review2);
+    }
 
-void output_stream_file() {
-    ifstream fin("1_assoc_stream.txt");
-    ofstream fos_stream("stream_data.txt");
+    for (vector<stream_entity_st>::const_iterator itr = purchaseEntities.begin(); itr != purchaseEntities.end(); itr++) {
+        const string &curr_purchase = itr->_subject;
+        long curr_time = purchaseTime[curr_purchase];
+        for (vector<string>::const_iterator record = itr->_records.begin(); record != itr->_records.end(); record++) {
+            sorter.add(*record + "\t" + to_string(curr_time));
+        }
+        if(purchase[curr_purchase].first!=""){
+            string purchase1 = removeBracket(purchase[curr_purchase].first) + "\t" +
+                               "http://db.uwaterloo.ca/~galuc/wsdbm/makesPurchase" + "\t" +
+                               removeBracket(curr_purchase) + "\t" + to_string(curr_time);
+            sorter.add(purchase1);
+        }
+        string purchase2 =
+                removeBracket(curr_purchase) + "\t" + "http://db.uwaterloo.ca/~galuc/wsdbm/purchaseFor" + "\t" +
+                removeBracket(purchase[curr_purchase].second) + "\t" + to_string(curr_time);
+        sorter.add(purchase2);
+    }
 
-    string line;
-    while (getline(fin, line)) {
-        vector<string> items = split(line, '\t');
-        if (items[1] == "<http://db.uwaterloo.ca/~galuc/wsdbm/likes>" ||
-            items[1] == "<http://db.uwaterloo.ca/~galuc/wsdbm/follows>" ||
-            items[1] == "<http://db.uwaterloo.ca/~galuc/wsdbm/subscribes>") {
-            string result = "";
-            size_t found = items[0].find('>');
-            result.append(items[0].substr(1, found - 1) + "\t");
-            found = items[1].find('>');
-            result.append(items[1].substr(1, found - 1) + "\t");
-            found = items[2].find('>');
-            result.append(items[2].substr(1, found - 1) + "\t");
-            result.append(items[3]);
-            fos_stream << result << '\n';
+    for (vector<stream_entity_st>::const_iterator itr = offerEntities.begin(); itr != offerEntities.end(); itr++) {
+        const string &curr_offer = itr->_subject;
+        for (int i = 0; i < offerRetailer[curr_offer].size(); i++) {
+            long curr_time = offerTime[curr_offer][i];
+            for (vector<string>::const_iterator record = itr->_records.begin(); record != itr->_records.end(); record++) {
+                sorter.add(*record + "\t" + to_string(curr_time));
+            }
+            string assoc1 =
+                    removeBracket(offerRetailer[curr_offer][i]) + "\t" + "http://purl.org/goodrelations/offers" +
+                    "\t" + removeBracket(curr_offer) + "\t" + to_string(curr_time);
+            sorter.add(assoc1);
+            if (!offerProduct[curr_offer].empty()) {
+                string assoc2 = removeBracket(curr_offer) + "\t" + "http://purl.org/goodrelations/includes" + "\t" +
+                                removeBracket(offerProduct[curr_offer][0]) + "\t" + to_string(curr_time);
+                sorter.add(assoc2);
+            }
+            string assoc3;
+            for (auto country:offerCountry[curr_offer]) {
+                assoc3 = removeBracket(curr_offer) + "\t" + "http://schema.org/eligibleRegion" + "\t" +
+                         removeBracket(country) + "\t" + to_string(curr_time);
+                sorter.add(assoc3);
+            }
         }
-        else {
+    }
+
+    // Sort on the timestamp column...
+    sorter.finish();
+};
+
+// Arrival processes of the time-ordered stream...
+namespace ARRIVAL_TYPES {
+    enum enum_t {
+        UNIFORM,
+        POISSON,
+        UNDEFINED
+    };
+};
+
+// Event times of one stream, drawn in increasing order without storing them. UNIFORM
+// yields the order statistics of event_count uniform draws over [0, RAND_MAX], each one
+// as the minimum of the draws that are still left. POISSON spaces the events by
+// exponential gaps, at the rate that puts event_count events into the same interval...
+struct event_clock_st {
+    ARRIVAL_TYPES::enum_t _arrival;
+    unsigned long long _event_count;
+    unsigned long long _remaining;
+    double _time;
+    counter_rng _rng;
+
+    event_clock_st(ARRIVAL_TYPES::enum_t arrival, unsigned long long event_count, unsigned int stream_key) {
+        _arrival = arrival;
+        _event_count = event_count;
+        _remaining = event_count;
+        _time = 0.0;
+        _rng.seek(RAND_SEED, counter_rng::hash("stream"), stream_key, 0);
+    }
 
+    long next() {
+        // Uniform over (0, 1]...
+        double u = ((double) _rng() + 1.0) / 4294967296.0;
+        if (_arrival == ARRIVAL_TYPES::POISSON) {
+            _time += -log(u) * ((double) RAND_MAX) / ((double) max(_event_count, 1ULL));
+        } else if (_remaining > 0) {
+            _time += (((double) RAND_MAX) - _time) * -expm1(log(u) / ((double) _remaining));
+            _remaining--;
         }
+        return (long) _time;
     }
+};
 
-    fin.close();
+// Events of one stream in increasing time order. _read fills in the records of the
+// next event without their timestamp, and returns false at the end of the stream...
+struct stream_source_st {
+    function<bool(vector<string> &)> _read;
+    event_clock_st _clock;
+    vector<string> _records;
+    long _time;
 
-    //build the reviewPurchase
+    stream_source_st(function<bool(vector<string> &)> read, const event_clock_st &clock) : _read(read), _clock(clock) {
+        _time = 0;
+    }
+
+    bool advance() {
+        _records.clear();
+        if (!_read(_records)) return false;
+        _time = _clock.next();
+        return true;
+    }
+};
+
+static void append_review_records(const stream_entity_st &entity, vector<string> &records) {
+    const string &curr_review = entity._subject;
+    records.insert(records.end(), entity._records.begin(), entity._records.end());
+    records.push_back(removeBracket(curr_review) + "\t" + "http://purl.org/stuff/rev#reviewer" + "\t" +
+                      removeBracket(review[curr_review].first));
+    records.push_back(removeBracket(review[curr_review].second) + "\t" + "http://purl.org/stuff/rev#hasReview" + "\t" +
+                      removeBracket(curr_review));
+}
+
+// Time-ordered alternative to output_stream_file(). Every stream (likes, follows,
+// subscribes, reviews, purchases and offers) gets its own clock, which assigns
+// increasing times to its events in the order they were generated. The streams are
+// merged by time on the way to stream.txt, so nothing has to be sorted afterwards.
+// The times of a stream are distributed as before, but they now increase with the
+// position of the events in the stream. Ties are broken in the order listed above...
+void output_ordered_stream_file(ARRIVAL_TYPES::enum_t arrival) {
     for (auto it = purchase.begin(); it != purchase.end(); it++) {
         reversePurchase[it->second] = it->first;
     }
 
-    ifstream in_review("1_review_stream.txt");
-    ifstream in_purchase("1_purchase_stream.txt");
-    ifstream in_offer("1_offer_stream.txt");
-
-    string curr_review = "";
-    long curr_time = 0;
-    bool getTime = true;
-    bool skip = false;
-    while (getline(in_review, line)) {
-        if (line.size() == 0) {
-            if (getTime) continue;
-            string review1 = removeBracket(curr_review) + "\t" + "http://purl.org/stuff/rev#reviewer" + "\t" +
-                             removeBracket(review[curr_review].first) + "\t" + to_string(curr_time);
-            string review2 =
-                    removeBracket(review[curr_review].second) + "\t" + "http://purl.org/stuff/rev#hasReview" + "\t" +
-                    removeBracket(curr_review) + "\t" + to_string(curr_time);
-            fos_stream << review1 << "\n" << review2 << "\n" << "\n";
-            getTime = true;
-            continue;
+    // A review by the buyer of the product takes the time of the purchase, so these
+    // reviews are kept aside and emitted along with it...
+    unordered_map<string, vector<string>> purchaseReviews;
+    unsigned long long review_count = 0;
+    for (vector<stream_entity_st>::const_iterator itr = reviewEntities.begin(); itr != reviewEntities.end(); itr++) {
+        const string &curr_review = itr->_subject;
+        if (review[curr_review].first.size() == 0 || review[curr_review].second.size() == 0) continue;
+        auto p_it = reversePurchase.find(review[curr_review]);
+        if (p_it == reversePurchase.end()) {
+            review_count++;
+        } else {
+            append_review_records(*itr, purchaseReviews[p_it->second]);
         }
-        vector<string> items = split(line, '\t');
-        if (getTime) {
-            if (reversePurchase.find(review[items[0]]) == reversePurchase.end()) {
-                curr_time = BOOST_UNIFORM_DIST_GEN();
-            }
-            else
-                curr_time = purchaseTime[reversePurchase[review[items[0]]]];
-            curr_review = items[0];
-            if (review[curr_review].first.size() == 0 || review[curr_review].second.size() == 0) {
-                skip = true;
-                continue;
+    }
+    unsigned long long offer_count = 0;
+    for (auto it = offerRetailer.begin(); it != offerRetailer.end(); it++) {
+        offer_count += it->second.size();
+    }
+
+    vector<stream_source_st *> sources;
+    const string timed_predicates[] = {"http://db.uwaterloo.ca/~galuc/wsdbm/likes",
+                                       "http://db.uwaterloo.ca/~galuc/wsdbm/follows",
+                                       "http://db.uwaterloo.ca/~galuc/wsdbm/subscribes"};
+    for (unsigned int i = 0; i < 3; i++) {
+        const stream_edges_st *edges = &streamEdges[timed_predicates[i]];
+        // The next edge and the run that it belongs to...
+        shared_ptr<pair<size_t, size_t> > cursor(new pair<size_t, size_t>(0, 0));
+        sources.push_back(new stream_source_st([cursor, edges](vector<string> &records) {
+            if (cursor->first >= edges->_ids.size()) return false;
+            while (cursor->second + 1 < edges->_runs.size() && edges->_runs[cursor->second + 1].first <= cursor->first) {
+                cursor->second++;
             }
-            else skip = false;
-            getTime = false;
+            const association_m_t *association = edges->_runs[cursor->second].second;
+            const pair<unsigned int, unsigned int> &ids = edges->_ids[cursor->first++];
+            records.push_back(association->_subject_type_iri + to_string(ids.first) + "\t" + association->_predicate_iri +
+                              "\t" + association->_object_type_iri + to_string(ids.second));
+            return true;
+        }, event_clock_st(arrival, edges->_ids.size(), i)));
+    }
+
+    shared_ptr<size_t> review_cursor(new size_t(0));
+    sources.push_back(new stream_source_st([review_cursor](vector<string> &records) {
+        while (*review_cursor < reviewEntities.size()) {
+            const stream_entity_st &entity = reviewEntities[(*review_cursor)++];
+            const string &curr_review = entity._subject;
+            if (review[curr_review].first.size() == 0 || review[curr_review].second.size() == 0) continue;
+            if (reversePurchase.find(review[curr_review]) != reversePurchase.end()) continue;
+            append_review_records(entity, records);
+            return true;
         }
-        if (skip) continue;
-        string result = "";
-        size_t found = items[0].find('>');
-        result.append(items[0].substr(1, found - 1) + "\t");
-        found = items[1].find('>');
-        result.append(items[1].substr(1, found - 1) + "\t");
-        result.append(items[2] + "\t");
-        result.append(to_string(curr_time));
-        fos_stream << result << "\n";
-    }
-
-    curr_time = 0;
-    string curr_purchase = "";
-    getTime = true;
-    while (getline(in_purchase, line)) {
-        if (!line.size()) {
-            if(purchase[curr_purchase].first!=""){
-                string purchase1 = removeBracket(purchase[curr_purchase].first) + "\t" +
-                                   "http://db.uwaterloo.ca/~galuc/wsdbm/makesPurchase" + "\t" +
-                                   removeBracket(curr_purchase) + "\t" + to_string(curr_time);
-                fos_stream << purchase1 << '\n';
-            }
-            string purchase2 =
-                    removeBracket(curr_purchase) + "\t" + "http://db.uwaterloo.ca/~galuc/wsdbm/purchaseFor" + "\t" +
-                    removeBracket(purchase[curr_purchase].second) + "\t" + to_string(curr_time);
-            fos_stream << purchase2 << '\n' << '\n';
-            getTime = true;
-            continue;
+        return false;
+    }, event_clock_st(arrival, review_count, 3)));
+
+    shared_ptr<size_t> purchase_cursor(new size_t(0));
+    sources.push_back(new stream_source_st([purchase_cursor, &purchaseReviews](vector<string> &records) {
+        if (*purchase_cursor >= purchaseEntities.size()) return false;
+        const stream_entity_st &entity = purchaseEntities[(*purchase_cursor)++];
+        const string &curr_purchase = entity._subject;
+        auto r_it = purchaseReviews.find(curr_purchase);
+        if (r_it != purchaseReviews.end()) {
+            records.insert(records.end(), r_it->second.begin(), r_it->second.end());
         }
-        vector<string> items = split(line, '\t');
-        if (getTime) {
-            curr_time = purchaseTime[items[0]];
-            getTime = false;
+        records.insert(records.end(), entity._records.begin(), entity._records.end());
+        if (purchase[curr_purchase].first != "") {
+            records.push_back(removeBracket(purchase[curr_purchase].first) + "\t" +
+                              "http://db.uwaterloo.ca/~galuc/wsdbm/makesPurchase" + "\t" + removeBracket(curr_purchase));
         }
-        curr_purchase = items[0];
-        string result = "";
-        size_t found = items[0].find('>');
-        result.append(items[0].substr(1, found - 1) + "\t");
-        found = items[1].find('>');
-        result.append(items[1].substr(1, found - 1) + "\t");
-        result.append(items[2] + "\t");
-        result.append(to_string(purchaseTime[items[0]]));
-        fos_stream << result << '\n';
-    }
-
-    curr_time = 0;
-    string curr_offer = "";
-    vector<string> cache;
-    while (getline(in_offer, line)) {
-        if (!line.size()) {
-            for (int i = 0; i < offerRetailer[curr_offer].size(); i++) {
-                curr_time = offerTime[curr_offer][i];
-                for (auto item: cache) {
-                    item.append(to_string(curr_time));
-                    fos_stream << item << '\n';
-                }
-                string assoc1 =
-                        removeBracket(offerRetailer[curr_offer][i]) + "\t" + "http://purl.org/goodrelations/offers" +
-                        "\t" + removeBracket(curr_offer) + "\t" + to_string(curr_time);
-                fos_stream << assoc1 << '\n';
-                string assoc2 = removeBracket(curr_offer) + "\t" + "http://purl.org/goodrelations/includes" + "\t" +
-                                removeBracket(offerProduct[curr_offer][0]) + "\t" + to_string(curr_time);
-                fos_stream << assoc2 << '\n';
-                string assoc3;
-                for (auto country:offerCountry[curr_offer]) {
-                    assoc3 = removeBracket(curr_offer) + "\t" + "http://schema.org/eligibleRegion" + "\t" +
-                             removeBracket(country) + "\t" + to_string(curr_time);
-                    fos_stream << assoc3 << '\n';
-                }
-                fos_stream << '\n';
+        records.push_back(removeBracket(curr_purchase) + "\t" + "http://db.uwaterloo.ca/~galuc/wsdbm/purchaseFor" + "\t" +
+                          removeBracket(purchase[curr_purchase].second));
+        return true;
+    }, event_clock_st(arrival, purchaseTime.size(), 4)));
+
+    // Every retailer of an offer makes a separate event...
+    struct offer_cursor_st {
+        size_t _entity;
+        const vector<string> *_retailers;
+        size_t _retailer;
+    };
+    shared_ptr<offer_cursor_st> cursor(new offer_cursor_st());
+    cursor->_entity = 0;
+    cursor->_retailers = NULL;
+    cursor->_retailer = 0;
+    sources.push_back(new stream_source_st([cursor](vector<string> &records) {
+        while (cursor->_retailers == NULL || cursor->_retailer >= cursor->_retailers->size()) {
+            if (cursor->_entity >= offerEntities.size()) return false;
+            auto r_it = offerRetailer.find(offerEntities[cursor->_entity++]._subject);
+            cursor->_retailers = (r_it == offerRetailer.end()) ? NULL : &r_it->second;
+            cursor->_retailer = 0;
+        }
+        const stream_entity_st &entity = offerEntities[cursor->_entity - 1];
+        const string &curr_offer = entity._subject;
+        records.insert(records.end(), entity._records.begin(), entity._records.end());
+        records.push_back(removeBracket((*cursor->_retailers)[cursor->_retailer]) + "\t" + "http://purl.org/goodrelations/offers" +
+                          "\t" + removeBracket(curr_offer));
+        if (!offerProduct[curr_offer].empty()) {
+            records.push_back(removeBracket(curr_offer) + "\t" + "http://purl.org/goodrelations/includes" + "\t" +
+                              removeBracket(offerProduct[curr_offer][0]));
+        }
+        for (auto country: offerCountry[curr_offer]) {
+            records.push_back(removeBracket(curr_offer) + "\t" + "http://schema.org/eligibleRegion" + "\t" +
+                              removeBracket(country));
+        }
+        cursor->_retailer++;
+        return true;
+    }, event_clock_st(arrival, offer_count, 5)));
+
+    typedef pair<long, unsigned int> head_t;
+    priority_queue<head_t, vector<head_t>, greater<head_t> > heads;
+    for (unsigned int i = 0; i < sources.size(); i++) {
+        if (sources[i]->advance()) heads.push(head_t(sources[i]->_time, i));
+    }
+    output_sink *sink = output_sink::open("stream.txt");
+    {
+        output_buffer out(sink);
+        while (!heads.empty()) {
+            unsigned int i = heads.top().second;
+            heads.pop();
+            stream_source_st *source = sources[i];
+            for (vector<string>::const_iterator itr = source->_records.begin(); itr != source->_records.end(); itr++) {
+                out.append(*itr);
+                out.append('\t');
+                out.append_uint(source->_time);
+                out.append('\n');
             }
-            cache.clear();
-            continue;
+            if (source->advance()) heads.push(head_t(source->_time, i));
         }
-        vector<string> items = split(line, '\t');
-        curr_offer = items[0];
-        string result = "";
-        size_t found = items[0].find('>');
-        result.append(items[0].substr(1, found - 1) + "\t");
-        found = items[1].find('>');
-        result.append(items[1].substr(1, found - 1) + "\t");
-        result.append(items[2] + "\t");
-        cache.push_back(result);
-    }
-
-
-    in_review.close();
-    in_purchase.close();
-    in_offer.close();
-    fos_stream.close();
-
-    string cmd2 = "sort -s -t '\t' -g -k 4 -T ./ stream_data.txt > stream_data_temp.txt";
-    char ls_cmd2[100];
-    sprintf(ls_cmd2, cmd2.c_str());
-    system(ls_cmd2);
-
-    //'^$' will match an empty line
-    string cmd3 = "grep -v '^$' stream_data_temp.txt > stream.txt";
-    char ls_cmd3[100];
-    sprintf(ls_cmd3, cmd3.c_str());
-    system(ls_cmd3);
-
-    remove("1_offer_stream.txt");
-    remove("1_assoc_stream.txt");
-    remove("1_review_stream.txt");
-    remove("1_purchase_stream.txt");
-    remove("stream_data.txt");
-    remove("stream_data_temp.txt");
-
-};
-
-string sumAB(string a, int b) {
-    string result = "";
-    string interval = to_string(b);
-    int lena = a.size() - 1, lenb = interval.size() - 1;
-    int carry = 0, op1 = 0, op2 = 0;
-    int mid = 0;
-    while (1) {
-        if (lena < 0 && lenb < 0) break;
-        op1 = 0;
-        op2 = 0;
-        if (lena >= 0) {
-            op1 = a[lena] - '0';
-            lena--;
-        }
-        if (lenb >= 0) {
-            op2 = interval[lenb] - '0';
-            lenb--;
-        }
-        mid = op1 + op2 + carry;
-        carry = mid / 10;
-        mid = mid % 10;
-        result.insert(result.begin(), mid + '0');
-    }
-    if (carry != 0) result.insert(result.begin(), carry + '0');
-    return result;
+    }
+    delete sink;
+    for (vector<stream_source_st *>::iterator itr = sources.begin(); itr != sources.end(); itr++) {
+        delete *itr;
+    }
 }
 
-void attach_timestamp(string src, string dst, int rate) {
-    ifstream fin(src);
-    ofstream fos_stream(dst);
+// Rewrites the 4th column of a stream file with a synthetic timeline in milliseconds:
+// consecutive lines that share their original timestamp form a group, and group k is
+// stamped floor(k * 1000 / rate), so that rate groups start every second. Times are
+// 64-bit integers, and rates that do not divide 1000 keep their fractional part...
+void attach_timestamp(const string &src, const string &dst, unsigned int rate) {
+    if (rate == 0) {
+        cerr << "[attach_timestamp()]\tThe stream rate must be positive..." << "\n";
+        exit(0);
+    }
+    FILE *fin = fopen(src.c_str(), "r");
+    if (fin == NULL) {
+        cerr << "[attach_timestamp()]\tFailed to open '" << src << "'..." << "\n";
+        exit(0);
+    }
+    vector<char> read_buffer(4 << 20);
+    setvbuf(fin, read_buffer.data(), _IOFBF, read_buffer.size());
+    output_sink *sink = output_sink::open(dst);
+
+    {
+        output_buffer out(sink);
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length = 0;
+        string last_sig = "";
+        bool first = true;
+        unsigned long long group = 0;
+        while ((length = getline(&line, &capacity, fin)) >= 0) {
+            if (length > 0 && line[length - 1] == '\n') length--;
+            if (length == 0) continue;
+            // The triple is everything up to the 3rd tab, the original timestamp follows it...
+            const char *end = line + length;
+            const char *field = line;
+            for (int tab_count = 0; tab_count < 3 && field != end; tab_count++) {
+                const char *tab = (const char *) memchr(field, '\t', end - field);
+                field = (tab == NULL) ? end : tab + 1;
+            }
+            const char *sig_end = (const char *) memchr(field, '\t', end - field);
+            sig_end = (sig_end == NULL) ? end : sig_end;
+            if (first) {
+                first = false;
+                last_sig.assign(field, sig_end - field);
+            } else if (last_sig.compare(0, string::npos, field, sig_end - field) != 0) {
+                last_sig.assign(field, sig_end - field);
+                group++;
+            }
+            out.append(line, field - line);
+            if (field == end && line[length - 1] != '\t') {
+                out.append('\t');
+            }
+            out.append_uint(group * 1000 / rate);
+            out.append('\n');
+        }
+        free(line);
+    }
+    fclose(fin);
+    delete sink;
+}
 
-    int interval = 1;
-    int batch = 1;
-    if(1000>rate){
-        interval = 1000/rate;
-    }else{
-        batch = rate/1000;
+// Writes query qid of -sq for C-SPARQL, and echoes it to stdout...
+static void write_csparql_query(int qid, const string &query) {
+    string cmd1 = "mkdir workload/csparql/q_"+to_string(qid);
+    char ls_cmd1[100];
+    sprintf(ls_cmd1, cmd1.c_str());
+    system(ls_cmd1);
+    ofstream fos("workload/csparql/q_"+to_string(qid)+"/oracle.query");
+    fos << query;
+    cout << query;
+    fos.close();
+    ifstream fis("workload/csparql/q_"+to_string(qid)+"/oracle.query");
+    ofstream fos2("workload/csparql/q_"+to_string(qid)+"/engine.query");
+    fos2<<"REGISTER QUERY test AS"<<"\n";
+    string temp = "";
+    getline(fis, temp);
+    auto ind = temp.find("WHERE");
+    fos2<<temp.substr(0, ind)<<"\n";
+    fos2<<"FROM STREAM <http://ex.org/streams/test> [RANGE ${WSIZE} STEP ${WSLIDE}]"<<"\n";
+    fos2<<"FROM <http://dsg.uwaterloo.ca/watdiv/knowledge>"<<"\n";
+    fos2<<"WHERE {"<<"\n";
+    while(getline(fis, temp)){
+        fos2<<temp<<"\n";
     }
+    fos2.close();
+    fis.close();
+}
 
-    //warm up stream, 1 triple/second
-    string line;
-    string last_time = "0";
-    bool first = true;
-    int i = 1;
-    string last_sig = "";
-    while (getline(fin, line)) {
-        if (line.size() == 0) continue;
-        vector<string> items = split(line, '\t');
-        string result = "";
-        result.append(items[0] + "\t");
-        result.append(items[1] + "\t");
-        result.append(items[2] + "\t");
-        string curr_sig = items[3];
-        if(first){
-            last_sig = curr_sig;
-            first = false;
+// Writes query qid of -sq for CQELS, and echoes it to stdout...
+static void write_cqels_query(int qid, const string &query) {
+    string cmd1 = "mkdir workload/cqels/q_"+to_string(qid);
+    char ls_cmd1[100];
+    sprintf(ls_cmd1, cmd1.c_str());
+    system(ls_cmd1);
+    ofstream fos3("workload/cqels/q_"+to_string(qid)+"/oracle.query");
+    fos3 << query;
+    cout << query;
+    fos3.close();
+    ifstream fis("workload/cqels/q_"+to_string(qid)+"/oracle.query");
+    ofstream fos4("workload/cqels/q_"+to_string(qid)+"/engine.query");
+    string temp = "";
+    getline(fis, temp);
+    auto ind = temp.find("WHERE");
+    fos4<<temp.substr(0, ind)<<"\n";
+    fos4<<"FROM NAMED <http://dsg.uwaterloo.ca/watdiv/knowledge>"<<"\n";
+    fos4<<"WHERE{"<<"\n";
+    vector<string> stream_edge;
+    vector<string> static_edge;
+    unordered_set<string> stream_edges{"<http://db.uwaterloo.ca/~galuc/wsdbm/likes>",
+                                       "<http://db.uwaterloo.ca/~galuc/wsdbm/follows>",
+                                       "<http://db.uwaterloo.ca/~galuc/wsdbm/subscribes>",
+                                       "<http://purl.org/goodrelations/offers>",
+                                       "<http://purl.org/goodrelations/includes>",
+                                       "<http://schema.org/eligibleRegion>",
+                                       "<http://db.uwaterloo.ca/~galuc/wsdbm/makesPurchase>",
+                                       "<http://db.uwaterloo.ca/~galuc/wsdbm/purchaseFor>",
+                                       "<http://purl.org/stuff/rev#reviewer>",
+                                       "<http://purl.org/stuff/rev#hasReview>",
+                                       "<http://purl.org/stuff/rev#rating>",
+                                       "<http://purl.org/stuff/rev#title>",
+                                       "<http://purl.org/stuff/rev#text>",
+                                       "<http://purl.org/stuff/rev#totalVotes>",
+                                       "<http://purl.org/goodrelations/price>",
+                                       "<http://db.uwaterloo.ca/~galuc/wsdbm/purchaseDate>",
+                                       "<http://purl.org/goodrelations/serialNumber>",
+                                       "<http://purl.org/goodrelations/price>",
+                                       "<http://purl.org/goodrelations/validFrom>",
+                                       "<http://purl.org/goodrelations/validThrough>",
+                                       "<http://schema.org/priceValidUntil>",
+                                       "<http://schema.org/eligibleQuantity>"};
+
+    while(getline(fis, temp)){
+        if(temp=="}") continue;
+        istringstream is(temp);
+        string item = "";
+        is>>item>>item;
+        if(stream_edges.count(item)) stream_edge.push_back(temp);
+        else static_edge.push_back(temp);
+    }
+    if(!stream_edge.empty()) {
+        fos4 << "\t" << "STREAM <http://ex.org/streams/test> [RANGE ${WSIZE} SLIDE ${WSLIDE}] {" << "\n";
+        for (auto item : stream_edge) {
+            fos4 << "    " << item << "\n";
         }
-        if(last_sig!=curr_sig){
-            if(batch==1||i>=batch){
-                last_sig = curr_sig;
-                last_time = sumAB(last_time, interval);
-                i = 1;
-            }else if(i<batch){
-                i++;
-            }
+        fos4 << "\t" << "}" << "\n";
+    }
+    if(!static_edge.empty()) {
+        fos4 << "\t" << "GRAPH<http://dsg.uwaterloo.ca/watdiv/knowledge>{" << "\n";
+        for (auto item : static_edge) {
+            fos4 << "    " << item << "\n";
+        }
+        fos4 << "\t" << "}" << "\n";
+    }
+    fos4<<"}";
+}
+
+// Removes "-j <threads>", "-o <output>", "-pull" and "-seed <seed>" from the arguments
+// of -q, so that the rest of them are the templates and the counts...
+static void take_query_options(int &argc, const char *argv[], unsigned int &thread_count, string &output_target, bool &pull) {
+    int count = 3;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = boost::lexical_cast<unsigned int>(string(argv[++i]));
+        } else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            model::seed_random(boost::lexical_cast<unsigned int>(string(argv[++i])));
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_target = argv[++i];
+        } else if (strcmp(argv[i], "-pull") == 0) {
+            pull = true;
+        } else {
+            argv[count++] = argv[i];
         }
-        result.append(last_time);
-        fos_stream << result << '\n';
     }
+    argc = count;
+}
 
-    fin.close();
+// Restores the state saved by -d, from saved.bin unless saved.txt was written after it...
+static void load_saved_model(model &cur_model) {
+    struct stat text_stat, snapshot_stat;
+    bool has_text = stat("saved.txt", &text_stat) == 0;
+    if (stat("saved.bin", &snapshot_stat) == 0 &&
+        (!has_text || snapshot_stat.st_mtim.tv_sec > text_stat.st_mtim.tv_sec ||
+         (snapshot_stat.st_mtim.tv_sec == text_stat.st_mtim.tv_sec && snapshot_stat.st_mtim.tv_nsec >= text_stat.st_mtim.tv_nsec)) &&
+        model_snapshot::load(cur_model, "saved.bin")) {
+        return;
+    }
+    cur_model.load("saved.txt");
 }
 
 
 int main(int argc, const char *argv[]) {
     dictionary *dict = dictionary::get_instance();
 
-    BOOST_NORMAL_DIST_GEN.engine().seed(1024);
-    BOOST_NORMAL_DIST_GEN.distribution().reset();
-    BOOST_UNIFORM_DIST_GEN.engine().seed(1024);
-    BOOST_UNIFORM_DIST_GEN.distribution().reset();
-    if (argc == 6 && argv[1][0] == '-' && argv[1][1] == 's' && argv[1][2] == 'd') {
-        BOOST_NORMAL_DIST_GEN.engine().seed(boost::lexical_cast<unsigned int>(string(argv[5])));
-        BOOST_NORMAL_DIST_GEN.distribution().reset();
-        BOOST_UNIFORM_DIST_GEN.engine().seed(boost::lexical_cast<unsigned int>(string(argv[5])));
-        BOOST_UNIFORM_DIST_GEN.distribution().reset();
+    model::seed_random(1024);
+    if ((argc == 6 || argc == 8) && argv[1][0] == '-' && argv[1][1] == 's' && argv[1][2] == 'd') {
+        model::seed_random(boost::lexical_cast<unsigned int>(string(argv[5])));
+    }
+    unsigned int query_thread_count = 0;
+    string query_output_target = "-";
+    bool query_pull = false;
+    if (argc >= 5 && strcmp(argv[1], "-q") == 0) {
+        take_query_options(argc, argv, query_thread_count, query_output_target, query_pull);
+    }
+
+    //./watdiv -ts <source-file> <dest-file> <rate>
+    // Rewrites timestamps without a model, so it is handled before the model is parsed...
+    if (argc == 5 && strcmp(argv[1], "-ts") == 0) {
+        unsigned int rate = boost::lexical_cast<unsigned int>(string(argv[4]));
+        attach_timestamp(argv[2], argv[3], rate);
+        dictionary::destroy_instance();
+        return 0;
     }
 
-    if ((argc == 2 || argc == 4 || argc == 5 || argc >= 6) && argv[1][0] == '-') {
+    //./watdiv -play <stream-file> <triples-per-second> [-o <output>] [-b <burst-profile>] [-i <report-interval>]
+    // Replays a stream without a model, so it is handled before the model is parsed...
+    if (argc >= 4 && argc % 2 == 0 && strcmp(argv[1], "-play") == 0) {
+        stream_player player(boost::lexical_cast<double>(string(argv[3])));
+        string output_target = "-";
+        for (int i = 4; i < argc; i += 2) {
+            if (strcmp(argv[i], "-o") == 0) {
+                output_target = argv[i + 1];
+            } else if (strcmp(argv[i], "-b") == 0) {
+                player.set_burst_profile(argv[i + 1]);
+            } else if (strcmp(argv[i], "-i") == 0) {
+                player.set_report_interval(boost::lexical_cast<double>(string(argv[i + 1])));
+            } else {
+                cerr << "[main()]\tUnknown option '" << argv[i] << "'..." << "\n";
+                exit(0);
+            }
+        }
+        output_sink *sink = output_sink::open(output_target);
+        player.play(argv[2], *sink);
+        sink->close();
+        player.report();
+        delete sink;
+        dictionary::destroy_instance();
+        return 0;
+    }
+
+    //./watdiv -st <statistics-file>
+    // Prints the statistics that -s saved, without the model or the dataset...
+    if (argc == 3 && strcmp(argv[1], "-st") == 0) {
+        statistics_file stats_file(argv[2]);
+        for (uint32_t i = 0; i < stats_file.entry_count(); i++) {
+            stats_file.report(i, cout);
+        }
+        dictionary::destroy_instance();
+        return 0;
+    }
+
+    if ((argc == 2 || argc == 4 || argc == 5 || argc >= 6 || (argc == 3 && strcmp(argv[1], "-lb") == 0)) && argv[1][0] == '-') {
         dict->init("/usr/share/dict/words", "../../files/firstnames.txt", "../../files/lastnames.txt");
         const char *model_filename = argv[2];
         model cur_model(model_filename);
         //statistics stat (cur_model);
         //./watdiv -sd ../../model/wsdbm-data-model.txt 1 1 1024 > static_rdf.txt
         // first '1' is static scale factor, second '1' is streaming scale factor
-        if (argc == 6 && argv[1][0] == '-' && argv[1][1] == 's' && argv[1][2] == 'd') {
+        // -t uniform|poisson emits the stream in time order instead of sorting it afterwards
+        if ((argc == 6 || argc == 8) && argv[1][0] == '-' && argv[1][1] == 's' && argv[1][2] == 'd') {
             unsigned int static_scale_factor = boost::lexical_cast<unsigned int>(string(argv[3]));
             unsigned int stream_scale_factor = boost::lexical_cast<unsigned int>(string(argv[4]));
+            ARRIVAL_TYPES::enum_t arrival = ARRIVAL_TYPES::UNDEFINED;
+            if (argc == 8) {
+                if (strcmp(argv[6], "-t") != 0) {
+                    cerr << "[main()]\tUnknown option '" << argv[6] << "'..." << "\n";
+                    exit(0);
+                }
+                if (strcmp(argv[7], "uniform") == 0) {
+                    arrival = ARRIVAL_TYPES::UNIFORM;
+                } else if (strcmp(argv[7], "poisson") == 0) {
+                    arrival = ARRIVAL_TYPES::POISSON;
+                } else {
+                    cerr << "[main()]\tUnknown arrival process '" << argv[7] << "'..." << "\n";
+                    exit(0);
+                }
+            }
+            // Unless the stream is time-ordered, the timed edges are sorted as they are generated...
+            stream_sorter *sorter = (arrival == ARRIVAL_TYPES::UNDEFINED) ? new stream_sorter("stream.txt") : NULL;
+            streamSorter = sorter;
             cur_model.generate_stream_data(static_scale_factor, stream_scale_factor);
             cur_model.save("saved.txt");
-            output_stream_file();
+            model_snapshot::save(cur_model, "saved.bin");
+            if (sorter != NULL) {
+                output_stream_file(*sorter);
+                streamSorter = NULL;
+                delete sorter;
+            } else {
+                output_ordered_stream_file(arrival);
+            }
             dictionary::destroy_instance();
             return 0;
-        //./watdiv -ts <source-file> <dest-file> <interval>
-        } else if (argc == 5 && argv[1][0] == '-' && argv[1][1] == 't' && argv[1][2] == 's') {
-            unsigned int rate = boost::lexical_cast <unsigned int> (string(argv[4]));
-            string src_file = argv[2];
-            string dest_file = argv[3];
-            attach_timestamp(src_file, dest_file, rate);
-            return 0;
         // ./watdiv -sq <model-file> <static-dataset> <stream-dataset> <max-query-size> <query-count> <constant-per-query-count> <constant-join-vertex-allowed?> <duplicate-edges-allowed?>
         } else if (argc ==10 && strlen(argv[1])==3 && argv[1][0] == '-' && argv[1][1] == 's' && argv[1][2] == 'q'){
-            cur_model.load("saved.txt");
-            vector<triple_st> triple_array = triple_st::parse_file(argv[3]);
-            vector<triple_st> stream_file = triple_st::parse_stream_file(argv[4]);
-            triple_array.insert(triple_array.end(), stream_file.begin(), stream_file.end());
+            load_saved_model(cur_model);
+            // The triples point into the mapped files until the statistics have encoded them...
+            triple_file static_file(argv[3], false);
+            triple_file stream_file(argv[4], true);
+            vector<triple_view_st> triple_array;
+            static_file.parse(triple_array);
+            stream_file.parse(triple_array);
             int maxQSize = boost::lexical_cast<int>(argv[5]);
             int qCount = boost::lexical_cast<int>(argv[6]);
             int constCount = boost::lexical_cast<int>(argv[7]);
+            cur_model.compute_statistics(triple_array, "statistics.bin");
             statistics stat(&cur_model, triple_array, maxQSize, qCount, constCount, argv[8][0] == 't',
                             argv[9][0] == 't', true);
+            string cmd1 = "mkdir workload";
+            char ls_cmd1[100];
+            sprintf(ls_cmd1, cmd1.c_str());
+            system(ls_cmd1);
+
+            string cmd2 = "mkdir workload/csparql";
+            char ls_cmd2[100];
+            sprintf(ls_cmd2, cmd2.c_str());
+            system(ls_cmd2);
+
+            // The queries are written out as soon as they are instantiated, and the CQELS
+            // pass reads them back from the C-SPARQL oracles, so that the workload is never
+            // held in memory...
             //remove("workload.txt");
             ifstream fin("workload.txt");
+            int query_total = 0;
             vector<string> workload;
             string line, qTemplateStr = "";
             while (getline(fin, line)) {
                 if (boost::starts_with(line, "#end")) {
                     query_template_m_t q_template(&cur_model);
                     q_template.parse_str(qTemplateStr);
+                    workload.clear();
                     q_template.instantiate(1, 1, workload);
+                    for (int i = 0; i < workload.size(); i++) {
+                        write_csparql_query(query_total++, workload[i]);
+                    }
                     qTemplateStr = "";
                 } else {
                     qTemplateStr.append(line);
@@ -3055,207 +4292,152 @@ int main(int argc, const char *argv[]) {
                 }
             }
 
-            // obtain a time-based seed:
-            //unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-            //shuffle (workload.begin(), workload.end(), std::default_random_engine(seed));
-            string cmd1 = "mkdir workload";
-            char ls_cmd1[100];
-            sprintf(ls_cmd1, cmd1.c_str());
-            system(ls_cmd1);
-
-            string cmd2 = "mkdir workload/csparql";
-            char ls_cmd2[100];
-            sprintf(ls_cmd2, cmd2.c_str());
-            system(ls_cmd2);
-
-            for (int qid = 0; qid < workload.size(); qid++) {
-                string cmd1 = "mkdir workload/csparql/q_"+to_string(qid);
-                char ls_cmd1[100];
-                sprintf(ls_cmd1, cmd1.c_str());
-                system(ls_cmd1);
-                ofstream fos("workload/csparql/q_"+to_string(qid)+"/oracle.query");
-                fos << workload[qid];
-                cout << workload[qid];
-                fos.close();
-                ifstream fis("workload/csparql/q_"+to_string(qid)+"/oracle.query");
-                ofstream fos2("workload/csparql/q_"+to_string(qid)+"/engine.query");
-                fos2<<"REGISTER QUERY test AS"<<"\n";
-                string temp = "";
-                getline(fis, temp);
-                auto ind = temp.find("WHERE");
-                fos2<<temp.substr(0, ind)<<"\n";
-                fos2<<"FROM STREAM <http://ex.org/streams/test> [RANGE ${WSIZE} STEP ${WSLIDE}]"<<"\n";
-                fos2<<"FROM <http://dsg.uwaterloo.ca/watdiv/knowledge>"<<"\n";
-                fos2<<"WHERE {"<<"\n";
-                while(getline(fis, temp)){
-                    fos2<<temp<<"\n";
-                }
-                fos2.close();
-                fis.close();
-            }
-
             string cmd3 = "mkdir workload/cqels";
             char ls_cmd3[100];
             sprintf(ls_cmd3, cmd3.c_str());
             system(ls_cmd3);
 
-            for (int qid = 0; qid < workload.size(); qid++) {
-                string cmd1 = "mkdir workload/cqels/q_"+to_string(qid);
-                char ls_cmd1[100];
-                sprintf(ls_cmd1, cmd1.c_str());
-                system(ls_cmd1);
-                ofstream fos3("workload/cqels/q_"+to_string(qid)+"/oracle.query");
-                fos3 << workload[qid];
-                cout << workload[qid];
-                fos3.close();
-                ifstream fis("workload/cqels/q_"+to_string(qid)+"/oracle.query");
-                ofstream fos4("workload/cqels/q_"+to_string(qid)+"/engine.query");
-                string temp = "";
-                getline(fis, temp);
-                auto ind = temp.find("WHERE");
-                fos4<<temp.substr(0, ind)<<"\n";
-                fos4<<"FROM NAMED <http://dsg.uwaterloo.ca/watdiv/knowledge>"<<"\n";
-                fos4<<"WHERE{"<<"\n";
-                vector<string> stream_edge;
-                vector<string> static_edge;
-                unordered_set<string> stream_edges{"<http://db.uwaterloo.ca/~galuc/wsdbm/likes>",
-                                                   "<http://db.uwaterloo.ca/~galuc/wsdbm/follows>",
-                                                   "<http://db.uwaterloo.ca/~galuc/wsdbm/subscribes>",
-                                                   "<http://purl.org/goodrelations/offers>",
-                                                   "<http://purl.org/goodrelations/includes>",
-                                                   "<http://schema.org/eligibleRegion>",
-                                                   "<http://db.uwaterloo.ca/~galuc/wsdbm/makesPurchase>",
-                                                   "<http://db.uwaterloo.ca/~galuc/wsdbm/purchaseFor>",
-                                                   "<http://purl.org/stuff/rev#reviewer>",
-                                                   "<http://purl.org/stuff/rev#hasReview>",
-                                                   "<http://purl.org/stuff/rev#rating>",
-                                                   "<http://purl.org/stuff/rev#title>",
-                                                   "<http://purl.org/stuff/rev#text>",
-                                                   "<http://purl.org/stuff/rev#totalVotes>",
-                                                   "<http://purl.org/goodrelations/price>",
-                                                   "<http://db.uwaterloo.ca/~galuc/wsdbm/purchaseDate>",
-                                                   "<http://purl.org/goodrelations/serialNumber>",
-                                                   "<http://purl.org/goodrelations/price>",
-                                                   "<http://purl.org/goodrelations/validFrom>",
-                                                   "<http://purl.org/goodrelations/validThrough>",
-                                                   "<http://schema.org/priceValidUntil>",
-                                                   "<http://schema.org/eligibleQuantity>"};
-
-                while(getline(fis, temp)){
-                    if(temp=="}") continue;
-                    istringstream is(temp);
-                    string item = "";
-                    is>>item>>item;
-                    if(stream_edges.count(item)) stream_edge.push_back(temp);
-                    else static_edge.push_back(temp);
-                }
-                if(!stream_edge.empty()) {
-                    fos4 << "\t" << "STREAM <http://ex.org/streams/test> [RANGE ${WSIZE} SLIDE ${WSLIDE}] {" << "\n";
-                    for (auto item : stream_edge) {
-                        fos4 << "    " << item << "\n";
-                    }
-                    fos4 << "\t" << "}" << "\n";
-                }
-                if(!static_edge.empty()) {
-                    fos4 << "\t" << "GRAPH<http://dsg.uwaterloo.ca/watdiv/knowledge>{" << "\n";
-                    for (auto item : static_edge) {
-                        fos4 << "    " << item << "\n";
-                    }
-                    fos4 << "\t" << "}" << "\n";
-                }
-                fos4<<"}";
+            for (int qid = 0; qid < query_total; qid++) {
+                ifstream fis("workload/csparql/q_"+to_string(qid)+"/oracle.query");
+                string query((istreambuf_iterator<char>(fis)), istreambuf_iterator<char>());
+                fis.close();
+                write_cqels_query(qid, query);
             }
 
             dictionary::destroy_instance();
             return 0;
-        } else if (argc == 4 && argv[1][0] == '-' && argv[1][1] == 'd') {
+        //./watdiv -d <model-file> <scale-factor> [-j <threads>] [-o <output>] [-z <zipf-table-limit>]
+        } else if (argc >= 4 && argc % 2 == 0 && strcmp(argv[1], "-d") == 0) {
             unsigned int scale_factor = boost::lexical_cast<unsigned int>(string(argv[3]));
-            cur_model.generate(scale_factor);
+            unsigned int thread_count = 0;
+            string output_target = "-";
+            for (int i = 4; i < argc; i += 2) {
+                if (strcmp(argv[i], "-j") == 0) {
+                    thread_count = boost::lexical_cast<unsigned int>(string(argv[i + 1]));
+                } else if (strcmp(argv[i], "-o") == 0) {
+                    output_target = argv[i + 1];
+                } else if (strcmp(argv[i], "-z") == 0) {
+                    zipf_sampler::set_table_limit(boost::lexical_cast<unsigned int>(string(argv[i + 1])));
+                } else {
+                    cerr << "[main()]\tUnknown option '" << argv[i] << "'..." << "\n";
+                    exit(0);
+                }
+            }
+            output_sink *sink = output_sink::open(output_target);
+            if (thread_count == 0) {
+                cur_model.generate(scale_factor, *sink);
+            } else {
+                cur_model.generate(scale_factor, thread_count, *sink);
+            }
+            sink->close();
+            sink->report();
+            delete sink;
             cur_model.save("saved.txt");
+            model_snapshot::save(cur_model, "saved.bin");
             //statistics stat (&cur_model, triples);
             dictionary::destroy_instance();
             return 0;
-        } else if (argc == 5 && argv[1][0] == '-' && argv[1][1] == 'q') {
-            cur_model.load("saved.txt");
+        } else if (argc >= 5 && argv[1][0] == '-' && argv[1][1] == 'q') {
+            // ./watdiv -q <model-file> [<query-file> ...] <query-count> <recurrence-factor> [-j <threads>] [-o <output>] [-pull] [-seed <seed>]
+            // Without query files, the templates are read from stdin, each one ending with #end.
+            // Queries are written as they are instantiated, in parallel with -j, and on the
+            // requests of the consumer with -pull (see workload_writer). The workload only
+            // depends on the seed (1024 by default), not on -j or -pull...
+            if (query_pull && argc == 5 && query_output_target.compare(0, 4, "tcp:") != 0) {
+                cerr << "[main]\t-pull needs a tcp: output when the templates are read from stdin..." << "\n";
+                exit(0);
+            }
+            load_saved_model(cur_model);
             unsigned int query_count = boost::lexical_cast<unsigned int>(string(argv[(argc - 2)]));
             unsigned int recurrence_factor = boost::lexical_cast<unsigned int>(string(argv[(argc - 1)]));
 
-            vector<string> workload;
-            string line, qTemplateStr = "";
-            while (getline(cin, line)) {
-                if (boost::starts_with(line, "#end")) {
-                    query_template_m_t q_template(&cur_model);
-                    q_template.parse_str(qTemplateStr);
-                    q_template.instantiate(query_count, recurrence_factor, workload);
-                    qTemplateStr = "";
-                } else {
-                    qTemplateStr.append(line);
-                    qTemplateStr.append("\n");
+            vector<query_template_m_t *> templates;
+            if (argc == 5) {
+                string line, qTemplateStr = "";
+                while (getline(cin, line)) {
+                    if (boost::starts_with(line, "#end")) {
+                        templates.push_back(new query_template_m_t(&cur_model));
+                        templates.back()->parse_str(qTemplateStr);
+                        qTemplateStr = "";
+                    } else {
+                        qTemplateStr.append(line);
+                        qTemplateStr.append("\n");
+                    }
+                }
+            } else {
+                for (int template_id = 3; template_id < (argc - 2); template_id++) {
+                    templates.push_back(new query_template_m_t(&cur_model));
+                    templates.back()->parse(argv[template_id]);
                 }
             }
 
-            // obtain a time-based seed:
-            //unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-            //shuffle (workload.begin(), workload.end(), std::default_random_engine(seed));
-            for (int qid = 0; qid < workload.size(); qid++) {
-                cout << workload[qid];
+            output_sink *sink = output_sink::open(query_output_target);
+            if (query_thread_count > 0 && !query_pull) {
+                query_template_m_t::instantiate(templates, query_count, recurrence_factor, query_thread_count, *sink);
+            } else {
+                if (query_thread_count > 0) {
+                    cerr << "[main]\tIgnoring -j, since -pull instantiates the queries on request..." << "\n";
+                }
+                workload_writer writer (sink, query_pull);
+                for (vector<query_template_m_t *>::iterator itr = templates.begin(); itr != templates.end(); itr++) {
+                    if (!(*itr)->instantiate(itr - templates.begin(), query_count, recurrence_factor, writer)) {
+                        break;
+                    }
+                }
+                writer.flush();
             }
-
-            dictionary::destroy_instance();
-            return 0;
-        } else if (argc >= 6 && argv[1][0] == '-' && argv[1][1] == 'q') {
-            cur_model.load("saved.txt");
-            unsigned int query_count = boost::lexical_cast<unsigned int>(string(argv[(argc - 2)]));
-            unsigned int recurrence_factor = boost::lexical_cast<unsigned int>(string(argv[(argc - 1)]));
-            vector<string> workload;
-            for (int template_id = 3; template_id < (argc - 2); template_id++) {
-                const char *query_filename = argv[template_id];
-                query_template_m_t q_template(&cur_model);
-                q_template.parse(query_filename);
-                q_template.instantiate(query_count, recurrence_factor, workload);
+            sink->close();
+            delete sink;
+            for (vector<query_template_m_t *>::iterator itr = templates.begin(); itr != templates.end(); itr++) {
+                delete *itr;
             }
 
-            /// obtain a time-based seed:
-            //unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-            //shuffle (workload.begin(), workload.end(), std::default_random_engine(seed));
-
-            for (int qid = 0; qid < workload.size(); qid++) {
-                cout << workload[qid];
-            }
             dictionary::destroy_instance();
             return 0;
         } else if (argc == 6 && argv[1][0] == '-' && argv[1][1] == 's') {
-            cur_model.load("saved.txt");
-            vector<triple_st> triple_array = triple_st::parse_file(argv[3]);
+            load_saved_model(cur_model);
+            triple_file static_file(argv[3], false);
+            vector<triple_view_st> triple_array;
+            static_file.parse(triple_array);
             int maxQSize = boost::lexical_cast<int>(argv[4]);
             int qCount = boost::lexical_cast<int>(argv[5]);
+            cur_model.compute_statistics(triple_array, "statistics.bin");
             statistics stat(&cur_model, triple_array, maxQSize, qCount, 1, false, false, false);
             dictionary::destroy_instance();
             return 0;
         } else if (argc == 7 && argv[1][0] == '-' && argv[1][1] == 's') {
-            cur_model.load("saved.txt");
-            vector<triple_st> triple_array = triple_st::parse_file(argv[3]);
+            load_saved_model(cur_model);
+            triple_file static_file(argv[3], false);
+            vector<triple_view_st> triple_array;
+            static_file.parse(triple_array);
             int maxQSize = boost::lexical_cast<int>(argv[4]);
             int qCount = boost::lexical_cast<int>(argv[5]);
             int constCount = boost::lexical_cast<int>(argv[6]);
+            cur_model.compute_statistics(triple_array, "statistics.bin");
             statistics stat(&cur_model, triple_array, maxQSize, qCount, constCount, false, false, false);
             dictionary::destroy_instance();
             return 0;
         } else if (argc == 8 && argv[1][0] == '-' && argv[1][1] == 's') {
-            cur_model.load("saved.txt");
-            vector<triple_st> triple_array = triple_st::parse_file(argv[3]);
+            load_saved_model(cur_model);
+            triple_file static_file(argv[3], false);
+            vector<triple_view_st> triple_array;
+            static_file.parse(triple_array);
             int maxQSize = boost::lexical_cast<int>(argv[4]);
             int qCount = boost::lexical_cast<int>(argv[5]);
             int constCount = boost::lexical_cast<int>(argv[6]);
+            cur_model.compute_statistics(triple_array, "statistics.bin");
             statistics stat(&cur_model, triple_array, maxQSize, qCount, constCount, argv[7][0] == 't', false, false);
             dictionary::destroy_instance();
             return 0;
         } else if (argc == 9 && argv[1][0] == '-' && argv[1][1] == 's') {
-            cur_model.load("saved.txt");
-            vector<triple_st> triple_array = triple_st::parse_file(argv[3]);
+            load_saved_model(cur_model);
+            triple_file static_file(argv[3], false);
+            vector<triple_view_st> triple_array;
+            static_file.parse(triple_array);
             int maxQSize = boost::lexical_cast<int>(argv[4]);
             int qCount = boost::lexical_cast<int>(argv[5]);
             int constCount = boost::lexical_cast<int>(argv[6]);
+            cur_model.compute_statistics(triple_array, "statistics.bin");
             statistics stat(&cur_model, triple_array, maxQSize, qCount, constCount, argv[7][0] == 't',
                             argv[8][0] == 't', false);
             dictionary::destroy_instance();
@@ -3264,18 +4446,32 @@ int main(int argc, const char *argv[]) {
             volatility_gen::test();
             dictionary::destroy_instance();
             return 0;
+        } else if (argc == 3 && strcmp(argv[1], "-lb") == 0) {
+            model_snapshot::benchmark(cur_model, "saved.txt", "saved.bin");
+            dictionary::destroy_instance();
+            return 0;
+        } else if (argc == 2 && argv[1][0] == '-' && argv[1][1] == 'z' && argv[1][2] == 'b') {
+            zipf_sampler::benchmark();
+            dictionary::destroy_instance();
+            return 0;
         }
     }
 
     cout << "Usage:::\t./watdiv -ts <source-file> <dest-file> <stream-rate>" << "\n";
-    cout << "Usage:::\t./watdiv -sd <model-file> <static-scale-factor> <stream-scale-factor> <rand-seed>" << "\n";
+    cout << "Usage:::\t./watdiv -play <stream-file> <triples-per-second> [-o <output-file>|<fifo>|tcp:<port>] [-b <seconds>:<factor>,...] [-i <report-interval>]" << "\n";
+    cout << "Usage:::\t./watdiv -sd <model-file> <static-scale-factor> <stream-scale-factor> <rand-seed> [-t uniform|poisson]" << "\n";
     cout << "Usage:::\t./watdiv -sq <model-file> <static-dataset> <stream-dataset> <max-query-size> <query-count> <constant-per-query-count> <constant-join-vertex-allowed?> <duplicate-edges-allowed?>" << "\n";
     cout << "Usage:::\t./watdiv -d <model-file> <scale-factor>" << "\n";
+    cout << "        \t./watdiv -d <model-file> <scale-factor> [-j <threads>] [-o <output-file>|'|<command>'] [-z <zipf-table-limit>]" << "\n";
     cout << "Usage:::\t./watdiv -q <model-file> <query-count> <recurrence-factor>" << "\n";
     cout << "        \t./watdiv -q <model-file> <query-file> <query-count> <recurrence-factor>" << "\n";
+    cout << "        \t./watdiv -q <model-file> [<query-file> ...] <query-count> <recurrence-factor> [-j <threads>] [-o <output-file>|<output-file>.gz|'|<command>'|tcp:<port>] [-pull] [-seed <seed>]" << "\n";
     cout << "Usage:::\t./watdiv -s <model-file> <dataset-file> <max-query-size> <query-count>" << "\n";
     cout << "        \t./watdiv -s <model-file> <dataset-file> <max-query-size> <query-count> <constant-per-query-count>" << "\n";
     cout << "        \t./watdiv -s <model-file> <dataset-file> <max-query-size> <query-count> <constant-per-query-count> <constant-join-vertex-allowed?>" << "\n";
+    cout << "Usage:::\t./watdiv -st <statistics-file>" << "\n";
+    cout << "Usage:::\t./watdiv -lb <model-file>" << "\n";
+    cout << "Usage:::\t./watdiv -zb" << "\n";
     //cout<<"Usage:::\t./watdiv -x"<<"\n";
     //cout<<"        \t./watdiv -s <model-file> <dataset-file> <max-query-size> <query-count> <constant-per-query-count> <constant-join-vertex-allowed?> <duplicate-edges-allowed?>"<<"\n";
     dictionary::destroy_instance();
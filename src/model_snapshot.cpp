@@ -0,0 +1,362 @@
+#include "../include/model_snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static const char MAGIC[8] = {'W', 'D', 'M', 'O', 'D', 'E', 'L', '\0'};
+static const uint32_t VERSION = 1;
+
+typedef boost::dynamic_bitset<>::block_type block_t;
+static_assert(sizeof(block_t) == sizeof(uint64_t), "bitmap sets are stored as 64-bit words");
+
+static size_t align(size_t offset){
+    return (offset + 7) & ~((size_t) 7);
+}
+
+static void pad(string & data){
+    data.resize(align(data.size()), '\0');
+}
+
+static snapshot_ref_st add_string(string & strings, const string & value){
+    snapshot_ref_st result;
+    result._offset = strings.size();
+    result._length = value.size();
+    strings.append(value);
+    return result;
+}
+
+// Appends the members of bits to data in the smallest encoding, and describes them in set...
+static void encode_set(const boost::dynamic_bitset<> & bits, snapshot_set_st & set, string & data){
+    vector<uint32_t> ids;
+    uint64_t run_count = 0;
+    for (size_t id = bits.find_first(); id != boost::dynamic_bitset<>::npos; id = bits.find_next(id)){
+        if (ids.empty() || ids.back() + 1 != id){
+            run_count++;
+        }
+        ids.push_back(id);
+    }
+    uint64_t word_count = ids.empty() ? 0 : (ids.back() / 64 + 1);
+    uint64_t bitmap_length = word_count * sizeof(uint64_t);
+    uint64_t runs_length = run_count * 2 * sizeof(uint32_t);
+    uint64_t array_length = ids.size() * sizeof(uint32_t);
+
+    set._cardinality = ids.size();
+    set._bit_count = ids.empty() ? 0 : (ids.back() + 1);
+    set._data_offset = data.size();
+    if (bitmap_length <= runs_length && bitmap_length <= array_length){
+        set._encoding = SET_ENCODINGS::BITMAP;
+        vector<block_t> blocks;
+        boost::to_block_range(bits, back_inserter(blocks));
+        blocks.resize(word_count);
+        data.append((const char *) blocks.data(), bitmap_length);
+    } else if (runs_length <= array_length){
+        set._encoding = SET_ENCODINGS::RUNS;
+        vector<uint32_t> runs;
+        for (size_t i = 0; i < ids.size(); i++){
+            if (i == 0 || ids[i - 1] + 1 != ids[i]){
+                runs.push_back(ids[i]);
+                runs.push_back(0);
+            }
+            runs.back()++;
+        }
+        data.append((const char *) runs.data(), runs_length);
+    } else {
+        set._encoding = SET_ENCODINGS::ARRAY;
+        data.append((const char *) ids.data(), array_length);
+    }
+    set._data_length = data.size() - set._data_offset;
+    pad(data);
+}
+
+void model_snapshot::save(const model & mdl, const char * filename){
+    const type_map & t_map = mdl._type_map;
+    string strings, data;
+
+    vector<snapshot_cursor_st> cursors;
+    for (map<string, unsigned int>::const_iterator itr = mdl._id_cursor_map.begin(); itr != mdl._id_cursor_map.end(); itr++){
+        snapshot_cursor_st cursor;
+        cursor._type = add_string(strings, itr->first);
+        cursor._value = itr->second;
+        cursor._padding = 0;
+        cursors.push_back(cursor);
+    }
+    vector<snapshot_ref_st> types, prefixes;
+    for (unsigned int t = 0; t < t_map.type_count(); t++){
+        types.push_back(add_string(strings, t_map.type(t)));
+    }
+    for (unsigned int p = 0; p < t_map.prefix_count(); p++){
+        prefixes.push_back(add_string(strings, t_map.prefix(p)));
+    }
+    vector<snapshot_set_st> sets;
+    for (unsigned int t = 0; t < t_map.type_count(); t++){
+        for (unsigned int p = 0; p < t_map.prefix_count(); p++){
+            const boost::dynamic_bitset<> * bits = t_map.members(p, t);
+            if (bits == NULL || bits->none()){
+                continue;
+            }
+            snapshot_set_st set;
+            set._type_index = t;
+            set._prefix_index = p;
+            encode_set(*bits, set, data);
+            sets.push_back(set);
+        }
+    }
+    // Sorted, so that equal states give equal files...
+    vector<snapshot_member_st> members;
+    const unordered_map<string, unordered_set<string> > & other_members = t_map.other_members();
+    vector<pair<string, string> > pairs;
+    for (unordered_map<string, unordered_set<string> >::const_iterator itr1 = other_members.begin(); itr1 != other_members.end(); itr1++){
+        for (unordered_set<string>::const_iterator itr2 = itr1->second.begin(); itr2 != itr1->second.end(); itr2++){
+            pairs.push_back(pair<string, string>(itr1->first, *itr2));
+        }
+    }
+    sort(pairs.begin(), pairs.end());
+    for (vector<pair<string, string> >::const_iterator itr = pairs.begin(); itr != pairs.end(); itr++){
+        snapshot_member_st member;
+        member._type = add_string(strings, itr->first);
+        member._instance = add_string(strings, itr->second);
+        members.push_back(member);
+    }
+
+    snapshot_header_st header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header._magic, MAGIC, sizeof(MAGIC));
+    header._version = VERSION;
+    header._cursor_count = cursors.size();
+    header._type_count = types.size();
+    header._prefix_count = prefixes.size();
+    header._set_count = sets.size();
+    header._member_count = members.size();
+    header._cursor_offset = align(sizeof(header));
+    header._type_offset = align(header._cursor_offset + cursors.size() * sizeof(snapshot_cursor_st));
+    header._prefix_offset = align(header._type_offset + types.size() * sizeof(snapshot_ref_st));
+    header._set_offset = align(header._prefix_offset + prefixes.size() * sizeof(snapshot_ref_st));
+    header._member_offset = align(header._set_offset + sets.size() * sizeof(snapshot_set_st));
+    header._data_offset = align(header._member_offset + members.size() * sizeof(snapshot_member_st));
+    header._string_offset = align(header._data_offset + data.size());
+    header._file_size = header._string_offset + strings.size();
+
+    string content;
+    content.reserve(header._file_size);
+    content.append((const char *) &header, sizeof(header));
+    pad(content);
+    content.append((const char *) cursors.data(), cursors.size() * sizeof(snapshot_cursor_st));
+    pad(content);
+    content.append((const char *) types.data(), types.size() * sizeof(snapshot_ref_st));
+    pad(content);
+    content.append((const char *) prefixes.data(), prefixes.size() * sizeof(snapshot_ref_st));
+    pad(content);
+    content.append((const char *) sets.data(), sets.size() * sizeof(snapshot_set_st));
+    pad(content);
+    content.append((const char *) members.data(), members.size() * sizeof(snapshot_member_st));
+    pad(content);
+    content.append(data);
+    pad(content);
+    content.append(strings);
+
+    ofstream fos(filename, ios::out | ios::binary | ios::trunc);
+    fos.write(content.data(), content.size());
+    fos.close();
+    if (!fos){
+        cerr << "[model_snapshot::save()]\tFailed to write '" << filename << "'..." << "\n";
+        exit(0);
+    }
+}
+
+static void corrupt(const char * filename){
+    cerr << "[model_snapshot::load()]\t'" << filename << "' is truncated or corrupt..." << "\n";
+    exit(0);
+}
+
+bool model_snapshot::load(model & mdl, const char * filename){
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(snapshot_header_st)){
+        ::close(fd);
+        return false;
+    }
+    size_t size = file_stat.st_size;
+    void * mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED){
+        cerr << "[model_snapshot::load()]\tFailed to map '" << filename << "': " << strerror(errno) << "\n";
+        exit(0);
+    }
+    const char * base = (const char *) mapping;
+    const snapshot_header_st & header = *((const snapshot_header_st *) base);
+    if (memcmp(header._magic, MAGIC, sizeof(MAGIC)) != 0 || header._version != VERSION){
+        munmap(mapping, size);
+        return false;
+    }
+    if (header._file_size != size || header._string_offset > size || header._data_offset > header._string_offset ||
+        header._cursor_offset + (uint64_t) header._cursor_count * sizeof(snapshot_cursor_st) > header._type_offset ||
+        header._type_offset + (uint64_t) header._type_count * sizeof(snapshot_ref_st) > header._prefix_offset ||
+        header._prefix_offset + (uint64_t) header._prefix_count * sizeof(snapshot_ref_st) > header._set_offset ||
+        header._set_offset + (uint64_t) header._set_count * sizeof(snapshot_set_st) > header._member_offset ||
+        header._member_offset + (uint64_t) header._member_count * sizeof(snapshot_member_st) > header._data_offset){
+        corrupt(filename);
+    }
+    const char * strings = base + header._string_offset;
+    uint64_t string_length = size - header._string_offset;
+    auto get_string = [&](const snapshot_ref_st & ref) {
+        if ((uint64_t) ref._offset + ref._length > string_length){
+            corrupt(filename);
+        }
+        return string(strings + ref._offset, ref._length);
+    };
+
+    mdl._id_cursor_map.clear();
+    mdl._type_map.clear();
+    const snapshot_cursor_st * cursors = (const snapshot_cursor_st *) (base + header._cursor_offset);
+    for (uint32_t i = 0; i < header._cursor_count; i++){
+        mdl._id_cursor_map.insert(pair<string, unsigned int>(get_string(cursors[i]._type), cursors[i]._value));
+    }
+
+    // The model may have interned its types and prefixes in another order...
+    type_map & t_map = mdl._type_map;
+    vector<unsigned int> type_ids, prefix_ids;
+    const snapshot_ref_st * types = (const snapshot_ref_st *) (base + header._type_offset);
+    for (uint32_t i = 0; i < header._type_count; i++){
+        type_ids.push_back(t_map.intern_type(get_string(types[i])));
+    }
+    const snapshot_ref_st * prefixes = (const snapshot_ref_st *) (base + header._prefix_offset);
+    for (uint32_t i = 0; i < header._prefix_count; i++){
+        prefix_ids.push_back(t_map.intern_prefix(get_string(prefixes[i])));
+    }
+
+    const snapshot_set_st * sets = (const snapshot_set_st *) (base + header._set_offset);
+    const char * data = base + header._data_offset;
+    uint64_t data_length = header._string_offset - header._data_offset;
+    for (uint32_t i = 0; i < header._set_count; i++){
+        const snapshot_set_st & set = sets[i];
+        if (set._type_index >= header._type_count || set._prefix_index >= header._prefix_count ||
+            set._data_offset % 8 != 0 || set._data_offset + set._data_length > data_length){
+            corrupt(filename);
+        }
+        boost::dynamic_bitset<> bits;
+        switch (set._encoding){
+            case SET_ENCODINGS::BITMAP: {
+                const block_t * blocks = (const block_t *) (data + set._data_offset);
+                bits.append(blocks, blocks + set._data_length / sizeof(block_t));
+                // The blocks are padded to whole words, the set ends at _bit_count...
+                if (bits.size() < set._bit_count){
+                    corrupt(filename);
+                }
+                bits.resize(set._bit_count);
+                break;
+            }
+            case SET_ENCODINGS::RUNS: {
+                const uint32_t * runs = (const uint32_t *) (data + set._data_offset);
+                bits.resize(set._bit_count);
+                for (uint64_t r = 0; r + 1 < set._data_length / sizeof(uint32_t); r += 2){
+                    if ((uint64_t) runs[r] + runs[r + 1] > set._bit_count){
+                        corrupt(filename);
+                    }
+                    bits.set(runs[r], runs[r + 1], true);
+                }
+                break;
+            }
+            case SET_ENCODINGS::ARRAY: {
+                const uint32_t * ids = (const uint32_t *) (data + set._data_offset);
+                bits.resize(set._bit_count);
+                for (uint64_t j = 0; j < set._data_length / sizeof(uint32_t); j++){
+                    if (ids[j] >= set._bit_count){
+                        corrupt(filename);
+                    }
+                    bits.set(ids[j]);
+                }
+                break;
+            }
+            default: {
+                corrupt(filename);
+            }
+        }
+        t_map.assign(prefix_ids[set._prefix_index], type_ids[set._type_index], bits);
+    }
+
+    const snapshot_member_st * members = (const snapshot_member_st *) (base + header._member_offset);
+    for (uint32_t i = 0; i < header._member_count; i++){
+        t_map.insert(get_string(members[i]._instance), get_string(members[i]._type));
+    }
+    t_map.build_index();
+    munmap(mapping, size);
+    return true;
+}
+
+// Type assertions as sorted "type instance" lines, independent of the interning order...
+static void canonical_state(const model & mdl, vector<string> & result){
+    result.clear();
+    for (map<string, unsigned int>::const_iterator itr = mdl._id_cursor_map.begin(); itr != mdl._id_cursor_map.end(); itr++){
+        stringstream line;
+        line << "#cursor " << itr->first << " " << itr->second;
+        result.push_back(line.str());
+    }
+    vector<string> lines;
+    mdl._type_map.to_str(lines);
+    for (vector<string>::const_iterator itr1 = lines.begin(); itr1 != lines.end(); itr1++){
+        stringstream parser(*itr1);
+        string type, instance;
+        parser >> type;
+        while (parser >> instance){
+            result.push_back(type + " " + instance);
+        }
+    }
+    sort(result.begin(), result.end());
+}
+
+static double elapsed_seconds(const chrono::steady_clock::time_point & start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static size_t file_size(const char * filename){
+    struct stat file_stat;
+    return (stat(filename, &file_stat) == 0) ? (size_t) file_stat.st_size : 0;
+}
+
+void model_snapshot::benchmark(model & mdl, const char * text_filename, const char * snapshot_filename){
+    const int ROUND_COUNT = 3;
+    double text_seconds = 0.0, snapshot_seconds = 0.0, save_seconds = 0.0;
+    vector<string> text_state, snapshot_state;
+    for (int round = 0; round < ROUND_COUNT; round++){
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        mdl.load(text_filename);
+        double seconds = elapsed_seconds(start);
+        text_seconds = (round == 0) ? seconds : min(text_seconds, seconds);
+    }
+    canonical_state(mdl, text_state);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    save(mdl, snapshot_filename);
+    save_seconds = elapsed_seconds(start);
+    for (int round = 0; round < ROUND_COUNT; round++){
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (!load(mdl, snapshot_filename)){
+            cerr << "[model_snapshot::benchmark()]\tFailed to load '" << snapshot_filename << "'..." << "\n";
+            exit(0);
+        }
+        double seconds = elapsed_seconds(start);
+        snapshot_seconds = (round == 0) ? seconds : min(snapshot_seconds, seconds);
+    }
+    canonical_state(mdl, snapshot_state);
+
+    cout << "assertions" << "\t" << "text_bytes" << "\t" << "text_load_s"
+         << "\t" << "snapshot_bytes" << "\t" << "snapshot_save_s" << "\t" << "snapshot_load_s"
+         << "\t" << "speedup" << "\t" << "identical" << "\n";
+    cout << text_state.size() << "\t" << file_size(text_filename) << "\t" << text_seconds
+         << "\t" << file_size(snapshot_filename) << "\t" << save_seconds << "\t" << snapshot_seconds
+         << "\t" << (text_seconds / snapshot_seconds) << "\t" << ((text_state == snapshot_state) ? "yes" : "no") << "\n";
+}
@@ -0,0 +1,270 @@
+#include "../include/output_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <iostream>
+
+namespace bpt = boost::posix_time;
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+output_buffer::output_buffer(){
+    _size = 0;
+    _flush_threshold = 0;
+    _sink = NULL;
+}
+
+output_buffer::output_buffer(output_sink * sink, size_t flush_threshold){
+    _size = 0;
+    _flush_threshold = flush_threshold;
+    _sink = sink;
+    _data.resize(flush_threshold + 4096);
+}
+
+output_buffer::~output_buffer(){
+    flush();
+}
+
+void output_buffer::reserve(size_t length){
+    if (_size + length > _data.size()){
+        _data.resize(max(_data.size() * 2, _size + length + 4096));
+    }
+}
+
+void output_buffer::append(char c){
+    reserve(1);
+    _data[_size++] = c;
+}
+
+void output_buffer::append(const char * data, size_t length){
+    reserve(length);
+    memcpy(&_data[_size], data, length);
+    _size += length;
+    if (_sink != NULL && _size >= _flush_threshold){
+        flush();
+    }
+}
+
+void output_buffer::append(const string & str){
+    append(str.data(), str.size());
+}
+
+void output_buffer::append_uint(unsigned long long value){
+    char digits[20];
+    append(digits, format_uint(value, digits));
+}
+
+// Formats value into result (at least 20 bytes), two digits at a time from the back
+// of a scratch buffer, and returns the number of digits...
+size_t output_buffer::format_uint(unsigned long long value, char * result){
+    char scratch[20];
+    char * cursor = scratch + sizeof(scratch);
+    while (value >= 100){
+        unsigned int pair = (unsigned int) (value % 100) * 2;
+        value /= 100;
+        *--cursor = DIGIT_PAIRS[pair + 1];
+        *--cursor = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10){
+        unsigned int pair = (unsigned int) value * 2;
+        *--cursor = DIGIT_PAIRS[pair + 1];
+        *--cursor = DIGIT_PAIRS[pair];
+    } else {
+        *--cursor = (char) ('0' + value);
+    }
+    size_t length = scratch + sizeof(scratch) - cursor;
+    memcpy(result, cursor, length);
+    return length;
+}
+
+// Appends <prefix><id>...
+void output_buffer::append_iri(const string & prefix, unsigned long long id){
+    append('<');
+    append(prefix);
+    append_uint(id);
+    append('>');
+}
+
+void output_buffer::flush(){
+    if (_sink != NULL && _size > 0){
+        _sink->write(data(), _size);
+        _size = 0;
+    }
+}
+
+output_sink::output_sink(){
+    _fd = -1;
+    _pipe = NULL;
+    _owns_fd = false;
+    _bytes_written = 0;
+    _start_time = bpt::microsec_clock::universal_time();
+}
+
+output_sink::~output_sink(){
+    close();
+}
+
+void output_sink::write(const char * data, size_t length){
+    while (length > 0){
+        ssize_t count = ::write(_fd, data, length);
+        if (count < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            cerr << "[output_sink::write()]\tFailed to write to '" << _target << "': " << strerror(errno) << "\n";
+            exit(0);
+        }
+        data += count;
+        length -= count;
+        _bytes_written += count;
+    }
+}
+
+// Gathers the buffers into as few writev(2) calls as possible...
+void output_sink::write(const vector<const output_buffer *> & buffers){
+    vector<struct iovec> iov;
+    for (vector<const output_buffer *>::const_iterator itr = buffers.begin(); itr != buffers.end(); itr++){
+        if (!(*itr)->empty()){
+            struct iovec entry;
+            entry.iov_base = (void *) (*itr)->data();
+            entry.iov_len = (*itr)->size();
+            iov.push_back(entry);
+        }
+    }
+    size_t first = 0;
+    while (first < iov.size()){
+        int count = (int) min(iov.size() - first, (size_t) IOV_MAX);
+        ssize_t written = ::writev(_fd, &iov[first], count);
+        if (written < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            cerr << "[output_sink::write()]\tFailed to write to '" << _target << "': " << strerror(errno) << "\n";
+            exit(0);
+        }
+        _bytes_written += written;
+        // Skip the fully written buffers, and resume a partially written one...
+        while (first < iov.size() && (size_t) written >= iov[first].iov_len){
+            written -= iov[first].iov_len;
+            first++;
+        }
+        if (first < iov.size()){
+            iov[first].iov_base = (char *) iov[first].iov_base + written;
+            iov[first].iov_len -= written;
+        }
+    }
+}
+
+void output_sink::close(){
+    if (_pipe != NULL){
+        pclose(_pipe);
+        _pipe = NULL;
+    } else if (_owns_fd && _fd >= 0){
+        ::close(_fd);
+    }
+    _fd = -1;
+    _owns_fd = false;
+}
+
+// Reports the output throughput in MB/s...
+void output_sink::report() const{
+    bpt::ptime end_time(bpt::microsec_clock::universal_time());
+    double seconds = (double) (end_time - _start_time).total_microseconds() / 1000000.0;
+    double megabytes = (double) _bytes_written / (1024.0 * 1024.0);
+    cerr << "[output_sink]\t" << _bytes_written << " bytes written to '" << _target << "' in " << seconds << " s";
+    if (seconds > 0.0){
+        cerr << " (" << (megabytes / seconds) << " MB/s)";
+    }
+    cerr << "\n";
+}
+
+// Listens on 127.0.0.1:<port>, and returns the socket of the first client that connects...
+static int accept_tcp_client(const string & port){
+    char * end = NULL;
+    long port_number = strtol(port.c_str(), &end, 10);
+    if (port.empty() || *end != '\0' || port_number <= 0 || port_number > 65535){
+        cerr << "[output_sink::open()]\tInvalid port '" << port << "'..." << "\n";
+        exit(0);
+    }
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t) port_number);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 1) != 0){
+        cerr << "[output_sink::open()]\tFailed to listen on 127.0.0.1:" << port << ": " << strerror(errno) << "\n";
+        exit(0);
+    }
+    cerr << "[output_sink::open()]\tWaiting for a connection on 127.0.0.1:" << port << "..." << "\n";
+    int client = -1;
+    while ((client = accept(listener, NULL, NULL)) < 0 && errno == EINTR);
+    if (client < 0){
+        cerr << "[output_sink::open()]\tFailed to accept a connection: " << strerror(errno) << "\n";
+        exit(0);
+    }
+    ::close(listener);
+    // Triples are written in small batches, which should not wait for more data...
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return client;
+}
+
+void output_sink::open_pipe(const string & command){
+    _pipe = popen(command.c_str(), "w");
+    if (_pipe == NULL){
+        cerr << "[output_sink::open()]\tFailed to start '" << command << "'..." << "\n";
+        exit(0);
+    }
+    _fd = fileno(_pipe);
+}
+
+output_sink * output_sink::open(const string & target){
+    output_sink * result = new output_sink();
+    result->_target = target;
+    if (target.empty() || target.compare("-") == 0){
+        result->_target = "stdout";
+        result->_fd = STDOUT_FILENO;
+    } else if (target.compare(0, 4, "tcp:") == 0){
+        result->_fd = accept_tcp_client(target.substr(4));
+        result->_owns_fd = true;
+    } else if (target[0] == '|'){
+        result->open_pipe(target.substr(1));
+    } else if (target.size() > 3 && target.compare(target.size() - 3, 3, ".gz") == 0){
+        // The file is written by gzip(1), with the name quoted for the shell...
+        string quoted = "'";
+        for (size_t i = 0; i < target.size(); i++){
+            quoted.append((target[i] == '\'') ? "'\\''" : string(1, target[i]));
+        }
+        quoted.append("'");
+        result->open_pipe("gzip -c > " + quoted);
+    } else {
+        result->_fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (result->_fd < 0){
+            cerr << "[output_sink::open()]\tFailed to open '" << target << "': " << strerror(errno) << "\n";
+            exit(0);
+        }
+        result->_owns_fd = true;
+    }
+    return result;
+}
@@ -85,7 +85,7 @@ bool statistics_st::operator<(const statistics_st &rhs) const {
     }
 }
 
-statistics::statistics(const model *mdl, const vector<triple_st> &triple_array, int maxQSize, int qCount,
+statistics::statistics(const model *mdl, vector<triple_view_st> &triple_array, int maxQSize, int qCount,
                        int constCount, bool constJoinVertexAllowed, bool dupEdgesAllowed, bool isStream) {
     srand(time(NULL));
     _model = mdl;
@@ -678,13 +678,9 @@ void statistics::print_stats() const{
 }
 */
 
-void statistics::index_triples(const vector<triple_st> &triple_array) {
-    for (int i = 0; i < triple_array.size(); i++) {
-        _spo_index.push_back(triple_array[i]);
-        _ops_index.push_back(triple_array[i]);
-    }
-    sort(_spo_index.begin(), _spo_index.end(), s_compare());
-    sort(_ops_index.begin(), _ops_index.end(), o_compare());
+// The store interns the terms and releases the triples, so that the indexes do not depend on the mapped triple files...
+void statistics::index_triples(vector<triple_view_st> &triple_array) {
+    _store.build(triple_array);
 }
 
 string statistics::get_key(string entity, string predicate, bool direction,
@@ -732,39 +728,25 @@ pair<double, double> statistics::sample (string entity, DISTRIBUTION_TYPES::enum
     } else {
         generator = new mapping_m_t (string("?x"), entity, distribution);
     }
+    generator->compile(_model->_namespace_map);
     double pr_exists = 0.0;
     double mean_card = 0.0;
     unsigned int instance_count = 0;
     generator->generate(*_model, instance_count);
     int sampling_factor = instance_count * 5;
+    uint32_t predicate_id = _store.dictionary().lookup(_model->_namespace_map.replace(predicate));
     for (int i=0; i<sampling_factor; i++){
         int cardinality = 0;
-        string min_subject = "", min_predicate = "", min_object = "";
-        min_predicate.append("<");
-        min_predicate.append(_model->_namespace_map.replace(predicate));
-        min_predicate.append(">");
         string rdf_term = generator->generate(*_model);
-        if (direction){
-            min_subject.append(rdf_term);
-            triple_st min_range (min_subject, min_predicate, min_object);
-            //cout<<"Searching for "<<min_range<<"\n";
-            vector<triple_st>::const_iterator itr = lower_bound(_spo_index.begin(), _spo_index.end(), min_range, s_compare());
-            for (; itr!=_spo_index.end() && itr->_subject.compare(min_subject)==0; itr++){
-                //cout<<"Debug "<<*itr<<"\n";
-                if (itr->_predicate.compare(min_predicate)==0){
-                    cardinality++;
-                }
-            }
-        } else {
-            min_object.append(rdf_term);
-            triple_st min_range (min_subject, min_predicate, min_object);
-            //cout<<"Searching for "<<min_range<<"\n";
-            vector<triple_st>::const_iterator itr = lower_bound(_ops_index.begin(), _ops_index.end(), min_range, o_compare());
-            for (; itr!=_ops_index.end() && itr->_object.compare(min_object)==0; itr++){
-                //cout<<"Debug "<<*itr<<"\n";
-                if (itr->_predicate.compare(min_predicate)==0){
-                    cardinality++;
-                }
+        if (rdf_term.size()>=2 && rdf_term[0]=='<'){
+            rdf_term = rdf_term.substr(1, rdf_term.size()-2);
+        }
+        uint32_t term_id = _store.dictionary().lookup(rdf_term);
+        if (term_id!=term_dictionary::NOT_FOUND && predicate_id!=term_dictionary::NOT_FOUND){
+            if (direction){
+                cardinality = _store.count_objects(term_id, predicate_id);
+            } else {
+                cardinality = _store.count_subjects(term_id, predicate_id);
             }
         }
         if (cardinality>0){
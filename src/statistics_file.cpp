@@ -0,0 +1,241 @@
+#include "../include/statistics_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <limits>
+#include <map>
+
+static const char MAGIC[8] = {'W', 'D', 'S', 'T', 'A', 'T', 'S', '\0'};
+static const uint32_t VERSION = 1;
+
+static size_t align(size_t offset){
+    return (offset + 7) & ~((size_t) 7);
+}
+
+void degree_summary_st::summarize(const int * statistics, unsigned int count, degree_summary_st & summary, vector<degree_count_st> & histogram){
+    map<uint32_t, uint32_t> degrees;
+    uint64_t sum = 0;
+    summary._instance_count = 0;
+    summary._covered_count = 0;
+    summary._min = numeric_limits<uint32_t>::max();
+    summary._max = numeric_limits<uint32_t>::min();
+    for (unsigned int i = 0; i < count; i++){
+        if (statistics[i] > 0){
+            uint32_t degree = statistics[i];
+            summary._covered_count++;
+            summary._min = min(summary._min, degree);
+            summary._max = max(summary._max, degree);
+            sum += degree;
+            degrees[degree]++;
+        }
+        if (statistics[i] >= 0){
+            summary._instance_count++;
+        }
+    }
+    // An empty side reports NaN, as a plain division would...
+    summary._mean = (double) sum / (double) summary._covered_count;
+    summary._cover = (double) summary._covered_count / (double) summary._instance_count;
+    summary._histogram_offset = 0;
+    summary._histogram_length = degrees.size();
+    histogram.clear();
+    for (map<uint32_t, uint32_t>::const_iterator itr = degrees.begin(); itr != degrees.end(); itr++){
+        degree_count_st degree_count;
+        degree_count._degree = itr->first;
+        degree_count._count = itr->second;
+        histogram.push_back(degree_count);
+    }
+}
+
+statistics_file::statistics_file(const char * filename){
+    _filename = filename;
+    _data = NULL;
+    _size = 0;
+    int fd = ::open(filename, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0){
+        cerr << "[statistics_file::statistics_file()]\tFailed to open '" << filename << "': " << strerror(errno) << "\n";
+        exit(0);
+    }
+    _size = file_stat.st_size;
+    if (_size < sizeof(statistics_file_header_st)){
+        cerr << "[statistics_file::statistics_file()]\t'" << filename << "' is not a statistics file..." << "\n";
+        exit(0);
+    }
+    void * data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED){
+        cerr << "[statistics_file::statistics_file()]\tFailed to map '" << filename << "': " << strerror(errno) << "\n";
+        exit(0);
+    }
+    ::close(fd);
+    _data = (const char *) data;
+    _header = (const statistics_file_header_st *) _data;
+    _entries = (const statistics_entry_st *) (_data + sizeof(statistics_file_header_st));
+
+    if (memcmp(_header->_magic, MAGIC, sizeof(MAGIC)) != 0 || _header->_version != VERSION){
+        cerr << "[statistics_file::statistics_file()]\t'" << filename << "' is not a statistics file of version " << VERSION << "..." << "\n";
+        exit(0);
+    }
+    if (_header->_file_size != _size || _header->_string_offset > _size || _header->_histogram_offset > _header->_string_offset ||
+        sizeof(statistics_file_header_st) + (uint64_t) _header->_entry_count * sizeof(statistics_entry_st) > _header->_histogram_offset){
+        cerr << "[statistics_file::statistics_file()]\t'" << filename << "' is truncated or corrupt..." << "\n";
+        exit(0);
+    }
+    uint64_t histogram_length = (_header->_string_offset - _header->_histogram_offset) / sizeof(degree_count_st);
+    for (uint32_t i = 0; i < _header->_entry_count; i++){
+        const degree_summary_st * sides[2] = {&_entries[i]._left, &_entries[i]._right};
+        for (int j = 0; j < 2; j++){
+            if (sides[j]->_histogram_offset + sides[j]->_histogram_length > histogram_length){
+                cerr << "[statistics_file::statistics_file()]\t'" << filename << "' is truncated or corrupt..." << "\n";
+                exit(0);
+            }
+        }
+    }
+}
+
+statistics_file::~statistics_file(){
+    munmap((void *) _data, _size);
+}
+
+boost::string_view statistics_file::get_string(const string_ref_st & ref) const{
+    if (ref._offset == NULL_STRING || _header->_string_offset + ref._offset + ref._length > _size){
+        return boost::string_view();
+    }
+    return boost::string_view(_data + _header->_string_offset + ref._offset, ref._length);
+}
+
+const degree_count_st * statistics_file::histogram(const degree_summary_st & summary) const{
+    return ((const degree_count_st *) (_data + _header->_histogram_offset)) + summary._histogram_offset;
+}
+
+const statistics_entry_st * statistics_file::find(const string & predicate, const string & subject_type, const string & object_type) const{
+    for (uint32_t i = 0; i < _header->_entry_count; i++){
+        if (get_string(_entries[i]._predicate) == predicate && get_string(_entries[i]._subject_type) == subject_type &&
+            get_string(_entries[i]._object_type) == object_type){
+            return &_entries[i];
+        }
+    }
+    return NULL;
+}
+
+void statistics_file::write(const char * filename, const vector<statistics_record_st> & records){
+    string strings;
+    vector<degree_count_st> histograms;
+    vector<statistics_entry_st> entries (records.size());
+    for (size_t i = 0; i < records.size(); i++){
+        const statistics_record_st & record = records[i];
+        statistics_entry_st & entry = entries[i];
+        const string * names[5] = {&record._predicate, &record._subject_type, &record._object_type,
+                                   record._subject_type_restriction, record._object_type_restriction};
+        string_ref_st * refs[5] = {&entry._predicate, &entry._subject_type, &entry._object_type,
+                                   &entry._subject_type_restriction, &entry._object_type_restriction};
+        for (int j = 0; j < 5; j++){
+            refs[j]->_offset = (names[j] == NULL) ? NULL_STRING : strings.size();
+            refs[j]->_length = (names[j] == NULL) ? 0 : names[j]->size();
+            if (names[j] != NULL){
+                strings.append(*names[j]);
+            }
+        }
+        entry._left = record._left;
+        entry._left._histogram_offset = histograms.size();
+        entry._left._histogram_length = record._left_histogram.size();
+        histograms.insert(histograms.end(), record._left_histogram.begin(), record._left_histogram.end());
+        entry._right = record._right;
+        entry._right._histogram_offset = histograms.size();
+        entry._right._histogram_length = record._right_histogram.size();
+        histograms.insert(histograms.end(), record._right_histogram.begin(), record._right_histogram.end());
+    }
+
+    statistics_file_header_st header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header._magic, MAGIC, sizeof(MAGIC));
+    header._version = VERSION;
+    header._entry_count = entries.size();
+    header._histogram_offset = align(sizeof(header) + entries.size() * sizeof(statistics_entry_st));
+    header._string_offset = align(header._histogram_offset + histograms.size() * sizeof(degree_count_st));
+    header._file_size = header._string_offset + strings.size();
+
+    ofstream fos(filename, ios::out | ios::binary | ios::trunc);
+    const char padding[8] = {0};
+    fos.write((const char *) &header, sizeof(header));
+    fos.write((const char *) entries.data(), entries.size() * sizeof(statistics_entry_st));
+    fos.write(padding, header._histogram_offset - (sizeof(header) + entries.size() * sizeof(statistics_entry_st)));
+    fos.write((const char *) histograms.data(), histograms.size() * sizeof(degree_count_st));
+    fos.write(padding, header._string_offset - (header._histogram_offset + histograms.size() * sizeof(degree_count_st)));
+    fos.write(strings.data(), strings.size());
+    fos.close();
+    if (!fos){
+        cerr << "[statistics_file::write()]\tFailed to write '" << filename << "'..." << "\n";
+        exit(0);
+    }
+}
+
+void statistics_file::report(uint32_t index, ostream & os) const{
+    const statistics_entry_st & entry = _entries[index];
+    boost::string_view subject_type_restriction = get_string(entry._subject_type_restriction);
+    boost::string_view object_type_restriction = get_string(entry._object_type_restriction);
+    report(get_string(entry._predicate), get_string(entry._subject_type), get_string(entry._object_type),
+           (entry._subject_type_restriction._offset == NULL_STRING) ? NULL : &subject_type_restriction,
+           (entry._object_type_restriction._offset == NULL_STRING) ? NULL : &object_type_restriction,
+           entry._left, histogram(entry._left), entry._right, histogram(entry._right), os);
+}
+
+void statistics_file::report(const statistics_record_st & record, ostream & os){
+    boost::string_view subject_type_restriction, object_type_restriction;
+    if (record._subject_type_restriction != NULL){
+        subject_type_restriction = *record._subject_type_restriction;
+    }
+    if (record._object_type_restriction != NULL){
+        object_type_restriction = *record._object_type_restriction;
+    }
+    report(record._predicate, record._subject_type, record._object_type,
+           (record._subject_type_restriction == NULL) ? NULL : &subject_type_restriction,
+           (record._object_type_restriction == NULL) ? NULL : &object_type_restriction,
+           record._left, record._left_histogram.data(), record._right, record._right_histogram.data(), os);
+}
+
+// Prints the degree of every covered instance, from the largest to the smallest...
+static void print_distribution(const degree_count_st * histogram, uint64_t length, ostream & os){
+    for (uint64_t i = length; i > 0; i--){
+        for (uint32_t j = 0; j < histogram[i - 1]._count; j++){
+            os << histogram[i - 1]._degree << " ";
+        }
+    }
+    os << "\n";
+}
+
+void statistics_file::report(boost::string_view predicate, boost::string_view subject_type, boost::string_view object_type,
+                             const boost::string_view * subject_type_restriction, const boost::string_view * object_type_restriction,
+                             const degree_summary_st & left, const degree_count_st * left_histogram,
+                             const degree_summary_st & right, const degree_count_st * right_histogram, ostream & os){
+    os << "Printing statistics..." << "\n";
+    os << "\tPredicate:           " << predicate << "\n";
+    os << "\tSubject-type:        " << subject_type << "\n";
+    os << "\tObject-type:         " << object_type << "\n";
+    if (subject_type_restriction != NULL){
+        os << "\tSubject-restriction: " << *subject_type_restriction << "\n";
+    }
+    if (object_type_restriction != NULL){
+        os << "\tObject-restriction: " << *object_type_restriction << "\n";
+    }
+
+    os << "\t\tSubject-statistics..." << "\n";
+    os << "\t\t\tCover:        " << left._cover << "\n";
+    os << "\t\t\tRange:        " << "[" << left._min << "-" << left._max << "]" << "\n";
+    os << "\t\t\tMean:         " << left._mean << "\n";
+    os << "\t\t\tDistribution: ";
+    print_distribution(left_histogram, left._histogram_length, os);
+
+    os << "\t\tObject-statistics..." << "\n";
+    os << "\t\t\tCover:        " << right._cover << "\n";
+    os << "\t\t\tRange:        " << "[" << right._min << "-" << right._max << "]" << "\n";
+    os << "\t\t\tMean:         " << right._mean << "\n";
+    os << "\t\t\tDistribution: ";
+    print_distribution(right_histogram, right._histogram_length, os);
+}
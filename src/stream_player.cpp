@@ -0,0 +1,235 @@
+#include "../include/stream_player.h"
+#include "../include/output_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+// Deadlines closer than this are busy-waited, since nanosleep(2) tends to overshoot
+// by tens of microseconds...
+static const double SPIN_SECONDS = 0.0002;
+// Upper bound on the triples of one write, so that a late player catches up in steps...
+static const unsigned long long MAX_BATCH_SIZE = 65536;
+static const size_t READ_BUFFER_SIZE = 4 << 20;
+
+static double monotonic_seconds(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1000000000.0;
+}
+
+static void wait_until(double deadline){
+    double remaining = deadline - monotonic_seconds();
+    if (remaining > SPIN_SECONDS){
+        double sleep_seconds = remaining - SPIN_SECONDS;
+        struct timespec duration;
+        duration.tv_sec = (time_t) sleep_seconds;
+        duration.tv_nsec = (long) ((sleep_seconds - (double) duration.tv_sec) * 1000000000.0);
+        while (nanosleep(&duration, &duration) != 0 && errno == EINTR);
+    }
+    while (monotonic_seconds() < deadline);
+}
+
+stream_player::stream_player(double rate){
+    if (!(rate > 0.0)){
+        cerr << "[stream_player::stream_player()]\tThe rate must be positive..." << "\n";
+        exit(0);
+    }
+    _rate = rate;
+    set_burst_profile("1:1");
+    _report_interval = 0.0;
+    _triple_count = 0;
+    _write_count = 0;
+    _elapsed = 0.0;
+    _lateness_mean = 0.0;
+    _lateness_m2 = 0.0;
+    _lateness_max = 0.0;
+}
+
+void stream_player::set_burst_profile(const string & profile){
+    vector<string> tokens;
+    boost::split(tokens, profile, boost::is_any_of(","));
+    _phases.clear();
+    _cycle_seconds = 0.0;
+    _cycle_triples = 0.0;
+    for (vector<string>::const_iterator itr = tokens.begin(); itr != tokens.end(); itr++){
+        size_t colon = itr->find(':');
+        phase_st phase;
+        try {
+            if (colon == string::npos){
+                throw boost::bad_lexical_cast();
+            }
+            phase._seconds = boost::lexical_cast<double>(itr->substr(0, colon));
+            phase._rate = _rate * boost::lexical_cast<double>(itr->substr(colon + 1));
+        } catch (boost::bad_lexical_cast &){
+            cerr << "[stream_player::set_burst_profile()]\tInvalid phase '" << *itr << "', expected <seconds>:<factor>..." << "\n";
+            exit(0);
+        }
+        if (!(phase._seconds > 0.0) || phase._rate < 0.0){
+            cerr << "[stream_player::set_burst_profile()]\tInvalid phase '" << *itr << "'..." << "\n";
+            exit(0);
+        }
+        _phases.push_back(phase);
+        _cycle_seconds += phase._seconds;
+        _cycle_triples += phase._seconds * phase._rate;
+    }
+    if (!(_cycle_triples > 0.0)){
+        cerr << "[stream_player::set_burst_profile()]\tThe profile '" << profile << "' never emits anything..." << "\n";
+        exit(0);
+    }
+}
+
+void stream_player::set_report_interval(double seconds){
+    _report_interval = seconds;
+}
+
+// Seconds from the start of the replay at which the cumulative rate reaches index...
+double stream_player::due_time(unsigned long long index) const{
+    double cycles = floor((double) index / _cycle_triples);
+    double triples = (double) index - cycles * _cycle_triples;
+    double result = cycles * _cycle_seconds;
+    for (vector<phase_st>::const_iterator itr = _phases.begin(); itr != _phases.end(); itr++){
+        double phase_triples = itr->_seconds * itr->_rate;
+        if (triples < phase_triples){
+            return result + triples / itr->_rate;
+        }
+        triples -= phase_triples;
+        result += itr->_seconds;
+    }
+    return result;
+}
+
+// Number of triples that are due after the given number of seconds...
+unsigned long long stream_player::due_count(double seconds) const{
+    double cycles = floor(seconds / _cycle_seconds);
+    double remaining = seconds - cycles * _cycle_seconds;
+    double triples = cycles * _cycle_triples;
+    for (vector<phase_st>::const_iterator itr = _phases.begin(); itr != _phases.end(); itr++){
+        if (remaining < itr->_seconds){
+            triples += remaining * itr->_rate;
+            break;
+        }
+        triples += itr->_seconds * itr->_rate;
+        remaining -= itr->_seconds;
+    }
+    return (unsigned long long) floor(triples) + 1;
+}
+
+void stream_player::record_lateness(double lateness){
+    _write_count++;
+    double delta = lateness - _lateness_mean;
+    _lateness_mean += delta / (double) _write_count;
+    _lateness_m2 += delta * (lateness - _lateness_mean);
+    _lateness_max = max(_lateness_max, lateness);
+}
+
+void stream_player::play(const string & stream_file, output_sink & sink){
+    int fd = ::open(stream_file.c_str(), O_RDONLY);
+    if (fd < 0){
+        cerr << "[stream_player::play()]\tFailed to open '" << stream_file << "': " << strerror(errno) << "\n";
+        exit(0);
+    }
+    // A reader that goes away shows up as a failed write instead...
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<char> buffer (READ_BUFFER_SIZE);
+    size_t begin = 0, end = 0;
+    bool eof = false;
+
+    double start = monotonic_seconds();
+    double last_report = 0.0;
+    unsigned long long last_report_count = 0;
+    while (true){
+        double now = monotonic_seconds() - start;
+        unsigned long long due = due_count(now);
+        if (due <= _triple_count){
+            wait_until(start + due_time(_triple_count));
+            continue;
+        }
+        double lateness = now - due_time(_triple_count);
+        unsigned long long batch_size = min(due - _triple_count, MAX_BATCH_SIZE);
+        // Write whole lines straight from the read buffer...
+        unsigned long long line_count = 0;
+        while (line_count < batch_size){
+            size_t cursor = begin;
+            while (line_count < batch_size && cursor < end){
+                const char * newline = (const char *) memchr(buffer.data() + cursor, '\n', end - cursor);
+                if (newline == NULL){
+                    break;
+                }
+                cursor = newline - buffer.data() + 1;
+                line_count++;
+            }
+            if (cursor > begin){
+                sink.write(buffer.data() + begin, cursor - begin);
+                begin = cursor;
+            }
+            if (line_count == batch_size || eof){
+                break;
+            }
+            // Keep the partial line, and refill the rest of the buffer...
+            memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            if (end == buffer.size()){
+                buffer.resize(buffer.size() * 2);
+            }
+            ssize_t count = ::read(fd, buffer.data() + end, buffer.size() - end);
+            if (count < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                cerr << "[stream_player::play()]\tFailed to read '" << stream_file << "': " << strerror(errno) << "\n";
+                exit(0);
+            }
+            if (count == 0){
+                eof = true;
+                // The last line may lack its newline...
+                if (begin < end){
+                    sink.write(buffer.data() + begin, end - begin);
+                    sink.write("\n", 1);
+                    begin = end;
+                    line_count++;
+                }
+            }
+            end += count;
+        }
+        if (line_count > 0){
+            _triple_count += line_count;
+            record_lateness(lateness);
+        }
+        _elapsed = monotonic_seconds() - start;
+        // Pauses of the profile can stretch an interval, so the rate is taken over its actual length...
+        if (_report_interval > 0.0 && _elapsed >= last_report + _report_interval){
+            cerr << "[stream_player]\t" << _triple_count << " triples after " << _elapsed << " s, "
+                 << ((double) (_triple_count - last_report_count) / (_elapsed - last_report)) << " triples/s since the last report" << "\n";
+            last_report = _elapsed;
+            last_report_count = _triple_count;
+        }
+        if (eof && begin == end){
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+// Reports the achieved rate against the average rate of the profile, and how far the
+// writes fell behind their schedule...
+void stream_player::report() const{
+    double target = _cycle_triples / _cycle_seconds;
+    double stddev = (_write_count > 1) ? sqrt(_lateness_m2 / (double) (_write_count - 1)) : 0.0;
+    cerr << "[stream_player]\t" << _triple_count << " triples in " << _write_count << " writes over " << _elapsed << " s: "
+         << ((_elapsed > 0.0) ? ((double) _triple_count / _elapsed) : 0.0) << " triples/s (target " << target << ")" << "\n";
+    cerr << "[stream_player]\tlateness mean " << (_lateness_mean * 1000000.0) << " us, stddev " << (stddev * 1000000.0)
+         << " us, max " << (_lateness_max * 1000000.0) << " us" << "\n";
+}
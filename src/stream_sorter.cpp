@@ -0,0 +1,295 @@
+#include "../include/stream_sorter.h"
+#include "../include/output_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <queue>
+
+// Records without a numeric key sort before every number, as they do with sort -g...
+static const double NO_KEY = -numeric_limits<double>::infinity();
+
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+// Record offsets within a chunk are 32 bits wide...
+static const size_t MAX_CHUNK_SIZE = 0x7FFFFFFF;
+static const size_t MIN_READ_BUFFER_SIZE = 64 << 10;
+static const size_t MAX_READ_BUFFER_SIZE = 4 << 20;
+
+// Reads the records of a run in order, either from a run file or from the sorted
+// chunk that was still in memory when the input ended...
+struct stream_sorter::run_reader_st{
+    int                 _fd;
+    string              _file;
+    vector<char>        _buffer;
+    size_t              _begin;
+    size_t              _end;
+    bool                _eof;
+
+    const chunk_st *    _chunk;
+    size_t              _cursor;
+
+    const char *        _record;
+    size_t              _length;
+    double              _key;
+
+    run_reader_st (const string & run_file, size_t buffer_size){
+        _fd = ::open(run_file.c_str(), O_RDONLY);
+        if (_fd < 0){
+            cerr << "[stream_sorter::run_reader_st()]\tFailed to open '" << run_file << "': " << strerror(errno) << "\n";
+            exit(0);
+        }
+        _file = run_file;
+        _buffer.resize(buffer_size);
+        _begin = 0;
+        _end = 0;
+        _eof = false;
+        _chunk = NULL;
+        _cursor = 0;
+    }
+
+    run_reader_st (const chunk_st * chunk){
+        _fd = -1;
+        _begin = 0;
+        _end = 0;
+        _eof = true;
+        _chunk = chunk;
+        _cursor = 0;
+    }
+
+    ~run_reader_st (){
+        if (_fd >= 0){
+            ::close(_fd);
+        }
+    }
+
+    // Moves to the next record, and returns false at the end of the run. The current
+    // record is only valid until the next call...
+    bool next (){
+        if (_chunk != NULL){
+            if (_cursor >= _chunk->_records.size()){
+                return false;
+            }
+            const record_st & record = _chunk->_records[_cursor++];
+            _record = &_chunk->_text[record._offset];
+            _length = record._length;
+            _key = record._key;
+            return true;
+        }
+        while (true){
+            const char * start = _buffer.data() + _begin;
+            const char * newline = (const char *) memchr(start, '\n', _end - _begin);
+            if (newline != NULL){
+                _record = start;
+                _length = newline - start;
+                _begin += _length + 1;
+                _key = parse_key(_record, _length);
+                return true;
+            }
+            if (_eof){
+                if (_begin == _end){
+                    return false;
+                }
+                _record = start;
+                _length = _end - _begin;
+                _begin = _end;
+                _key = parse_key(_record, _length);
+                return true;
+            }
+            // Keep the partial record, and refill the rest of the buffer...
+            memmove(_buffer.data(), start, _end - _begin);
+            _end -= _begin;
+            _begin = 0;
+            if (_end == _buffer.size()){
+                _buffer.resize(_buffer.size() * 2);
+            }
+            ssize_t count = ::read(_fd, _buffer.data() + _end, _buffer.size() - _end);
+            if (count < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                cerr << "[stream_sorter::run_reader_st::next()]\tFailed to read '" << _file << "': " << strerror(errno) << "\n";
+                exit(0);
+            }
+            if (count == 0){
+                _eof = true;
+            }
+            _end += count;
+        }
+    }
+};
+
+void stream_sorter::chunk_st::sort(){
+    stable_sort(_records.begin(), _records.end(), [](const record_st & a, const record_st & b) { return a._key < b._key; });
+}
+
+stream_sorter::stream_sorter(const string & output_file, size_t memory_budget, unsigned int thread_count){
+    if (thread_count == 0){
+        thread_count = thread::hardware_concurrency();
+    }
+    _output_file = output_file;
+    _memory_budget = memory_budget;
+    _thread_count = (thread_count == 0) ? 1 : thread_count;
+    // One chunk is filled while every worker sorts and writes another one...
+    _chunk_limit = min(max(memory_budget / (_thread_count + 1), MIN_CHUNK_SIZE), MAX_CHUNK_SIZE);
+    _chunk = new chunk_st();
+    _chunk->_text.reserve(_chunk_limit);
+    _record_count = 0;
+    _finished = false;
+}
+
+stream_sorter::~stream_sorter(){
+    wait_for_workers(0);
+    delete _chunk;
+    if (!_finished){
+        for (vector<string>::const_iterator itr = _run_files.begin(); itr != _run_files.end(); itr++){
+            remove(itr->c_str());
+        }
+    }
+}
+
+// Returns the numeric value at the start of the 4th column, parsed like strtod(3)...
+double stream_sorter::parse_key(const char * record, size_t length){
+    const char * end = record + length;
+    const char * field = record;
+    for (int tab_count = 0; tab_count < 3; tab_count++){
+        field = (const char *) memchr(field, '\t', end - field);
+        if (field == NULL){
+            return NO_KEY;
+        }
+        field++;
+    }
+    // Timestamps are plain integers, which can be converted without a copy...
+    const char * cursor = field;
+    unsigned long long value = 0;
+    while (cursor < end && cursor - field < 18 && *cursor >= '0' && *cursor <= '9'){
+        value = value * 10 + (*cursor - '0');
+        cursor++;
+    }
+    if (cursor == end && cursor != field){
+        return (double) value;
+    }
+    string text (field, end);
+    char * stop = NULL;
+    double result = strtod(text.c_str(), &stop);
+    if (stop == text.c_str() || result != result){
+        return NO_KEY;
+    }
+    return result;
+}
+
+void stream_sorter::add(const string & record){
+    add(record.data(), record.size());
+}
+
+void stream_sorter::add(const char * record, size_t length){
+    if (length == 0){
+        return;
+    }
+    if (_finished){
+        cerr << "[stream_sorter::add()]\tThe sorter has already been finished..." << "\n";
+        exit(0);
+    }
+    if (!_chunk->_records.empty() && _chunk->memory_usage() + length + sizeof(record_st) > _chunk_limit){
+        spill();
+    }
+    record_st entry;
+    entry._key = parse_key(record, length);
+    entry._offset = _chunk->_text.size();
+    entry._length = length;
+    _chunk->_records.push_back(entry);
+    _chunk->_text.insert(_chunk->_text.end(), record, record + length);
+    _record_count++;
+}
+
+// Hands the current chunk over to a worker, once fewer than _thread_count are busy...
+void stream_sorter::spill(){
+    wait_for_workers(_thread_count - 1);
+    string run_file = "stream_run_" + to_string(_run_files.size()) + ".tmp";
+    _run_files.push_back(run_file);
+    _workers.push_back(thread(write_run, _chunk, run_file));
+    _chunk = new chunk_st();
+    _chunk->_text.reserve(_chunk_limit);
+}
+
+void stream_sorter::wait_for_workers(size_t max_pending){
+    while (_workers.size() > max_pending){
+        _workers.front().join();
+        _workers.pop_front();
+    }
+}
+
+void stream_sorter::write_run(chunk_st * chunk, string run_file){
+    chunk->sort();
+    output_sink * sink = output_sink::open(run_file);
+    {
+        output_buffer buffer (sink, 1 << 20);
+        for (vector<record_st>::const_iterator itr = chunk->_records.begin(); itr != chunk->_records.end(); itr++){
+            buffer.append(&chunk->_text[itr->_offset], itr->_length);
+            buffer.append('\n');
+        }
+    }
+    delete sink;
+    delete chunk;
+}
+
+void stream_sorter::finish(){
+    if (_finished){
+        return;
+    }
+    wait_for_workers(0);
+    _chunk->sort();
+    merge();
+    for (vector<string>::const_iterator itr = _run_files.begin(); itr != _run_files.end(); itr++){
+        remove(itr->c_str());
+    }
+    _finished = true;
+}
+
+// k-way merge of the run files and the last chunk. Ties go to the lower run, which
+// holds the records that were added first...
+void stream_sorter::merge(){
+    size_t buffer_size = min(max(_memory_budget / (_run_files.size() + 1), MIN_READ_BUFFER_SIZE), MAX_READ_BUFFER_SIZE);
+    vector<run_reader_st *> readers;
+    for (vector<string>::const_iterator itr = _run_files.begin(); itr != _run_files.end(); itr++){
+        readers.push_back(new run_reader_st(*itr, buffer_size));
+    }
+    readers.push_back(new run_reader_st(_chunk));
+
+    typedef pair<double, unsigned int> head_t;
+    priority_queue<head_t, vector<head_t>, greater<head_t> > heads;
+    for (unsigned int run = 0; run < readers.size(); run++){
+        if (readers[run]->next()){
+            heads.push(head_t(readers[run]->_key, run));
+        }
+    }
+
+    output_sink * sink = output_sink::open(_output_file);
+    {
+        output_buffer buffer (sink);
+        while (!heads.empty()){
+            unsigned int run = heads.top().second;
+            heads.pop();
+            run_reader_st * reader = readers[run];
+            if (reader->_length > 0){
+                buffer.append(reader->_record, reader->_length);
+                buffer.append('\n');
+            }
+            if (reader->next()){
+                heads.push(head_t(reader->_key, run));
+            }
+        }
+    }
+    delete sink;
+
+    for (vector<run_reader_st *>::iterator itr = readers.begin(); itr != readers.end(); itr++){
+        delete *itr;
+    }
+}
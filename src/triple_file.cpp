@@ -0,0 +1,180 @@
+#include "../include/triple_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+// Files are not split into chunks smaller than this...
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+static inline bool is_space(char c){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+static inline void strip_brackets(const char * & begin, const char * & end){
+    if (end - begin >= 2 && *begin == '<' && *(end - 1) == '>'){
+        begin++;
+        end--;
+    }
+}
+
+static size_t count_lines(const char * begin, const char * end){
+    size_t result = 0;
+    for (const char * cursor = begin; cursor < end; cursor++){
+        cursor = (const char *) memchr(cursor, '\n', end - cursor);
+        if (cursor == NULL){
+            return result + 1;
+        }
+        result++;
+    }
+    return result;
+}
+
+string triple_view_st::to_term(boost::string_view term){
+    string result;
+    if (!term.empty() && term[0] == '"'){
+        result.assign(term.data(), term.size());
+    } else {
+        result.reserve(term.size() + 2);
+        result.append(1, '<');
+        result.append(term.data(), term.size());
+        result.append(1, '>');
+    }
+    return result;
+}
+
+triple_file::triple_file(const char * filename, bool stream){
+    _filename = filename;
+    _stream = stream;
+    _data = NULL;
+    _size = 0;
+    int fd = ::open(filename, O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0){
+        cerr << "[triple_file::triple_file()]\tFailed to open '" << filename << "': " << strerror(errno) << "\n";
+        exit(0);
+    }
+    _size = file_stat.st_size;
+    if (_size > 0){
+        void * data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED){
+            cerr << "[triple_file::triple_file()]\tFailed to map '" << filename << "': " << strerror(errno) << "\n";
+            exit(0);
+        }
+        madvise(data, _size, MADV_SEQUENTIAL);
+        _data = (const char *) data;
+    }
+    ::close(fd);
+}
+
+triple_file::~triple_file(){
+    if (_data != NULL){
+        munmap((void *) _data, _size);
+    }
+}
+
+// Tokenizes the lines of [begin, end) into result, and returns the number of triples...
+size_t triple_file::tokenize(const char * begin, const char * end, triple_view_st * result) const{
+    size_t count = 0;
+    const char * line = begin;
+    while (line < end){
+        const char * line_end = (const char *) memchr(line, '\n', end - line);
+        line_end = (line_end == NULL) ? end : line_end;
+        const char * b = line;
+        const char * e = line_end;
+        line = line_end + 1;
+
+        while (b < e && is_space(*b)) b++;
+        while (e > b && is_space(*(e - 1))) e--;
+        // N-Triples end with " ." or "\t."...
+        if (!_stream && e > b && *(e - 1) == '.'){
+            e--;
+            while (e > b && is_space(*(e - 1))) e--;
+        }
+        const char * tab1 = (const char *) memchr(b, '\t', e - b);
+        if (tab1 == NULL) continue;
+        const char * tab2 = (const char *) memchr(tab1 + 1, '\t', e - tab1 - 1);
+        if (tab2 == NULL) continue;
+        const char * tab3 = (const char *) memchr(tab2 + 1, '\t', e - tab2 - 1);
+        tab3 = (tab3 == NULL) ? e : tab3;
+
+        const char * s_begin = b, * s_end = tab1;
+        const char * p_begin = tab1 + 1, * p_end = tab2;
+        const char * o_begin = tab2 + 1, * o_end = tab3;
+        strip_brackets(s_begin, s_end);
+        strip_brackets(p_begin, p_end);
+        strip_brackets(o_begin, o_end);
+
+        triple_view_st & triple = result[count++];
+        triple._subject = s_begin;
+        triple._subject_length = s_end - s_begin;
+        triple._predicate_offset = p_begin - s_begin;
+        triple._predicate_length = p_end - p_begin;
+        triple._object_offset = o_begin - s_begin;
+        triple._object_length = o_end - o_begin;
+    }
+    return count;
+}
+
+void triple_file::parse(vector<triple_view_st> & result, unsigned int thread_count) const{
+    if (_size == 0){
+        return;
+    }
+    if (thread_count == 0){
+        thread_count = thread::hardware_concurrency();
+    }
+    size_t chunk_count = max((size_t) 1, min((size_t) max(thread_count, 1u), _size / MIN_CHUNK_SIZE));
+
+    // Chunks start right after a newline...
+    vector<const char *> bounds;
+    bounds.push_back(_data);
+    for (size_t i = 1; i < chunk_count; i++){
+        const char * cursor = max(_data + (_size * i) / chunk_count, bounds.back());
+        const char * newline = (const char *) memchr(cursor, '\n', (_data + _size) - cursor);
+        bounds.push_back((newline == NULL) ? (_data + _size) : (newline + 1));
+    }
+    bounds.push_back(_data + _size);
+
+    vector<size_t> line_counts (chunk_count, 0);
+    vector<size_t> triple_counts (chunk_count, 0);
+    vector<thread> workers;
+    for (size_t i = 0; i < chunk_count; i++){
+        workers.push_back(thread([&, i]() { line_counts[i] = count_lines(bounds[i], bounds[i + 1]); }));
+    }
+    for (vector<thread>::iterator itr = workers.begin(); itr != workers.end(); itr++){
+        itr->join();
+    }
+    workers.clear();
+
+    size_t first = result.size();
+    vector<size_t> offsets (chunk_count, first);
+    for (size_t i = 1; i < chunk_count; i++){
+        offsets[i] = offsets[i - 1] + line_counts[i - 1];
+    }
+    result.resize(offsets.back() + line_counts.back());
+    triple_view_st * data = result.data();
+    for (size_t i = 0; i < chunk_count; i++){
+        workers.push_back(thread([&, i]() { triple_counts[i] = tokenize(bounds[i], bounds[i + 1], data + offsets[i]); }));
+    }
+    for (vector<thread>::iterator itr = workers.begin(); itr != workers.end(); itr++){
+        itr->join();
+    }
+
+    // Close the gaps that skipped lines left behind...
+    size_t size = offsets[0] + triple_counts[0];
+    for (size_t i = 1; i < chunk_count; i++){
+        if (size != offsets[i]){
+            memmove(data + size, data + offsets[i], triple_counts[i] * sizeof(triple_view_st));
+        }
+        size += triple_counts[i];
+    }
+    result.resize(size);
+}
@@ -0,0 +1,371 @@
+#include "../include/triple_store.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+// Terms are copied into arena blocks of this size, longer ones get a block of their own...
+static const size_t BLOCK_SIZE = 1 << 16;
+static const uint32_t INITIAL_SLOT_COUNT = 1 << 10;
+// Triples are not split into chunks smaller than this...
+static const size_t MIN_CHUNK_TRIPLES = 1 << 16;
+
+static const int DIGIT_BITS = 11;
+static const size_t RADIX = 1 << DIGIT_BITS;
+static const uint64_t DIGIT_MASK = RADIX - 1;
+// Fewer keys than this are sorted by a single thread...
+static const size_t MIN_PARALLEL_KEYS = 1 << 18;
+
+// Runs task(0), ..., task(count - 1) on one thread each, or inline for a single one...
+template <typename task_t>
+static void run_parallel(size_t count, const task_t & task){
+    if (count == 1){
+        task(0);
+        return;
+    }
+    vector<thread> workers;
+    for (size_t i = 0; i < count; i++){
+        workers.push_back(thread([&task, i]() { task(i); }));
+    }
+    for (vector<thread>::iterator itr = workers.begin(); itr != workers.end(); itr++){
+        itr->join();
+    }
+}
+
+term_dictionary::term_dictionary(){
+    _shards = new shard_st[SHARD_COUNT];
+    for (uint32_t i = 0; i < SHARD_COUNT; i++){
+        _shards[i]._slots.assign(INITIAL_SLOT_COUNT, 0);
+        _shards[i]._block_used = BLOCK_SIZE;
+    }
+}
+
+term_dictionary::~term_dictionary(){
+    for (uint32_t i = 0; i < SHARD_COUNT; i++){
+        for (vector<char *>::iterator itr = _shards[i]._blocks.begin(); itr != _shards[i]._blocks.end(); itr++){
+            delete [] *itr;
+        }
+    }
+    delete [] _shards;
+}
+
+// Multiplicative hash over 8-byte words with a final avalanche (MurmurHash3's fmix64)...
+uint64_t term_dictionary::hash(boost::string_view term){
+    const char * data = term.data();
+    size_t length = term.size();
+    uint64_t result = 0x9E3779B97F4A7C15ULL ^ length;
+    for (; length >= 8; data += 8, length -= 8){
+        uint64_t word;
+        memcpy(&word, data, 8);
+        result = (result ^ word) * 0xFF51AFD7ED558CCDULL;
+        result ^= result >> 32;
+    }
+    if (length > 0){
+        uint64_t word = 0;
+        memcpy(&word, data, length);
+        result = (result ^ word) * 0xFF51AFD7ED558CCDULL;
+    }
+    result ^= result >> 33;
+    result *= 0xFF51AFD7ED558CCDULL;
+    result ^= result >> 33;
+    result *= 0xC4CEB9FE1A85EC53ULL;
+    result ^= result >> 33;
+    return result;
+}
+
+// Returns the slot that holds the term, or the empty slot where it belongs...
+uint32_t term_dictionary::find_slot(const shard_st & shard, boost::string_view term, uint32_t hash){
+    uint32_t mask = shard._slots.size() - 1;
+    for (uint32_t slot = hash & mask; ; slot = (slot + 1) & mask){
+        uint32_t index = shard._slots[slot];
+        if (index == 0){
+            return slot;
+        }
+        const entry_st & entry = shard._entries[index - 1];
+        if (entry._hash == hash && entry._length == term.size() && memcmp(entry._data, term.data(), term.size()) == 0){
+            return slot;
+        }
+    }
+}
+
+void term_dictionary::grow(shard_st & shard){
+    vector<uint32_t> slots (shard._slots.size() * 2, 0);
+    uint32_t mask = slots.size() - 1;
+    for (uint32_t index = 0; index < shard._entries.size(); index++){
+        uint32_t slot = shard._entries[index]._hash & mask;
+        while (slots[slot] != 0){
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = index + 1;
+    }
+    shard._slots.swap(slots);
+}
+
+uint32_t term_dictionary::intern(boost::string_view term){
+    uint64_t term_hash = hash(term);
+    uint32_t shard_id = term_hash & (SHARD_COUNT - 1);
+    uint32_t entry_hash = term_hash >> 32;
+    shard_st & shard = _shards[shard_id];
+
+    lock_guard<mutex> lock (shard._mutex);
+    uint32_t slot = find_slot(shard, term, entry_hash);
+    if (shard._slots[slot] != 0){
+        return ((shard._slots[slot] - 1) << SHARD_BITS) | shard_id;
+    }
+    if (shard._entries.size() >= (1u << (32 - SHARD_BITS)) - 1){
+        cerr << "[term_dictionary::intern()]\tToo many terms for 32-bit IDs..." << "\n";
+        exit(0);
+    }
+    char * data = NULL;
+    if (term.size() > BLOCK_SIZE / 4){
+        data = new char[term.size() + 1];
+        shard._blocks.insert(shard._blocks.begin(), data);
+    } else {
+        if (shard._block_used + term.size() > BLOCK_SIZE){
+            shard._blocks.push_back(new char[BLOCK_SIZE]);
+            shard._block_used = 0;
+        }
+        data = shard._blocks.back() + shard._block_used;
+        shard._block_used += term.size();
+    }
+    memcpy(data, term.data(), term.size());
+
+    entry_st entry;
+    entry._data = data;
+    entry._length = term.size();
+    entry._hash = entry_hash;
+    shard._entries.push_back(entry);
+    uint32_t index = shard._entries.size();
+    shard._slots[slot] = index;
+    if ((size_t) index * 2 > shard._slots.size()){
+        grow(shard);
+    }
+    return ((index - 1) << SHARD_BITS) | shard_id;
+}
+
+uint32_t term_dictionary::lookup(boost::string_view term) const{
+    uint64_t term_hash = hash(term);
+    uint32_t shard_id = term_hash & (SHARD_COUNT - 1);
+    const shard_st & shard = _shards[shard_id];
+    uint32_t index = shard._slots[find_slot(shard, term, term_hash >> 32)];
+    return (index == 0) ? NOT_FOUND : (((index - 1) << SHARD_BITS) | shard_id);
+}
+
+boost::string_view term_dictionary::term(uint32_t id) const{
+    const entry_st & entry = _shards[id & (SHARD_COUNT - 1)]._entries[id >> SHARD_BITS];
+    return boost::string_view(entry._data, entry._length);
+}
+
+size_t term_dictionary::size() const{
+    size_t result = 0;
+    for (uint32_t i = 0; i < SHARD_COUNT; i++){
+        result += _shards[i]._entries.size();
+    }
+    return result;
+}
+
+size_t term_dictionary::memory_usage() const{
+    size_t result = 0;
+    for (uint32_t i = 0; i < SHARD_COUNT; i++){
+        const shard_st & shard = _shards[i];
+        result += shard._slots.capacity() * sizeof(uint32_t) + shard._entries.capacity() * sizeof(entry_st);
+        for (vector<entry_st>::const_iterator itr = shard._entries.begin(); itr != shard._entries.end(); itr++){
+            result += itr->_length;
+        }
+    }
+    return result;
+}
+
+triple_store::triple_store(){
+    _triple_count = 0;
+}
+
+void triple_store::build(vector<triple_view_st> & triples, unsigned int thread_count){
+    if (thread_count == 0){
+        thread_count = thread::hardware_concurrency();
+    }
+    size_t triple_count = triples.size();
+    size_t chunk_count = max((size_t) 1, min((size_t) max(thread_count, 1u), triple_count / MIN_CHUNK_TRIPLES));
+    vector<size_t> bounds;
+    for (size_t i = 0; i <= chunk_count; i++){
+        bounds.push_back((triple_count * i) / chunk_count);
+    }
+
+    // Encode the triples, and count them per predicate and chunk...
+    vector<uint32_t> subject_ids (triple_count), predicate_ids (triple_count), object_ids (triple_count);
+    vector<unordered_map<uint32_t, size_t> > chunk_counts (chunk_count);
+    run_parallel(chunk_count, [&](size_t chunk){
+        unordered_map<uint32_t, size_t> & counts = chunk_counts[chunk];
+        for (size_t i = bounds[chunk]; i < bounds[chunk + 1]; i++){
+            subject_ids[i] = _dictionary.intern(triples[i].subject());
+            predicate_ids[i] = _dictionary.intern(triples[i].predicate());
+            object_ids[i] = _dictionary.intern(triples[i].object());
+            counts[predicate_ids[i]]++;
+        }
+    });
+    vector<triple_view_st>().swap(triples);
+
+    vector<uint32_t> predicates;
+    for (size_t chunk = 0; chunk < chunk_count; chunk++){
+        for (unordered_map<uint32_t, size_t>::const_iterator itr = chunk_counts[chunk].begin(); itr != chunk_counts[chunk].end(); itr++){
+            if (find(predicates.begin(), predicates.end(), itr->first) == predicates.end()){
+                predicates.push_back(itr->first);
+            }
+        }
+    }
+    for (vector<uint32_t>::const_iterator itr = predicates.begin(); itr != predicates.end(); itr++){
+        if (_predicate_index.find(*itr) == _predicate_index.end()){
+            size_t index = _predicate_index.size();
+            _predicate_index[*itr] = index;
+        }
+    }
+
+    // Every chunk writes its triples behind those of the previous chunks, and behind
+    // the keys of earlier builds...
+    _so_keys.resize(_predicate_index.size());
+    _os_keys.resize(_predicate_index.size());
+    vector<size_t> base (_predicate_index.size(), 0);
+    for (vector<uint32_t>::const_iterator itr = predicates.begin(); itr != predicates.end(); itr++){
+        size_t index = _predicate_index[*itr];
+        size_t total = 0;
+        for (size_t chunk = 0; chunk < chunk_count; chunk++){
+            unordered_map<uint32_t, size_t>::iterator count = chunk_counts[chunk].find(*itr);
+            if (count != chunk_counts[chunk].end()){
+                size_t chunk_total = count->second;
+                count->second = total;
+                total += chunk_total;
+            }
+        }
+        base[index] = _so_keys[index].size();
+        _so_keys[index].resize(base[index] + total);
+        _os_keys[index].resize(base[index] + total);
+    }
+
+    run_parallel(chunk_count, [&](size_t chunk){
+        unordered_map<uint32_t, size_t> & positions = chunk_counts[chunk];
+        uint32_t last_predicate = term_dictionary::NOT_FOUND;
+        size_t index = 0;
+        size_t * position = NULL;
+        for (size_t i = bounds[chunk]; i < bounds[chunk + 1]; i++){
+            if (predicate_ids[i] != last_predicate){
+                last_predicate = predicate_ids[i];
+                index = _predicate_index.find(last_predicate)->second;
+                position = &positions.find(last_predicate)->second;
+            }
+            size_t offset = base[index] + (*position)++;
+            _so_keys[index][offset] = ((uint64_t) subject_ids[i] << 32) | object_ids[i];
+            _os_keys[index][offset] = ((uint64_t) object_ids[i] << 32) | subject_ids[i];
+        }
+    });
+    vector<uint32_t>().swap(subject_ids);
+    vector<uint32_t>().swap(predicate_ids);
+    vector<uint32_t>().swap(object_ids);
+
+    for (vector<uint32_t>::const_iterator itr = predicates.begin(); itr != predicates.end(); itr++){
+        size_t index = _predicate_index[*itr];
+        radix_sort(_so_keys[index], thread_count);
+        radix_sort(_os_keys[index], thread_count);
+    }
+    _triple_count += triple_count;
+}
+
+// LSD radix sort over DIGIT_BITS-bit digits. Digits in which all keys agree are
+// skipped, which leaves few passes for the small IDs of most datasets. Each thread
+// counts the digits of its slice of the keys, and then scatters the slice to the
+// offsets it owns within every bucket, so that every pass stays stable...
+void triple_store::radix_sort(vector<uint64_t> & keys, unsigned int thread_count){
+    size_t key_count = keys.size();
+    if (key_count < 2){
+        return;
+    }
+    if (thread_count == 0){
+        thread_count = thread::hardware_concurrency();
+    }
+    size_t slice_count = (key_count < MIN_PARALLEL_KEYS) ? 1 : max((size_t) 1, min((size_t) thread_count, key_count / MIN_PARALLEL_KEYS));
+    vector<size_t> bounds;
+    for (size_t i = 0; i <= slice_count; i++){
+        bounds.push_back((key_count * i) / slice_count);
+    }
+
+    vector<uint64_t> slice_or (slice_count, 0), slice_and (slice_count, ~0ULL);
+    run_parallel(slice_count, [&](size_t slice){
+        uint64_t any = 0, all = ~0ULL;
+        for (size_t i = bounds[slice]; i < bounds[slice + 1]; i++){
+            any |= keys[i];
+            all &= keys[i];
+        }
+        slice_or[slice] = any;
+        slice_and[slice] = all;
+    });
+    uint64_t varying = 0, all = ~0ULL;
+    for (size_t i = 0; i < slice_count; i++){
+        varying |= slice_or[i];
+        all &= slice_and[i];
+    }
+    varying ^= all;
+    if (varying == 0){
+        return;
+    }
+
+    vector<uint64_t> buffer (key_count);
+    uint64_t * source = keys.data();
+    uint64_t * target = buffer.data();
+    vector<size_t> offsets (slice_count * RADIX);
+    for (int shift = 0; shift < 64; shift += DIGIT_BITS){
+        if (((varying >> shift) & DIGIT_MASK) == 0){
+            continue;
+        }
+        run_parallel(slice_count, [&](size_t slice){
+            size_t * counts = &offsets[slice * RADIX];
+            fill(counts, counts + RADIX, 0);
+            for (size_t i = bounds[slice]; i < bounds[slice + 1]; i++){
+                counts[(source[i] >> shift) & DIGIT_MASK]++;
+            }
+        });
+        size_t total = 0;
+        for (size_t digit = 0; digit < RADIX; digit++){
+            for (size_t slice = 0; slice < slice_count; slice++){
+                size_t count = offsets[slice * RADIX + digit];
+                offsets[slice * RADIX + digit] = total;
+                total += count;
+            }
+        }
+        run_parallel(slice_count, [&](size_t slice){
+            size_t * positions = &offsets[slice * RADIX];
+            for (size_t i = bounds[slice]; i < bounds[slice + 1]; i++){
+                target[positions[(source[i] >> shift) & DIGIT_MASK]++] = source[i];
+            }
+        });
+        swap(source, target);
+    }
+    if (source != keys.data()){
+        keys.swap(buffer);
+    }
+}
+
+size_t triple_store::count_range(const vector<uint64_t> & keys, uint32_t prefix){
+    vector<uint64_t>::const_iterator begin = lower_bound(keys.begin(), keys.end(), (uint64_t) prefix << 32);
+    vector<uint64_t>::const_iterator end = upper_bound(begin, keys.end(), ((uint64_t) prefix << 32) | 0xFFFFFFFFULL);
+    return end - begin;
+}
+
+size_t triple_store::count_objects(uint32_t subject_id, uint32_t predicate_id) const{
+    unordered_map<uint32_t, uint32_t>::const_iterator itr = _predicate_index.find(predicate_id);
+    return (itr == _predicate_index.end()) ? 0 : count_range(_so_keys[itr->second], subject_id);
+}
+
+size_t triple_store::count_subjects(uint32_t object_id, uint32_t predicate_id) const{
+    unordered_map<uint32_t, uint32_t>::const_iterator itr = _predicate_index.find(predicate_id);
+    return (itr == _predicate_index.end()) ? 0 : count_range(_os_keys[itr->second], object_id);
+}
+
+size_t triple_store::memory_usage() const{
+    size_t result = _dictionary.memory_usage();
+    for (size_t i = 0; i < _so_keys.size(); i++){
+        result += (_so_keys[i].capacity() + _os_keys[i].capacity()) * sizeof(uint64_t);
+    }
+    return result;
+}
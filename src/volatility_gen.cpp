@@ -11,7 +11,8 @@
 
 using namespace std;
 
-volatility_gen::volatility_gen(const char * frequency_sample_file, double location, VOLATILITY_MODEL::enum_t distribution, const char * volatility_sample_file){
+volatility_gen::volatility_gen(const char * frequency_sample_file, double location, VOLATILITY_MODEL::enum_t distribution, const char * volatility_sample_file,
+                               double advance_fraction){
     random_device rd;
     _rd_gen = new mt19937 (rd());
     _uniform_real_distribution = new uniform_real_distribution<> (0, 1);
@@ -21,6 +22,11 @@ volatility_gen::volatility_gen(const char * frequency_sample_file, double locati
 
     _location = location;
     _distribution = distribution;
+    _advance_fraction = advance_fraction;
+    _tree_step = 0;
+    _total_frequency = 0.0;
+    _update_count = 0;
+    _tick = 0;
 
     string token;
     ifstream ifs_freq (frequency_sample_file);
@@ -56,8 +62,8 @@ volatility_gen::volatility_gen(const char * frequency_sample_file, double locati
 }
 
 volatility_gen::volatility_gen(const volatility_gen & rhs){
-    random_device rd;
-    _rd_gen = new mt19937 (rd());
+    // The copy continues the random stream of rhs...
+    _rd_gen = new mt19937 (*rhs._rd_gen);
     _uniform_real_distribution = new uniform_real_distribution<> (0, 1);
 
     _instantiated = rhs._instantiated;
@@ -65,24 +71,28 @@ volatility_gen::volatility_gen(const volatility_gen & rhs){
     _location = rhs._location;
     _max_frequency = rhs._max_frequency;
     _distribution = rhs._distribution;
+    _advance_fraction = rhs._advance_fraction;
     _frequency_sample.insert(_frequency_sample.begin(), rhs._frequency_sample.cbegin(), rhs._frequency_sample.cend());
     _gen_frequency.insert(_gen_frequency.begin(), rhs._gen_frequency.cbegin(), rhs._gen_frequency.cend());
     _volatility_sample.insert(_volatility_sample.begin(), rhs._volatility_sample.cbegin(), rhs._volatility_sample.cend());
     _gen_volatility.insert(_gen_volatility.begin(), rhs._gen_volatility.cbegin(), rhs._gen_volatility.cend());
 
     _dynamic_frequency_array = new double [_model_size];
-    _cum_density_array = new double [_model_size];
     for (int i=0; i<_model_size; i++){
         _dynamic_frequency_array[i] = rhs._dynamic_frequency_array[i];
-        _cum_density_array[i] = rhs._cum_density_array[i];
     }
+    _frequency_tree = rhs._frequency_tree;
+    _tree_step = rhs._tree_step;
+    _total_frequency = rhs._total_frequency;
+    _update_count = rhs._update_count;
+    _selected_tick = rhs._selected_tick;
+    _tick = rhs._tick;
 }
 
 volatility_gen::~volatility_gen(){
     delete _rd_gen;
     delete _uniform_real_distribution;
     if (_model_size>0){
-        delete [] _cum_density_array;
         delete [] _dynamic_frequency_array;
     }
 }
@@ -90,10 +100,8 @@ volatility_gen::~volatility_gen(){
 void volatility_gen::initialize (int model_size){
     _model_size = model_size;
     _dynamic_frequency_array = new double [_model_size];
-    _cum_density_array = new double[_model_size];
     _max_frequency = 0.0;
 
-    double total_frequency = 0.0;
     for (int i=0; i<_model_size; i++){
         double rand_index = next_uniform() * (double)(_frequency_sample.size()-1);
         double range_min = _frequency_sample[floor(rand_index)];
@@ -104,7 +112,6 @@ void volatility_gen::initialize (int model_size){
         }
         _gen_frequency.push_back(interpolated);
         _dynamic_frequency_array[i] = interpolated;
-        total_frequency = total_frequency + interpolated;
     }
     for (int i=0; i<_model_size; i++){
         double rand_index = next_uniform() * (double)(_volatility_sample.size()-1);
@@ -114,13 +121,11 @@ void volatility_gen::initialize (int model_size){
         _gen_volatility.push_back(interpolated);
     }
 
-    for (int i=0; i<_model_size; i++){
-        if (i==0){
-            _cum_density_array[i] = _dynamic_frequency_array[i] / total_frequency;
-        } else {
-            _cum_density_array[i] = _cum_density_array[i-1] + (_dynamic_frequency_array[i] / total_frequency);
-        }
+    _tree_step = 1;
+    while (_tree_step * 2 <= _model_size){
+        _tree_step = _tree_step * 2;
     }
+    build_tree();
 
     _max_frequency = _max_frequency * 1000;
     _instantiated = true;
@@ -133,39 +138,79 @@ void volatility_gen::initialize (int model_size){
     warmup();
 }
 
+// Restarts the random stream from seed. Models are seeded from random_device until then...
+void volatility_gen::seed (unsigned int seed){
+    _rd_gen->seed(seed);
+}
+
 bool volatility_gen::is_initialized () const{
     return _instantiated;
 }
 
 double volatility_gen::advance (){
-    double total_frequency = 0.0;
-    for (int i=0; i<_model_size; i++){
-        double ln_inc = get_next_ln_increase(i);
-        _dynamic_frequency_array[i] = _dynamic_frequency_array[i] * exp(ln_inc);
-        if (_dynamic_frequency_array[i] < 1.0){
-            _dynamic_frequency_array[i] = 1.0;
+    if (_advance_fraction >= 1.0){
+        for (int i=0; i<_model_size; i++){
+            _dynamic_frequency_array[i] = next_frequency(i);
         }
-        if (_dynamic_frequency_array[i] > _max_frequency){
-            _dynamic_frequency_array[i] = _max_frequency;
+        build_tree();
+    } else {
+        // Floyd's algorithm draws advance_count distinct entities uniformly...
+        int advance_count = max(1, (int) (_advance_fraction * (double) _model_size));
+        // An entity is selected in this tick if it is stamped with _tick...
+        if (++_tick == 0 || _selected_tick.size() != (size_t) _model_size){
+            _selected_tick.assign(_model_size, 0);
+            _tick = 1;
         }
-        total_frequency += _dynamic_frequency_array[i];
+        for (int j=(_model_size-advance_count); j<_model_size; j++){
+            int index = min((int) (next_uniform() * (double) (j+1)), j);
+            if (_selected_tick[index] == _tick){
+                index = j;
+            }
+            _selected_tick[index] = _tick;
+            update_frequency(index, next_frequency(index));
+        }
+        _update_count += advance_count;
+        if (_update_count >= _model_size){
+            build_tree();
+        }
+    }
+    cerr << "Advancing..." << "\n";
+    return _total_frequency;
+}
 
-        //cout << "log-increase [" << i << "] = " << ln_inc << "\n";
-        //cout << "ovr-increase [" << i << "] = " << exp(ln_inc) << "\n";
-        //cout << "frequency [" << i << "] = " << _dynamic_frequency_array[i] << "\n";
+// Frequency of an entity after one more log-increase, within [1, _max_frequency]...
+double volatility_gen::next_frequency (int index) const{
+    double frequency = _dynamic_frequency_array[index] * exp(get_next_ln_increase(index));
+    if (frequency < 1.0){
+        frequency = 1.0;
     }
-    for (int i=0; i<_model_size; i++){
-        if (i==0){
-            _cum_density_array[i] = _dynamic_frequency_array[i] / total_frequency;
-        } else {
-            _cum_density_array[i] = _cum_density_array[i-1] + (_dynamic_frequency_array[i] / total_frequency);
+    if (frequency > _max_frequency){
+        frequency = _max_frequency;
+    }
+    return frequency;
+}
+
+void volatility_gen::build_tree (){
+    _frequency_tree.assign(_model_size+1, 0.0);
+    _total_frequency = 0.0;
+    for (int i=1; i<=_model_size; i++){
+        _frequency_tree[i] += _dynamic_frequency_array[i-1];
+        _total_frequency += _dynamic_frequency_array[i-1];
+        int parent = i + (i & -i);
+        if (parent <= _model_size){
+            _frequency_tree[parent] += _frequency_tree[i];
         }
+    }
+    _update_count = 0;
+}
 
-        //cout << "probability [" << i << "] = " << (_dynamic_frequency_array[i] / total_frequency) << "\n";
+void volatility_gen::update_frequency (int index, double frequency){
+    double delta = frequency - _dynamic_frequency_array[index];
+    _dynamic_frequency_array[index] = frequency;
+    for (int i=index+1; i<=_model_size; i+=(i & -i)){
+        _frequency_tree[i] += delta;
     }
-    //cout << "Total frequency = " << total_frequency << "\n";
-    cerr << "Advancing..." << "\n";
-    return total_frequency;
+    _total_frequency += delta;
 }
 
 void volatility_gen::warmup (){
@@ -233,17 +278,30 @@ double volatility_gen::get_next_ln_increase (int index) const{
 }
 
 double volatility_gen::get_probability (int index) const{
-    if (index==0){
-        return _cum_density_array[index];
-    } else {
-        return (_cum_density_array[index] - _cum_density_array[(index-1)]);
-    }
+    return _dynamic_frequency_array[index] / _total_frequency;
 }
 
+// Descends the Fenwick tree to the first entity whose cumulative frequency reaches the
+// pivot, as a binary search over the cumulative distribution would...
 int volatility_gen::next_rand_index () const{
-    double pivot = next_uniform();
-    double * location = lower_bound(_cum_density_array, _cum_density_array+_model_size, pivot);
-    return (location-_cum_density_array);
+    double pivot = next_uniform() * _total_frequency;
+    int position = 0;
+    for (int step=_tree_step; step>0; step>>=1){
+        if (position + step <= _model_size && _frequency_tree[position + step] < pivot){
+            position += step;
+            pivot -= _frequency_tree[position];
+        }
+    }
+    return min(position, _model_size-1);
+}
+
+// Sum of the frequencies of the first count entities, read from the tree...
+double volatility_gen::get_cumulative_frequency (int count) const{
+    double result = 0.0;
+    for (int i=min(count, _model_size); i>0; i-=(i & -i)){
+        result += _frequency_tree[i];
+    }
+    return result;
 }
 
 double volatility_gen::next_uniform() const{
@@ -255,6 +313,7 @@ volatility_gen * volatility_gen::parse (const string & line, string & name, floa
     VOLATILITY_MODEL::enum_t distribution = VOLATILITY_MODEL::UNDEFINED;
     string frequency_sample_file;
     string volatility_sample_file;
+    double advance_fraction = 1.0;
 
     stringstream parser(line);
     int index = 0;
@@ -304,14 +363,22 @@ volatility_gen * volatility_gen::parse (const string & line, string & name, floa
                 advance_pr = boost::lexical_cast<float>(token);
                 break;
             }
+            case 7:{
+                advance_fraction = boost::lexical_cast<double>(token);
+                if (advance_fraction <= 0.0 || advance_fraction > 1.0){
+                    cerr<<"[volatility_gen::parse()]\tThe advance fraction must be in (0, 1]..."<<"\n";
+                    exit(0);
+                }
+                break;
+            }
         }
         index++;
     }
-    if (index!=7){
+    if (index!=7 && index!=8){
         cerr<<"[volatility_gen::parse()]\tUnsupported number of arguments..."<<"\n";
         exit(0);
     }
-    return new volatility_gen(frequency_sample_file.c_str(), location, distribution, volatility_sample_file.c_str());
+    return new volatility_gen(frequency_sample_file.c_str(), location, distribution, volatility_sample_file.c_str(), advance_fraction);
 }
 
 void volatility_gen::test (){
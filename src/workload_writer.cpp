@@ -0,0 +1,82 @@
+#include "../include/workload_writer.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+
+static const char QUERY_DELIMITER[] = "#end\n";
+
+workload_writer::workload_writer(output_sink * sink, bool pull) : _buffer(sink, FLUSH_THRESHOLD){
+    _sink = sink;
+    _pull = pull;
+    _request_fd = -1;
+    _closed = false;
+    _credit = 0;
+    _query_count = 0;
+    if (_pull){
+        // Requests come back on the connection of a tcp: sink, and on stdin otherwise...
+        struct stat fd_stat;
+        _request_fd = (fstat(_sink->_fd, &fd_stat) == 0 && S_ISSOCK(fd_stat.st_mode)) ? _sink->_fd : STDIN_FILENO;
+        // A consumer that goes away shows up as the end of its requests instead...
+        signal(SIGPIPE, SIG_IGN);
+    }
+}
+
+workload_writer::~workload_writer(){
+    flush();
+}
+
+bool workload_writer::write(const string & query){
+    if (_pull && _credit == 0 && !wait_for_credit()){
+        return false;
+    }
+    _buffer.append(query);
+    _query_count++;
+    if (_pull){
+        _buffer.append(QUERY_DELIMITER, sizeof(QUERY_DELIMITER) - 1);
+        if (--_credit == 0){
+            _buffer.flush();
+        }
+    }
+    return true;
+}
+
+void workload_writer::flush(){
+    _buffer.flush();
+}
+
+// Reads requests until one of them asks for at least one query, and returns false if
+// the consumer closes its side first...
+bool workload_writer::wait_for_credit(){
+    _buffer.flush();
+    while (_credit == 0 && !_closed){
+        char * newline = (char *) memchr(_request.data(), '\n', _request.size());
+        if (newline != NULL){
+            string line (_request.data(), newline);
+            _request.erase(_request.begin(), _request.begin() + (newline - _request.data()) + 1);
+            char * end = NULL;
+            unsigned long long count = strtoull(line.c_str(), &end, 10);
+            _credit = (end == line.c_str()) ? 1 : count;
+            continue;
+        }
+        char data[4096];
+        ssize_t count = ::read(_request_fd, data, sizeof(data));
+        if (count < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            cerr << "[workload_writer::wait_for_credit()]\tFailed to read the requests: " << strerror(errno) << "\n";
+            exit(0);
+        }
+        if (count == 0){
+            _closed = true;
+        }
+        _request.insert(_request.end(), data, data + count);
+    }
+    return _credit > 0;
+}
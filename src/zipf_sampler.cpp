@@ -0,0 +1,209 @@
+#include "../include/zipf_sampler.h"
+#include "../include/counter_rng.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
+
+namespace bpt = boost::posix_time;
+
+static const uint32_t FULL_THRESHOLD = 0x80000000u;
+
+// Above this many items, alias tables cost more memory and setup time than they save...
+static unsigned int TABLE_LIMIT = 1 << 20;
+
+// Tables are never released, so that pointers handed out by get() stay valid...
+static mutex sampler_mutex;
+static map<unsigned int, zipf_sampler *> sampler_cache;
+static thread_local unordered_map<unsigned int, const zipf_sampler *> local_sampler_cache;
+
+static uint32_t to_threshold(double probability){
+    if (probability >= 1.0){
+        return FULL_THRESHOLD;
+    }
+    return (probability <= 0.0) ? 0 : (uint32_t) (probability * (double) FULL_THRESHOLD);
+}
+
+zipf_sampler::zipf_sampler(unsigned int item_count, bool use_table){
+    _item_count = item_count;
+    _h_integral_x1 = log(1.5) - 1.0;
+    _h_integral_n = log((double) item_count + 0.5);
+    _squeeze = 2.0 - exp(log(2.5) - 0.5);
+    if (use_table){
+        build_table();
+    }
+}
+
+// Vose's construction: columns whose scaled probability is below 1 are topped up
+// by an alias taken from the columns above 1...
+void zipf_sampler::build_table(){
+    unsigned int item_count = _item_count;
+    _columns.resize(item_count);
+
+    // Sum from the smallest weight up, to limit the rounding error...
+    double harmonic = 0.0;
+    for (unsigned int i = item_count; i > 0; i--){
+        harmonic += 1.0 / ((double) i);
+    }
+
+    vector<double> probabilities (item_count);
+    vector<uint32_t> small, large;
+    for (unsigned int i = 0; i < item_count; i++){
+        probabilities[i] = ((double) item_count) / (harmonic * ((double) (i + 1)));
+        if (probabilities[i] < 1.0){
+            small.push_back(i);
+        } else {
+            large.push_back(i);
+        }
+    }
+    while (!small.empty() && !large.empty()){
+        uint32_t s = small.back(), l = large.back();
+        small.pop_back();
+        _columns[s]._threshold = to_threshold(probabilities[s]);
+        _columns[s]._alias = l;
+        probabilities[l] = (probabilities[l] + probabilities[s]) - 1.0;
+        if (probabilities[l] < 1.0){
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left over is 1 up to rounding errors...
+    for (vector<uint32_t>::const_iterator itr = large.begin(); itr != large.end(); itr++){
+        _columns[*itr]._threshold = FULL_THRESHOLD;
+        _columns[*itr]._alias = *itr;
+    }
+    for (vector<uint32_t>::const_iterator itr = small.begin(); itr != small.end(); itr++){
+        _columns[*itr]._threshold = FULL_THRESHOLD;
+        _columns[*itr]._alias = *itr;
+    }
+}
+
+size_t zipf_sampler::memory_usage() const{
+    return sizeof(zipf_sampler) + _columns.capacity() * sizeof(column_st);
+}
+
+unsigned int zipf_sampler::table_limit(){
+    return TABLE_LIMIT;
+}
+
+// Only affects samplers that are not built yet...
+void zipf_sampler::set_table_limit(unsigned int item_count){
+    TABLE_LIMIT = item_count;
+}
+
+// Returns the shared sampler for item_count, building it on first use. Every thread
+// remembers the samplers it has seen, so the lock is only taken once per item count...
+const zipf_sampler * zipf_sampler::get(unsigned int item_count){
+    unordered_map<unsigned int, const zipf_sampler *>::const_iterator f_it = local_sampler_cache.find(item_count);
+    if (f_it != local_sampler_cache.end()){
+        return f_it->second;
+    }
+    const zipf_sampler * result = NULL;
+    {
+        lock_guard<mutex> lock(sampler_mutex);
+        map<unsigned int, zipf_sampler *>::iterator s_it = sampler_cache.find(item_count);
+        if (s_it == sampler_cache.end()){
+            s_it = sampler_cache.insert(pair<unsigned int, zipf_sampler *>(item_count, new zipf_sampler(item_count, item_count <= TABLE_LIMIT))).first;
+        }
+        result = s_it->second;
+    }
+    local_sampler_cache[item_count] = result;
+    return result;
+}
+
+static double elapsed_seconds(const bpt::ptime & begin){
+    return (double) (bpt::microsec_clock::universal_time() - begin).total_microseconds() / 1000000.0;
+}
+
+// Compares both samplers against the harmonic CDF with a binary search per draw,
+// which is how model::generate_zipfian() used to sample. Reports setup time, draws/sec,
+// memory and the observed frequency of rank 0 against its exact probability. The
+// table-based samplers are skipped above 10^8 items...
+void zipf_sampler::benchmark(){
+    const unsigned int DRAW_COUNT = 10000000;
+    const unsigned int MAX_TABLE_ITEMS = 100000000;
+    cout << "item_count" << "\t" << "p(rank0)"
+         << "\t" << "cdf_setup_s" << "\t" << "cdf_draws/s" << "\t" << "cdf_MB" << "\t" << "cdf_p(rank0)"
+         << "\t" << "alias_setup_s" << "\t" << "alias_draws/s" << "\t" << "alias_MB" << "\t" << "alias_p(rank0)"
+         << "\t" << "rejection_draws/s" << "\t" << "rejection_p(rank0)"
+         << "\n";
+    for (unsigned long long item_count = 1000; item_count <= 1000000000; item_count *= 10){
+        double harmonic = 0.0;
+        for (unsigned long long i = item_count; i > 0; i--){
+            harmonic += 1.0 / ((double) i);
+        }
+        cout << item_count << "\t" << (1.0 / harmonic);
+
+        counter_rng rng;
+        auto next_bits = [&rng]() { return rng() >> 1; };
+        unsigned long long checksum = 0;
+        unsigned int rank0_count = 0;
+        if (item_count <= MAX_TABLE_ITEMS){
+            rng.seed(1024);
+            bpt::ptime t1(bpt::microsec_clock::universal_time());
+            vector<double> intervals;
+            double offset = 0.0;
+            for (unsigned int i = 1; i <= item_count; i++){
+                offset += 1.0 / ((double) i);
+                intervals.push_back(offset);
+            }
+            double scale_factor = 1.0 / offset;
+            for (unsigned int cursor = 0; cursor < item_count; cursor++){
+                intervals[cursor] = intervals[cursor] * scale_factor;
+            }
+            double setup = elapsed_seconds(t1);
+            bpt::ptime t2(bpt::microsec_clock::universal_time());
+            for (unsigned int d = 0; d < DRAW_COUNT; d++){
+                double random_value = ((double) next_bits()) / ((double) 0x7FFFFFFF);
+                unsigned int rank = lower_bound(intervals.begin(), intervals.end(), random_value) - intervals.begin();
+                checksum += rank;
+                rank0_count += (rank == 0);
+            }
+            double seconds = elapsed_seconds(t2);
+            cout << "\t" << setup << "\t" << (DRAW_COUNT / seconds)
+                 << "\t" << ((double) (intervals.capacity() * sizeof(double)) / (1024.0 * 1024.0))
+                 << "\t" << ((double) rank0_count / DRAW_COUNT);
+        } else {
+            cout << "\t-\t-\t-\t-";
+        }
+        if (item_count <= MAX_TABLE_ITEMS){
+            rank0_count = 0;
+            rng.seed(1024);
+            bpt::ptime t1(bpt::microsec_clock::universal_time());
+            zipf_sampler sampler (item_count, true);
+            double setup = elapsed_seconds(t1);
+            bpt::ptime t2(bpt::microsec_clock::universal_time());
+            for (unsigned int d = 0; d < DRAW_COUNT; d++){
+                unsigned int rank = sampler.draw(next_bits);
+                checksum += rank;
+                rank0_count += (rank == 0);
+            }
+            double seconds = elapsed_seconds(t2);
+            cout << "\t" << setup << "\t" << (DRAW_COUNT / seconds)
+                 << "\t" << ((double) sampler.memory_usage() / (1024.0 * 1024.0))
+                 << "\t" << ((double) rank0_count / DRAW_COUNT);
+        } else {
+            cout << "\t-\t-\t-\t-";
+        }
+        {
+            rank0_count = 0;
+            rng.seed(1024);
+            zipf_sampler sampler (item_count, false);
+            bpt::ptime t2(bpt::microsec_clock::universal_time());
+            for (unsigned int d = 0; d < DRAW_COUNT; d++){
+                unsigned int rank = sampler.draw(next_bits);
+                checksum += rank;
+                rank0_count += (rank == 0);
+            }
+            double seconds = elapsed_seconds(t2);
+            cout << "\t" << (DRAW_COUNT / seconds)
+                 << "\t" << ((double) rank0_count / DRAW_COUNT);
+        }
+        cout << "\t" << "(checksum " << checksum << ")" << "\n";
+        cout.flush();
+    }
+}
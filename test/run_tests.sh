@@ -0,0 +1,52 @@
+#!/bin/sh
+# Runs the unit tests, and checks watdiv end to end on the WSDBM model:
+#   - data and saved model do not depend on the number of threads (-d ... -j),
+#   - the binary snapshot loads into the same model as saved.txt (-lb),
+#   - query workloads do not depend on the number of threads (-q ... -j), only on -seed.
+#
+# Usage: run_tests.sh <watdiv-binary> <unit-tests-binary>
+
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+WATDIV=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+UNIT_TESTS=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+MODEL=$REPO/model/wsdbm-data-model.txt
+
+# watdiv reads its dictionaries from ../../files...
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+mkdir -p "$WORK/a/b"
+ln -s "$REPO/files" "$WORK/files"
+cd "$WORK/a/b" || exit 1
+
+FAILURES=0
+report (){
+    if [ "$1" -eq 0 ]; then
+        echo "[run_tests]	$2: ok"
+    else
+        echo "[run_tests]	$2: FAILED"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+"$UNIT_TESTS"
+report $? "unit tests"
+
+"$WATDIV" -d "$MODEL" 1 -j 1 > data_1.nt 2> /dev/null && mv saved.txt saved_1.txt &&
+"$WATDIV" -d "$MODEL" 1 -j 4 > data_4.nt 2> /dev/null &&
+cmp -s data_1.nt data_4.nt && cmp -s saved_1.txt saved.txt
+report $? "data with -j 1 and -j 4"
+
+"$WATDIV" -lb "$MODEL" 2> /dev/null | tail -n 1 | cut -f 8 | grep -qx yes
+report $? "snapshot round trip"
+
+"$WATDIV" -q "$MODEL" "$REPO"/testsuite/*.txt 200 5 -j 1 > queries_1.txt 2> /dev/null &&
+"$WATDIV" -q "$MODEL" "$REPO"/testsuite/*.txt 200 5 -j 4 > queries_4.txt 2> /dev/null &&
+"$WATDIV" -q "$MODEL" "$REPO"/testsuite/*.txt 200 5 > queries_0.txt 2> /dev/null &&
+[ -s queries_1.txt ] && cmp -s queries_1.txt queries_4.txt && cmp -s queries_0.txt queries_4.txt
+report $? "queries without -j, with -j 1 and -j 4"
+
+"$WATDIV" -q "$MODEL" "$REPO"/testsuite/*.txt 200 5 -seed 7 > queries_seed.txt 2> /dev/null &&
+[ -s queries_seed.txt ] && ! cmp -s queries_seed.txt queries_4.txt
+report $? "queries with another -seed"
+
+[ "$FAILURES" -eq 0 ]
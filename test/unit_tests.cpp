@@ -0,0 +1,258 @@
+#include "../include/counter_rng.h"
+#include "../include/stream_sorter.h"
+#include "../include/volatility_gen.h"
+#include "../include/zipf_sampler.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Unit tests of the components that can be checked without a model: the Zipfian
+// sampler against the exact distribution, the external sort against a stable
+// in-memory sort, and the Fenwick tree of volatility_gen against plain sums. The
+// end-to-end checks are in run_tests.sh...
+
+static int failure_count = 0;
+
+static void check(bool condition, const string & test, const string & message){
+    if (!condition){
+        cerr << "[" << test << "]\tFAILED: " << message << "\n";
+        failure_count++;
+    }
+}
+
+// Uniform values in [0, 2^31), as zipf_sampler::draw() expects...
+struct bits_gen_st{
+    counter_rng     _rng;
+
+    bits_gen_st(uint32_t seed){
+        _rng.seed(seed);
+    }
+
+    uint32_t operator()(){
+        return _rng() >> 1;
+    }
+};
+
+// Draws from both kinds of sampler, and compares the frequency of the first ranks
+// with 1/(i+1)/H(n), within 5 standard deviations...
+static void test_zipf_sampler(){
+    const unsigned int DRAW_COUNT = 400000;
+    unsigned int item_counts[] = {1, 10, 1000, 100000};
+    for (unsigned int c = 0; c < sizeof(item_counts) / sizeof(item_counts[0]); c++){
+        unsigned int item_count = item_counts[c];
+        double harmonic = 0.0;
+        for (unsigned int i = 0; i < item_count; i++){
+            harmonic += 1.0 / (double) (i + 1);
+        }
+        for (int use_table = 0; use_table < 2; use_table++){
+            string test = string("zipf_sampler/") + (use_table ? "table/" : "rejection/") + to_string(item_count);
+            zipf_sampler sampler (item_count, use_table != 0);
+            bits_gen_st next_bits (item_count * 2 + use_table);
+            unsigned int rank_count = min(item_count, 20u);
+            vector<unsigned int> counts (rank_count, 0);
+            bool in_range = true;
+            for (unsigned int d = 0; d < DRAW_COUNT; d++){
+                unsigned int rank = sampler.draw(next_bits);
+                in_range = in_range && rank < item_count;
+                if (rank < rank_count){
+                    counts[rank]++;
+                }
+            }
+            check(in_range, test, "rank out of range");
+            for (unsigned int i = 0; i < rank_count; i++){
+                double expected = 1.0 / (double) (i + 1) / harmonic;
+                double observed = (double) counts[i] / (double) DRAW_COUNT;
+                double tolerance = 5.0 * sqrt(expected * (1.0 - expected) / (double) DRAW_COUNT) + 1e-4;
+                check(fabs(observed - expected) <= tolerance, test,
+                      "rank " + to_string(i) + " drawn with frequency " + to_string(observed) +
+                      " instead of " + to_string(expected));
+            }
+        }
+    }
+    check(zipf_sampler::get(1000) == zipf_sampler::get(1000), "zipf_sampler/get", "samplers are not shared");
+}
+
+static bool read_lines(const string & filename, vector<string> & lines){
+    ifstream ifs (filename.c_str());
+    if (!ifs){
+        return false;
+    }
+    string line;
+    while (getline(ifs, line)){
+        lines.push_back(line);
+    }
+    return true;
+}
+
+// Sorts records with a few distinct keys (so that there are ties), records without
+// a numeric key and empty records, and compares the result with std::stable_sort...
+static void test_stream_sorter(const string & test, unsigned int record_count, unsigned int thread_count, bool spills){
+    string output_file = "unit_tests_sorted.txt";
+    vector<pair<double, string> > expected;
+    bits_gen_st next_bits (record_count + thread_count);
+    stream_sorter sorter (output_file, 0, thread_count);
+    for (unsigned int i = 0; i < record_count; i++){
+        unsigned int kind = next_bits() % 100;
+        string record;
+        if (kind == 0){
+            record = "";
+        } else if (kind == 1){
+            record = "s" + to_string(i) + "\tp\to";
+        } else if (kind == 2){
+            record = "s" + to_string(i) + "\tp\to\tnot-a-time";
+        } else {
+            record = "s" + to_string(i) + "\tp\to\t" + to_string(next_bits() % 1000);
+        }
+        sorter.add(record);
+        if (!record.empty()){
+            expected.push_back(pair<double, string>(stream_sorter::parse_key(record.data(), record.size()), record));
+        }
+    }
+    check((sorter.run_count() > 0) == spills, test, to_string(sorter.run_count()) + " runs written");
+    sorter.finish();
+    stable_sort(expected.begin(), expected.end(),
+                [](const pair<double, string> & lhs, const pair<double, string> & rhs){ return lhs.first < rhs.first; });
+
+    vector<string> lines;
+    check(read_lines(output_file, lines), test, "no output file");
+    check(sorter.record_count() == expected.size(), test, "wrong record count");
+    check(lines.size() == expected.size(), test,
+          to_string(lines.size()) + " records written instead of " + to_string(expected.size()));
+    for (size_t i = 0; i < lines.size() && i < expected.size(); i++){
+        if (lines[i] != expected[i].second){
+            check(false, test, "record " + to_string(i) + " is '" + lines[i] + "' instead of '" + expected[i].second + "'");
+            break;
+        }
+    }
+    remove(output_file.c_str());
+}
+
+// volatility_gen reports every advance on cerr, which is muted while it runs...
+struct quiet_st{
+    stringstream    _sink;
+    streambuf *     _cerr;
+
+    quiet_st(){
+        _cerr = cerr.rdbuf(_sink.rdbuf());
+    }
+
+    ~quiet_st(){
+        cerr.rdbuf(_cerr);
+    }
+};
+
+static void write_samples(const string & filename, double first, double step, int count){
+    ofstream ofs (filename.c_str());
+    for (int i = 0; i < count; i++){
+        ofs << (first + step * i) << "\n";
+    }
+}
+
+// The frequency of every entity, recovered from its probability and the total that
+// advance() returns...
+static void get_frequencies(const volatility_gen & generator, double total, vector<double> & frequencies){
+    frequencies.resize(generator.get_model_size());
+    for (int i = 0; i < generator.get_model_size(); i++){
+        frequencies[i] = generator.get_probability(i) * total;
+    }
+}
+
+// Advances a model partially, and checks after every tick that exactly max(1, f*n)
+// entities changed, and that the prefix sums of the tree and the total are the plain
+// sums of the frequencies. Then checks the draws of next_rand_index() against get_probability().
+// The frequencies stay far from the clamps of next_frequency(), and every volatility
+// is positive, so every selected entity does change...
+static void test_volatility_gen(double advance_fraction){
+    const int MODEL_SIZE = 1000;
+    const int TICK_COUNT = 25;
+    const unsigned int DRAW_COUNT = 400000;
+    string test = "volatility_gen/" + to_string(advance_fraction);
+    string frequency_file = "unit_tests_frequency.txt", volatility_file = "unit_tests_volatility.txt";
+    write_samples(frequency_file, 1000.0, 10.0, 100);
+    write_samples(volatility_file, 0.01, 0.001, 10);
+
+    volatility_gen generator (frequency_file.c_str(), 0.0, VOLATILITY_MODEL::NORMAL_DIST, volatility_file.c_str(),
+                              advance_fraction);
+    generator.seed(MODEL_SIZE);
+    double total = 0.0;
+    {
+        quiet_st quiet;
+        generator.initialize(MODEL_SIZE);
+        total = generator.advance();
+    }
+    int expected_changes = max(1, (int) (advance_fraction * MODEL_SIZE));
+    vector<double> before, after;
+    for (int tick = 0; tick < TICK_COUNT; tick++){
+        get_frequencies(generator, total, before);
+        {
+            quiet_st quiet;
+            total = generator.advance();
+        }
+        get_frequencies(generator, total, after);
+        int changes = 0, first_mismatch = -1;
+        double sum = 0.0;
+        for (int i = 0; i < MODEL_SIZE; i++){
+            changes += (fabs(after[i] - before[i]) > 1e-12 * before[i]) ? 1 : 0;
+            sum += after[i];
+            if (first_mismatch < 0 && fabs(generator.get_cumulative_frequency(i + 1) - sum) > 1e-9 * sum){
+                first_mismatch = i;
+            }
+        }
+        check(first_mismatch < 0, test,
+              "tick " + to_string(tick) + " has a wrong cumulative frequency at entity " + to_string(first_mismatch));
+        check(changes == expected_changes, test,
+              "tick " + to_string(tick) + " changed " + to_string(changes) + " entities instead of " + to_string(expected_changes));
+        check(fabs(sum - total) <= 1e-9 * total, test,
+              "tick " + to_string(tick) + " has a total of " + to_string(total) + " instead of " + to_string(sum));
+    }
+
+    vector<unsigned int> counts (MODEL_SIZE, 0);
+    bool in_range = true;
+    for (unsigned int d = 0; d < DRAW_COUNT; d++){
+        int index = generator.next_rand_index();
+        in_range = in_range && index >= 0 && index < MODEL_SIZE;
+        if (index >= 0 && index < MODEL_SIZE){
+            counts[index]++;
+        }
+    }
+    check(in_range, test, "index out of range");
+    for (int i = 0; i < MODEL_SIZE; i++){
+        double expected = generator.get_probability(i);
+        double observed = (double) counts[i] / (double) DRAW_COUNT;
+        double tolerance = 5.0 * sqrt(expected * (1.0 - expected) / (double) DRAW_COUNT) + 1e-4;
+        if (fabs(observed - expected) > tolerance){
+            check(false, test, "entity " + to_string(i) + " drawn with frequency " + to_string(observed) +
+                               " instead of " + to_string(expected));
+            break;
+        }
+    }
+    remove(frequency_file.c_str());
+    remove(volatility_file.c_str());
+}
+
+int main(){
+    test_zipf_sampler();
+    // Full ticks rebuild the tree, partial ones update it (and rebuild it every n updates)...
+    test_volatility_gen(1.0);
+    test_volatility_gen(0.1);
+    test_volatility_gen(0.0001);
+    // Fits into one chunk...
+    test_stream_sorter("stream_sorter/memory", 1000, 1, false);
+    // Spills a few runs of at least 1 MB, which are merged with the last chunk...
+    test_stream_sorter("stream_sorter/runs", 200000, 2, true);
+    if (failure_count > 0){
+        cerr << "[unit_tests]\t" << failure_count << " checks failed..." << "\n";
+        return 1;
+    }
+    cerr << "[unit_tests]\tAll checks passed..." << "\n";
+    return 0;
+}